@@ -1,8 +1,12 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
 #include <time.h>
 #include <malloc.h>
+#include <sys/stat.h>
 #include "io.h"
 #include <linmath.h>
 #include "hash.h"
@@ -14,6 +18,25 @@
 #include <stb_truetype.h>
 #include <stb_image.h>
 #include <SDL.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UI_SSE2
+#endif
+#if defined(_MSC_VER)
+#define UI_THREAD_LOCAL __declspec(thread)
+#else
+#define UI_THREAD_LOCAL _Thread_local
+#endif
+
+// Bumped on every texture upload, lets streams skip reading back textures that can't have changed
+static SDL_atomic_t ui_texture_generation_;
 
 static const float ui_color_white[] = { 1.f, 1.f, 1.f, 1.f };
 
@@ -24,6 +47,15 @@ enum
 	k_EUIStyleSelectorMax
 } k_EUIStyleSelector;
 
+// Baked glyph quads in structure-of-arrays form so text runs can be generated several glyphs at a time
+typedef struct
+{
+	float xoff[96], yoff[96]; // Include the +0.5 stbtt_GetBakedQuad adds before flooring
+	float width[96], height[96];
+	float s0[96], t0[96], s1[96], t1[96];
+	float advance[96];
+} UIGlyphTable;
+
 typedef struct UIFont_s
 {
 	char path[256];
@@ -33,6 +65,10 @@ typedef struct UIFont_s
 	stbtt_bakedchar cdata[96];
 	stbtt_fontinfo font_info;
 	float height;
+	float ascent;
+	int bitmap_width, bitmap_height; // Dimensions of gl_texture, the glyphs may live in an atlas page
+	bool owns_texture; // False when gl_texture is an atlas page
+	UIGlyphTable glyphs;
 } UIFont;
 
 typedef struct
@@ -43,6 +79,9 @@ typedef struct
 typedef struct
 {
 	unsigned int image_id;
+	UITiledImage *tiled;
+	float zoom;
+	UIVec2 center;
 } UIImageElement;
 
 typedef struct
@@ -66,8 +105,52 @@ typedef struct
 	k_EUIInputElementType input_type;
 	void *out_value;
 	size_t out_value_length;
+	// Formatted numeric value and its measured width, filled from the number cache
+	char value_text[32];
+	float value_width;
+	bool value_cached;
+	// Cumulative advances of the displayed value in the frame's width arena, for the caret and selection
+	size_t value_widths, value_length;
+	bool value_measured;
 } UIInputElement;
 
+// Style properties as the renderer consumes them, interned per context
+typedef struct
+{
+	float border_thickness;
+	float margin;
+	float max_width, max_height;
+	float padding_x, padding_y;
+	unsigned char border_color[4];
+	unsigned char background_color[4];
+	unsigned char text_color[4];
+} UIResolvedStyle;
+
+#define UI_MAX_STYLES (65536) // Indices are 16-bit
+#define UI_STYLE_MEMO_SIZE (64)
+
+// Recently interned source props, skips packing and hashing for styles reused every element
+typedef struct
+{
+	const UIStyleProps *src;
+	UIStyleProps props;
+	uint16_t index;
+	bool valid;
+} UIStyleMemo;
+
+#define UI_NUMBER_CACHE_SIZE (1024)
+
+// Direct mapped on the bound variable's address, a collision only costs a reformat
+typedef struct
+{
+	const void *key;
+	uint32_t bits;
+	int precision;
+	k_EUIInputElementType type;
+	char text[32];
+	float width;
+} UINumberCacheEntry;
+
 typedef enum
 {
 	k_EUIElementTypeNone,
@@ -78,6 +161,9 @@ typedef enum
 	k_EUIElementTypeImage,
 	k_EUIElementTypePane,
 	k_EUIElementTypeFrame,
+	k_EUIElementTypePlot,
+	k_EUIElementTypeConsole,
+	k_EUIElementTypeEditor,
 	k_EUIElementTypeMax
 } k_EUIElementType;
 
@@ -86,35 +172,384 @@ typedef struct
 	float x, y, w, h;
 } UIRectangle;
 
+typedef struct
+{
+	float scroll_x;
+	double scroll_y; // Double so a list millions of rows long still scrolls by single pixels
+	float content_width;
+	double content_height; // Measured last frame
+} UIPaneState;
+
+typedef struct
+{
+	UIPaneState *state;
+} UIPaneElement;
+
+typedef struct
+{
+	int width;
+	size_t samples_per_column;
+	const float *values;
+	// Min/max of complete columns, slot is the absolute column index modulo capacity
+	float *bucket_min, *bucket_max;
+	uint64_t *bucket_index;
+	size_t capacity;
+	// Decimated window for this frame, one entry per pixel column
+	float *column_min, *column_max;
+	float *column_x0, *column_x1; // Relative to the content box
+	size_t numcolumns;
+	float lo, hi;
+} UIPlotState;
+
+typedef struct
+{
+	UIPlotState *state;
+	float color[4];
+} UIPlotElement;
+
+typedef struct
+{
+	UIConsole *console;
+	uint32_t first, last; // Visible line range
+	float line_height;
+	float color[4];
+} UIConsoleElement;
+
+struct UITextBuffer_s
+{
+	// Gap buffer, text is data[0, gap_start) followed by data[gap_end, capacity)
+	char *data;
+	size_t capacity;
+	size_t gap_start, gap_end;
+	// Offset of the first character of every line, widths are < 0 until measured
+	size_t *lines;
+	float *line_widths;
+	size_t numlines, maxlines;
+	float max_width;
+	size_t caret;
+	size_t anchor; // Selection is between anchor and caret
+	float desired_x; // Column the caret returns to when moving up and down through shorter lines
+	size_t page_lines;
+	bool changed;
+};
+
+typedef struct
+{
+	UITextBuffer *buffer;
+	size_t first, last; // Visible line range
+	float line_height;
+	bool focused;
+} UIEditorElement;
+
 typedef struct
 {
 	size_t index;
 	k_EUIElementType type;
 	// uint64_t id;
-	char label[256];
+	// Offsets into the frame's text and width arenas, 0 is the empty label
+	size_t label, label_length, label_widths;
 	union
 	{
 		UIButtonElement button;
 		UIInputElement input;
 		UICheckboxElement checkbox;
 		UIImageElement image;
+		UIPaneElement pane;
+		UIPlotElement plot;
+		UIConsoleElement console;
+		UIEditorElement editor;
 	} u;
 	UIRectangle rect;
-	UIStyleProps style;
+	UIRectangle clip; // Only valid if clipped
+	size_t clip_owner; // Pane element the clip rectangle came from
+	int transform, clip_transform; // Index into the frame's transforms, 0 is identity
+	bool clipped;
+	bool culled; // Entirely outside the clip rectangle, not drawn or interacted with
+	bool estimated; // Above or below the pane and sized without measuring, its width isn't known
+	uint16_t style; // Into the context's style table, already resolved for hovered or focused
+	float width, height; // Content box, from the style or size override, then the content
 	float content_width, content_height;
 } UIElement;
 
 typedef struct
 {
-	int buttons[3]; // Left, Middle, Right
+	int buttons[3]; // Left, Middle, Right, held down at the end of the frame's input
 	int x, y;
+	float wheel_x, wheel_y;
 } UIMouseState;
 
+typedef enum
+{
+	k_EUIInputEventMotion,
+	k_EUIInputEventButtonDown,
+	k_EUIInputEventButtonUp,
+	k_EUIInputEventWheel
+} k_EUIInputEvent;
+
+typedef struct
+{
+	k_EUIInputEvent type;
+	uint32_t timestamp; // SDL event time, oldest of the events merged into this one
+	int button;
+	int x, y;
+	float wheel_x, wheel_y;
+} UIInputEvent;
+
+// A left button press of the current frame, widgets take them in order
+typedef struct
+{
+	int button;
+	int x, y;
+	uint32_t timestamp;
+	bool consumed;
+} UIMousePress;
+
+#define UI_MAX_PANE_DEPTH (16)
+#define UI_PANE_SCROLLBAR_WIDTH (6.f)
+#define UI_PANE_SCROLL_STEP (40.f)
+
+typedef struct
+{
+	size_t element;
+	unsigned int id;
+	UIPaneState *state;
+	float saved_x, saved_y;
+	UIRectangle clip;
+	float content_x, content_y; // Unscrolled origin of the content
+	float max_x, max_y;
+	double extent_y; // Content height known without laying it out (ui_list), exact where max_y would round
+	bool estimated; // Has elements outside the clip that weren't measured
+	const UIList *list; // Set while a list row callback runs
+	float row_x, row_y;
+	int transform;
+} UIPane;
+
+#define UI_MAX_TRANSFORM_DEPTH (16)
+
+// 2D affine transform, x' = m[0] * x + m[2] * y + m[4], y' = m[1] * x + m[3] * y + m[5]
+typedef struct
+{
+	float m[6];
+	float inverse[6];
+} UIAffine;
+
+#define UI_MAX_LAYOUT_DEPTH (16)
+
+typedef struct
+{
+	size_t first_element;
+	UIRectangle rect; // As laid out this frame
+} UILayoutItem;
+
+typedef struct
+{
+	unsigned int hash; // Of everything the solve depends on, the origin is not part of it
+	size_t count, capacity;
+	float *positions; // x, y pairs relative to the layout origin
+	float width, height;
+} UILayoutCache;
+
 typedef struct
+{
+	unsigned int id;
+	UILayoutType type;
+	int columns;
+	float spacing;
+	UIVec2 max_size;
+	float origin_x, origin_y;
+	int pane_depth;
+	size_t first_element;
+	size_t first_item, numitems;
+	// Flow position of the next item when the cache has no position for it
+	float flow_x, flow_y, flow_extent;
+	UILayoutCache *cache;
+} UILayout;
+
+typedef struct UIStateEntry_s
+{
+	unsigned int id;
+	size_t size;
+	void (*destroy)(void *state); // Frees anything the state owns, called on cleanup
+	struct UIStateEntry_s *next;
+} UIStateEntry;
+
+// Persistent per-ID storage for widgets that keep state across frames
+typedef struct
+{
+	UIStateEntry **buckets;
+	size_t numbuckets;
+	size_t numentries;
+} UIStateStore;
+
+typedef struct UIImageCacheEntry_s
+{
+	char *path;
+	unsigned int hash;
+	time_t mtime;
+	unsigned int image_id;
+	int width, height, source_width, source_height;
+	size_t bytes;
+	int refcount;
+	bool stale; // File changed while acquired, reloaded once released
+	bool deferred; // Looked up off the GL thread, loaded by the next submission at deferred_size
+	UIVec2 deferred_size;
+	size_t last_frame;
+	unsigned int last_validated;
+	struct UIImageCacheEntry_s *hash_next;
+	struct UIImageCacheEntry_s *lru_prev, *lru_next; // lru_prev is more recently used
+} UIImageCacheEntry;
+
+typedef struct
+{
+	float position[2];
+	float texCoord[2];
+	unsigned char color[4];
+} UIGLVertex;
+
+typedef struct
+{
+	GLuint texture;
+	size_t first, count;
+	UIRectangle clip;
+	bool clipped;
+} UIDrawCommand;
+
+// Vertices for the whole frame, consecutive draws with the same texture are merged into one command
+typedef struct
+{
+	UIGLVertex *vertices;
+	size_t numvertices, maxvertices;
+	UIDrawCommand *commands;
+	size_t numcommands, maxcommands;
+	UIRectangle clip; // Applied to commands recorded from now on
+	bool clipped;
+	bool sealed; // Next allocation starts a new command even if it could be merged
+	// Everything submission needs, a published list doesn't refer back to the context
+	int width, height;
+	size_t frame;
+	uint32_t input_timestamp; // For input to submission latency, 0 if no input went into this frame
+	UITiledImage **tiled_images; // Have tiles waiting for upload
+	size_t numtiled_images, maxtiled_images;
+	SDL_Cursor *cursor;
+	bool text_input;
+	uint64_t generation; // Counts publications of the context, tells a drawn list from a newer one
+} UIDrawList;
+
+#define UI_ATLAS_PAGE_SIZE (1024)
+#define UI_ATLAS_PADDING (1) // On every side, filled with the rectangle's edge pixels
+#define UI_ATLAS_DEFAULT_MAX_IMAGE_SIZE (64)
+#define UI_ATLAS_DEFAULT_REPACK_THRESHOLD (0.25f)
+
+typedef struct
+{
+	int x, y, height;
+} UIAtlasShelf;
+
+typedef struct
+{
+	GLuint gl_texture;
+	unsigned char *pixels; // CPU copy, needed to repack without reading back from the GPU
+	UIAtlasShelf *shelves;
+	size_t numshelves, maxshelves;
+	int used_area, freed_area;
+	bool repack_pending; // Moves rectangles under lists already built, waits for ui_shared_retire_
+	bool upload_pending; // Changed off the GL thread, the whole page is uploaded by the next submission
+} UIAtlasPage;
+
+typedef struct
+{
+	int page; // -1 when the slot is free
+	int x, y, w, h;
+	bool pinned; // Font and white texel, never moved or freed
+	int next_free;
+} UIAtlasRect;
+
+typedef struct
+{
+	UIAtlasPage *pages;
+	size_t numpages;
+	UIAtlasRect *rects;
+	size_t numrects;
+	int free_rect;
+	int white_rect;
+	int max_image_size;
+	float repack_threshold;
+	size_t repacks;
+} UIAtlas;
+
+#define UI_IMAGE_CACHE_DEFAULT_BUDGET (128 * 1024 * 1024)
+#define UI_IMAGE_CACHE_REVALIDATE_MS (1000)
+
+typedef struct
+{
+	UIImageCacheEntry **buckets;
+	size_t numbuckets;
+	UIImageCacheEntry *lru_head, *lru_tail;
+	UIImageCacheStats stats;
+	bool downscale;
+	bool mipmaps;
+	size_t numdeferred;
+} UIImageCache;
+
+typedef struct
+{
+	int width, height; // Uploaded size
+	int source_width, source_height;
+	size_t bytes;
+} UIImageInfo;
+
+typedef enum
+{
+	k_EUIProgramDefault,
+	k_EUIProgramMax
+} k_EUIProgram;
+
+// GL objects and other handles owned by the library, whatever is still registered at teardown is freed
+typedef struct
+{
+	k_EUIResource type;
+	uintptr_t handle;
+	size_t bytes;
+	int width, height; // Level 0 of textures, a stream reads them back with these
+} UIResource;
+
+typedef struct
+{
+	UIResource *entries;
+	size_t numentries, maxentries;
+} UIResourceRegistry;
+
+// Resources shared read-only between contexts, mutations of the atlas and image cache take the lock
+typedef struct
+{
+	int refcount;
+	SDL_mutex *lock; // Recursive
+	SDL_threadID gl_thread; // Created the shared state, textures are only created and uploaded to there
+	UIFont *default_font;
+	GLuint programs[k_EUIProgramMax]; // Created on first use
+	char program_cache_dir[256]; // Empty disables the binary cache
+	GLuint white_texture;
+	GLuint default_image;
+	UIAtlas atlas;
+	UIImageCache image_cache;
+	SDL_Cursor *default_cursor;
+	SDL_Cursor *hand_cursor;
+	SDL_Cursor *text_cursor;
+	UIResourceRegistry resources;
+	// Unloaded textures wait until no published list of a context sharing them can still draw them
+	GLuint *retired_textures;
+	size_t numretired_textures, maxretired_textures;
+	int unsubmitted_lists; // Published by contexts that submit and not drawn yet
+} UIShared;
+
+struct UIContext_s
 {
 	float x, y;
+	size_t frame;
+	UIShared *shared;
+	GLuint vao, vbo;
+	size_t vbo_size; // Of the last upload
 	UIFont *default_font;
-	GLuint gl_program;
 	UIElement *elements;
 	size_t numelements;
 	size_t maxelements;
@@ -122,6 +557,15 @@ typedef struct
 	GLuint white_texture;
 	GLuint default_image;
 	UIMouseState mouse, mouse_prev_frame;
+	// Mouse events queued by ui_event and applied in order by ui_begin_frame
+	UIInputEvent *input_queue;
+	size_t numinput_events, maxinput_events;
+	UIMousePress *presses;
+	size_t numpresses, maxpresses;
+	uint32_t input_timestamp; // Oldest event applied this frame, 0 if none
+	UIInputStats input_stats;
+	bool submits_lists; // Set by the first ui_submit_draw_list, headless contexts never do
+	bool list_unsubmitted; // Counted in shared->unsubmitted_lists
 	bool scan_code_state[SDL_NUM_SCANCODES];
 	bool interact_active;
 
@@ -134,1219 +578,7818 @@ typedef struct
 	bool text_input_changed;
 	int selection_beg, selection_end;
 	int caret_pos;
+	unsigned int caret_blink_time;
+	bool caret_visible;
 	bool sameline;
 	int sameline_count;
 	UIStyle *style;
 	UIStyle custom_style;
-} UIContext;
-static UIContext ui_ctx;
+	UIResolvedStyle *style_table; // Index 0 is the empty style
+	size_t numstyles, maxstyles;
+	uint32_t *style_buckets; // Open addressing, index + 1 or 0 if empty
+	size_t numstyle_buckets;
+	UIStyleMemo style_memo[UI_STYLE_MEMO_SIZE];
+	struct UIVertexPool_s *vertex_pool; // Created the first time a frame is large enough
+	// Built on the app thread into draw_list while the render thread submits the published one
+	UIDrawList draw_lists[2];
+	UIDrawList *draw_list;
+	int published_list, submitting_list; // -1 if none
+	uint64_t published_generation;
+	SDL_mutex *draw_mutex;
+	SDL_cond *draw_cond;
+	UIStateStore state_store;
+	UIPane panes[UI_MAX_PANE_DEPTH];
+	int pane_depth;
+	UITextBuffer *active_editor;
+	UINumberCacheEntry *number_cache;
+	// Element labels and their label_length + 1 cumulative advances, reset every frame
+	char *text_arena;
+	size_t text_arena_size, text_arena_capacity;
+	float *width_arena;
+	size_t width_arena_size, width_arena_capacity;
+	// Every pushed transform of this frame, elements refer to them by index
+	UIAffine *transforms;
+	size_t numtransforms, maxtransforms;
+	int transform_stack[UI_MAX_TRANSFORM_DEPTH];
+	int transform_depth;
+	UILayout layouts[UI_MAX_LAYOUT_DEPTH];
+	int layout_depth;
+	UILayoutItem *layout_items;
+	size_t numlayout_items, maxlayout_items;
+};
+// Every thread builds into its own current context, set with ui_set_context
+static UI_THREAD_LOCAL UIContext *ui_current_ctx_;
+static UIContext *ui_default_ctx_;
+#define ui_ctx (*ui_current_ctx_)
+
+static void ui_shared_lock_()
+{
+	SDL_LockMutex(ui_ctx.shared->lock);
+}
+
+static void ui_shared_unlock_()
+{
+	SDL_UnlockMutex(ui_ctx.shared->lock);
+}
+
+// Widgets that load images or fonts upload while building, which only works where the GL context is current
+static bool ui_on_gl_thread_()
+{
+	return SDL_ThreadID() == ui_ctx.shared->gl_thread;
+}
+
+static void ui_resource_add_(k_EUIResource type, uintptr_t handle, size_t bytes)
+{
+	UIResourceRegistry *r = &ui_ctx.shared->resources;
+	ui_shared_lock_();
+	if(r->numentries >= r->maxentries)
+	{
+		r->maxentries = r->maxentries == 0 ? 64 : r->maxentries * 2;
+		r->entries = realloc(r->entries, sizeof(UIResource) * r->maxentries);
+	}
+	r->entries[r->numentries++] = (UIResource) { type, handle, bytes, 0, 0 };
+	ui_shared_unlock_();
+}
+
+static void ui_resource_add_texture_(GLuint texture, int width, int height, size_t bytes)
+{
+	UIResourceRegistry *r = &ui_ctx.shared->resources;
+	ui_shared_lock_();
+	ui_resource_add_(k_EUIResourceTexture, texture, bytes);
+	r->entries[r->numentries - 1].width = width;
+	r->entries[r->numentries - 1].height = height;
+	ui_shared_unlock_();
+}
+
+static UIResource *ui_resource_find_(k_EUIResource type, uintptr_t handle)
+{
+	UIResourceRegistry *r = &ui_ctx.shared->resources;
+	// Recently created resources are the ones most likely to go away again
+	for(size_t i = r->numentries; i-- > 0;)
+	{
+		if(r->entries[i].type == type && r->entries[i].handle == handle)
+			return &r->entries[i];
+	}
+	return NULL;
+}
+
+static void ui_resource_resize_(k_EUIResource type, uintptr_t handle, size_t bytes)
+{
+	ui_shared_lock_();
+	UIResource *res = ui_resource_find_(type, handle);
+	if(res)
+		res->bytes = bytes;
+	ui_shared_unlock_();
+}
+
+static void ui_resource_remove_(k_EUIResource type, uintptr_t handle)
+{
+	UIResourceRegistry *r = &ui_ctx.shared->resources;
+	ui_shared_lock_();
+	UIResource *res = ui_resource_find_(type, handle);
+	if(res)
+		*res = r->entries[--r->numentries];
+	ui_shared_unlock_();
+}
+
+// Set on vertex workers, element rendering appends to the worker's own arena
+static UI_THREAD_LOCAL UIDrawList *ui_worker_draw_list_;
+
+static UIDrawList *ui_draw_target_()
+{
+	return ui_worker_draw_list_ ? ui_worker_draw_list_ : ui_ctx.draw_list;
+}
+
+static int ui_current_transform_()
+{
+	return ui_ctx.transform_depth > 0 ? ui_ctx.transform_stack[ui_ctx.transform_depth - 1] : 0;
+}
 
 static const char *vertex_shader_source = "#version 300 es\n\
 layout(location = 0) in vec2 position;\n\
 layout(location = 1) in vec2 texCoord;\n\
+layout(location = 2) in vec4 color;\n\
 out vec2 v_texCoord;\n\
+out vec4 v_color;\n\
 uniform mat4 projection;\n\
 uniform mat4 model;\n\
 void main()\n\
 {\n\
     gl_Position = projection * model * vec4(position, 0.0, 1.0);\n\
     v_texCoord = texCoord;\n\
+    v_color = color;\n\
 }\n";
 static const char *fragment_shader_source = "#version 300 es\nprecision mediump float;\n\
 in vec2 v_texCoord;\n\
+in vec4 v_color;\n\
 uniform sampler2D s_texture;\n\
-uniform vec4 textColor;\n\
 void main() {\n\
     vec4 color = texture(s_texture, v_texCoord);\n\
-    gl_FragColor = textColor * color;\n\
+    gl_FragColor = v_color * color;\n\
 }";
 
-//#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
-UIFont *ui_load_font(const char *path)
+static void ui_atlas_upload_(UIAtlasPage *page, int x, int y, int w, int h)
 {
-	UIFont *font = calloc(1, sizeof(UIFont));
-	font->font_size = 16;
-	snprintf(font->path, sizeof(font->path), path);
-
-	if(k_EIOResultOk != io_read_binary_file(font->path, &font->ttf_buffer, NULL, NULL))
+	if(!ui_on_gl_thread_())
 	{
-		printf("Can't load font '%s'\n", font->path);
-		return NULL;
+		page->upload_pending = true;
+		return;
 	}
-	stbtt_InitFont(&font->font_info, font->ttf_buffer, 0);
-
-	int ascent, descent, line_gap;
-	stbtt_GetFontVMetrics(&font->font_info, &ascent, &descent, &line_gap);
-	float scale = stbtt_ScaleForPixelHeight(&font->font_info, font->font_size);
-	font->height = (ascent - descent + line_gap) * scale;
-	unsigned char image[512 * 512 * 4];
-	stbtt_BakeFontBitmap(font->ttf_buffer, 0, font->font_size, image, 512, 512, 32, 96, font->cdata); // no guarantee this fits!
+	glBindTexture(GL_TEXTURE_2D, page->gl_texture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, UI_ATLAS_PAGE_SIZE);
+	glTexSubImage2D(GL_TEXTURE_2D,
+					0,
+					x,
+					y,
+					w,
+					h,
+					GL_RGBA,
+					GL_UNSIGNED_BYTE,
+					page->pixels + (y * UI_ATLAS_PAGE_SIZE + x) * 4);
+	SDL_AtomicAdd(&ui_texture_generation_, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
 
-	char *tmp = malloc(512 * 512 * 4);
-	memset(tmp, 255, 512 * 512 * 4);
-	for(int x = 0; x < 512; ++x)
+// Also extends the edges into the padding, linear filtering at the rectangle's border then samples its own
+// pixels like GL_CLAMP_TO_EDGE would instead of a neighbour's
+static void ui_atlas_blit_(UIAtlasPage *page, int x, int y, int w, int h, const unsigned char *src, int src_stride)
+{
+	for(int row = 0; row < h; ++row)
 	{
-		for(int y = 0; y < 512; ++y)
+		unsigned char *dst = page->pixels + ((y + row) * UI_ATLAS_PAGE_SIZE + x) * 4;
+		memcpy(dst, src + row * src_stride, w * 4);
+		for(int i = 1; i <= UI_ATLAS_PADDING; ++i)
 		{
-			int index = (y * 512 + x) * 4;
-			tmp[index + 3] = image[y * 512 + x];
+			memcpy(dst - i * 4, dst, 4);
+			memcpy(dst + (w - 1 + i) * 4, dst + (w - 1) * 4, 4);
 		}
 	}
-	#if 0
-	if(!stbi_write_png("bitmap_font.png", 512, 512, 1, image, 0))
+	unsigned char *first = page->pixels + (y * UI_ATLAS_PAGE_SIZE + x - UI_ATLAS_PADDING) * 4;
+	unsigned char *last = page->pixels + ((y + h - 1) * UI_ATLAS_PAGE_SIZE + x - UI_ATLAS_PADDING) * 4;
+	for(int i = 1; i <= UI_ATLAS_PADDING; ++i)
 	{
-		printf("Error writing PNG file.\n");
+		memcpy(first - i * UI_ATLAS_PAGE_SIZE * 4, first, (w + UI_ATLAS_PADDING * 2) * 4);
+		memcpy(last + i * UI_ATLAS_PAGE_SIZE * 4, last, (w + UI_ATLAS_PADDING * 2) * 4);
 	}
-	#endif
-	glGenTextures(1, &font->gl_texture);
-	glBindTexture(GL_TEXTURE_2D, font->gl_texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 512, 512, 0, GL_RGBA, GL_UNSIGNED_BYTE, tmp);
-	free(tmp);
+}
 
+static UIAtlasPage *ui_atlas_new_page_(UIAtlas *atlas)
+{
+	atlas->pages = realloc(atlas->pages, sizeof(UIAtlasPage) * (atlas->numpages + 1));
+	UIAtlasPage *page = &atlas->pages[atlas->numpages++];
+	memset(page, 0, sizeof(UIAtlasPage));
+	page->pixels = calloc(UI_ATLAS_PAGE_SIZE * UI_ATLAS_PAGE_SIZE, 4);
+	glGenTextures(1, &page->gl_texture);
+	ui_resource_add_texture_(page->gl_texture, UI_ATLAS_PAGE_SIZE, UI_ATLAS_PAGE_SIZE, UI_ATLAS_PAGE_SIZE * UI_ATLAS_PAGE_SIZE * 4);
+	glBindTexture(GL_TEXTURE_2D, page->gl_texture);
+	glTexImage2D(GL_TEXTURE_2D,
+				 0,
+				 GL_RGBA,
+				 UI_ATLAS_PAGE_SIZE,
+				 UI_ATLAS_PAGE_SIZE,
+				 0,
+				 GL_RGBA,
+				 GL_UNSIGNED_BYTE,
+				 page->pixels);
+	SDL_AtomicAdd(&ui_texture_generation_, 1);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	return font;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return page;
 }
-unsigned int ui_load_image(const char *path)
+
+// Shelf packer, picks the shortest shelf the rectangle fits on. Returns the position inside the padding.
+static bool ui_atlas_page_alloc_(UIAtlasPage *page, int w, int h, int *out_x, int *out_y)
 {
-	int width, height, channels;
-	unsigned char *image = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
-	if(!image)
-	{
-		return ui_ctx.default_image;
-	}
-	GLenum format = GL_INVALID_ENUM;
-	switch(channels)
+	int pw = w + UI_ATLAS_PADDING * 2;
+	int ph = h + UI_ATLAS_PADDING * 2;
+	UIAtlasShelf *best = NULL;
+	for(size_t i = 0; i < page->numshelves; ++i)
 	{
-		case 1: format = GL_RED;
-		case 3: format = GL_RGB;
-		case 4: format = GL_RGBA;
+		UIAtlasShelf *shelf = &page->shelves[i];
+		if(shelf->height >= ph && shelf->x + pw <= UI_ATLAS_PAGE_SIZE && (!best || shelf->height < best->height))
+		{
+			best = shelf;
+		}
 	}
-	if(format == GL_INVALID_ENUM)
+	if(!best)
 	{
-		return ui_ctx.default_image;
+		int y = 0;
+		if(page->numshelves > 0)
+		{
+			UIAtlasShelf *last = &page->shelves[page->numshelves - 1];
+			y = last->y + last->height;
+		}
+		if(y + ph > UI_ATLAS_PAGE_SIZE || pw > UI_ATLAS_PAGE_SIZE)
+		{
+			return false;
+		}
+		if(page->numshelves >= page->maxshelves)
+		{
+			page->maxshelves = page->maxshelves == 0 ? 8 : page->maxshelves * 2;
+			page->shelves = realloc(page->shelves, sizeof(UIAtlasShelf) * page->maxshelves);
+		}
+		best = &page->shelves[page->numshelves++];
+		best->x = 0;
+		best->y = y;
+		best->height = ph;
 	}
-	unsigned int image_id;
-	glGenTextures(1, &image_id);
-	glBindTexture(GL_TEXTURE_2D, image_id);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, format, GL_UNSIGNED_BYTE, image);
-	stbi_image_free(image);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	// glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	*out_x = best->x + UI_ATLAS_PADDING;
+	*out_y = best->y + UI_ATLAS_PADDING;
+	best->x += pw;
+	page->used_area += pw * ph;
+	return true;
+}
 
-	return image_id;
+static int ui_atlas_repack_compare_(const void *a, const void *b)
+{
+	const UIAtlasRect *ra = &ui_ctx.shared->atlas.rects[*(const int *)a];
+	const UIAtlasRect *rb = &ui_ctx.shared->atlas.rects[*(const int *)b];
+	if(ra->h == rb->h)
+		return *(const int *)a - *(const int *)b;
+	return rb->h - ra->h;
 }
-void ui_font_measure_text(UIFont *font, const char *beg, const char *end, float *width, float *height)
+
+// Pinned rectangles stay where they are, the font's baked glyph positions point into them. The others are
+// packed by height below the lowest pinned one, the page is left as it was if they don't all fit there.
+static void ui_atlas_repack_page_(UIAtlas *atlas, int p)
 {
-	if(width)
+	UIAtlasPage *page = &atlas->pages[p];
+	int *order = malloc(sizeof(int) * (atlas->numrects + 1));
+	size_t n = 0;
+	int reserved = 0, pinned_area = 0;
+	for(size_t i = 0; i < atlas->numrects; ++i)
 	{
-		*width = 0.f;
+		UIAtlasRect *rect = &atlas->rects[i];
+		if(rect->page != p)
+			continue;
+		if(rect->pinned)
+		{
+			reserved = max(reserved, rect->y + rect->h + UI_ATLAS_PADDING);
+			pinned_area += (rect->w + UI_ATLAS_PADDING * 2) * (rect->h + UI_ATLAS_PADDING * 2);
+		}
+		else
+		{
+			order[n++] = (int)i;
+		}
 	}
-	#if 0
-	if(height)
+	qsort(order, n, sizeof(int), ui_atlas_repack_compare_);
+
+	// A full shelf over the pinned band, new shelves start below it
+	UIAtlasPage packed;
+	memset(&packed, 0, sizeof(packed));
+	packed.maxshelves = 8;
+	packed.shelves = malloc(sizeof(UIAtlasShelf) * packed.maxshelves);
+	if(reserved > 0)
+		packed.shelves[packed.numshelves++] = (UIAtlasShelf) { UI_ATLAS_PAGE_SIZE, 0, reserved };
+	int *positions = malloc(sizeof(int) * 2 * (n + 1));
+	for(size_t i = 0; i < n; ++i)
 	{
-		*height = 0.f;
+		UIAtlasRect *rect = &atlas->rects[order[i]];
+		if(!ui_atlas_page_alloc_(&packed, rect->w, rect->h, &positions[i * 2], &positions[i * 2 + 1]))
+		{
+			free(packed.shelves);
+			free(positions);
+			free(order);
+			return;
+		}
 	}
-	#endif
 
-	float scale = stbtt_ScaleForPixelHeight(&font->font_info, font->font_size);
-	#if 1
-	int ascent, descent, lineGap;
-	stbtt_GetFontVMetrics(&font->font_info, &ascent, &descent, &lineGap);
-	if(height)
+	unsigned char *old_pixels = page->pixels;
+	page->pixels = calloc(UI_ATLAS_PAGE_SIZE * UI_ATLAS_PAGE_SIZE, 4);
+	for(size_t i = 0; i < atlas->numrects; ++i)
 	{
-		float h = (ascent - descent + lineGap) * scale;
-		if(*height == 0.f || h > *height)
+		UIAtlasRect *rect = &atlas->rects[i];
+		if(rect->page == p && rect->pinned)
 		{
-			*height = h;
+			ui_atlas_blit_(page,
+						   rect->x,
+						   rect->y,
+						   rect->w,
+						   rect->h,
+						   old_pixels + (rect->y * UI_ATLAS_PAGE_SIZE + rect->x) * 4,
+						   UI_ATLAS_PAGE_SIZE * 4);
 		}
 	}
-	#endif
-	float x, y;
-	while(1)
+	for(size_t i = 0; i < n; ++i)
 	{
-		if(end)
+		UIAtlasRect *rect = &atlas->rects[order[i]];
+		int x = positions[i * 2], y = positions[i * 2 + 1];
+		ui_atlas_blit_(page,
+					   x,
+					   y,
+					   rect->w,
+					   rect->h,
+					   old_pixels + (rect->y * UI_ATLAS_PAGE_SIZE + rect->x) * 4,
+					   UI_ATLAS_PAGE_SIZE * 4);
+		rect->x = x;
+		rect->y = y;
+	}
+	free(page->shelves);
+	page->shelves = packed.shelves;
+	page->numshelves = packed.numshelves;
+	page->maxshelves = packed.maxshelves;
+	page->used_area = packed.used_area + pinned_area;
+	page->freed_area = 0;
+	free(old_pixels);
+	free(positions);
+	free(order);
+	ui_atlas_upload_(page, 0, 0, UI_ATLAS_PAGE_SIZE, UI_ATLAS_PAGE_SIZE);
+	atlas->repacks++;
+}
+
+static int ui_atlas_add_(UIAtlas *atlas, const unsigned char *rgba, int w, int h, bool pinned)
+{
+	int x, y;
+	size_t p;
+	for(p = 0; p < atlas->numpages; ++p)
+	{
+		if(ui_atlas_page_alloc_(&atlas->pages[p], w, h, &x, &y))
+			break;
+	}
+	if(p == atlas->numpages)
+	{
+		if(!ui_atlas_page_alloc_(ui_atlas_new_page_(atlas), w, h, &x, &y))
+			return -1;
+	}
+	int index = atlas->free_rect;
+	if(index >= 0)
+	{
+		atlas->free_rect = atlas->rects[index].next_free;
+	}
+	else
+	{
+		atlas->rects = realloc(atlas->rects, sizeof(UIAtlasRect) * (atlas->numrects + 1));
+		index = (int)atlas->numrects++;
+	}
+	UIAtlasRect *rect = &atlas->rects[index];
+	rect->page = (int)p;
+	rect->x = x;
+	rect->y = y;
+	rect->w = w;
+	rect->h = h;
+	rect->pinned = pinned;
+	rect->next_free = -1;
+	ui_atlas_blit_(&atlas->pages[p], x, y, w, h, rgba, w * 4);
+	ui_atlas_upload_(&atlas->pages[p],
+					 x - UI_ATLAS_PADDING,
+					 y - UI_ATLAS_PADDING,
+					 w + UI_ATLAS_PADDING * 2,
+					 h + UI_ATLAS_PADDING * 2);
+	return index;
+}
+
+static void ui_atlas_remove_(UIAtlas *atlas, int index)
+{
+	UIAtlasRect *rect = &atlas->rects[index];
+	if(rect->page < 0 || rect->pinned)
+		return;
+	UIAtlasPage *page = &atlas->pages[rect->page];
+	page->freed_area += (rect->w + UI_ATLAS_PADDING * 2) * (rect->h + UI_ATLAS_PADDING * 2);
+	rect->page = -1;
+	rect->next_free = atlas->free_rect;
+	atlas->free_rect = index;
+	if(page->freed_area > page->used_area * atlas->repack_threshold)
+	{
+		page->repack_pending = true;
+	}
+}
+
+static void ui_atlas_init_(UIAtlas *atlas)
+{
+	memset(atlas, 0, sizeof(UIAtlas));
+	atlas->free_rect = -1;
+	atlas->max_image_size = UI_ATLAS_DEFAULT_MAX_IMAGE_SIZE;
+	atlas->repack_threshold = UI_ATLAS_DEFAULT_REPACK_THRESHOLD;
+	// Solid block so untextured quads can share the atlas page with text and icons
+	unsigned char white[4 * 4 * 4];
+	memset(white, 255, sizeof(white));
+	atlas->white_rect = ui_atlas_add_(atlas, white, 4, 4, true);
+}
+
+static void ui_atlas_free_(UIAtlas *atlas)
+{
+	for(size_t i = 0; i < atlas->numpages; ++i)
+	{
+		ui_resource_remove_(k_EUIResourceTexture, atlas->pages[i].gl_texture);
+		glDeleteTextures(1, &atlas->pages[i].gl_texture);
+		free(atlas->pages[i].pixels);
+		free(atlas->pages[i].shelves);
+	}
+	free(atlas->pages);
+	free(atlas->rects);
+	memset(atlas, 0, sizeof(UIAtlas));
+	atlas->free_rect = -1;
+	atlas->white_rect = -1;
+}
+
+void ui_image_atlas_config(int max_image_size, float repack_threshold)
+{
+	ui_shared_lock_();
+	ui_ctx.shared->atlas.max_image_size = max_image_size;
+	ui_ctx.shared->atlas.repack_threshold = repack_threshold;
+	ui_shared_unlock_();
+}
+
+void ui_image_atlas_stats(UIImageAtlasStats *out_stats)
+{
+	ui_shared_lock_();
+	UIAtlas *atlas = &ui_ctx.shared->atlas;
+	memset(out_stats, 0, sizeof(UIImageAtlasStats));
+	out_stats->pages = atlas->numpages;
+	out_stats->repacks = atlas->repacks;
+	for(size_t i = 0; i < atlas->numrects; ++i)
+	{
+		if(atlas->rects[i].page >= 0)
+			out_stats->images++;
+	}
+	for(size_t i = 0; i < atlas->numpages; ++i)
+	{
+		out_stats->used_area += atlas->pages[i].used_area - atlas->pages[i].freed_area;
+		out_stats->freed_area += atlas->pages[i].freed_area;
+	}
+	ui_shared_unlock_();
+}
+
+// Resolves an image id to the texture to bind and the UV rectangle (s0, t0, s1, t1) to sample
+static GLuint ui_image_texture_(unsigned int image_id, float *uv)
+{
+	uv[0] = uv[1] = 0.f;
+	uv[2] = uv[3] = 1.f;
+	if(image_id == 0)
+	{
+		if(ui_ctx.shared->atlas.white_rect < 0)
+			return ui_ctx.white_texture;
+		UIAtlasRect *rect = &ui_ctx.shared->atlas.rects[ui_ctx.shared->atlas.white_rect];
+		// Sample the center of the block, bilinear filtering can't bleed in from the neighbours
+		uv[0] = uv[2] = (rect->x + rect->w * 0.5f) / UI_ATLAS_PAGE_SIZE;
+		uv[1] = uv[3] = (rect->y + rect->h * 0.5f) / UI_ATLAS_PAGE_SIZE;
+		return ui_ctx.shared->atlas.pages[rect->page].gl_texture;
+	}
+	if(image_id & UI_IMAGE_ATLAS_BIT)
+	{
+		unsigned int index = image_id & ~UI_IMAGE_ATLAS_BIT;
+		if(index >= ui_ctx.shared->atlas.numrects || ui_ctx.shared->atlas.rects[index].page < 0)
+			return ui_ctx.default_image;
+		UIAtlasRect *rect = &ui_ctx.shared->atlas.rects[index];
+		uv[0] = (float)rect->x / UI_ATLAS_PAGE_SIZE;
+		uv[1] = (float)rect->y / UI_ATLAS_PAGE_SIZE;
+		uv[2] = (float)(rect->x + rect->w) / UI_ATLAS_PAGE_SIZE;
+		uv[3] = (float)(rect->y + rect->h) / UI_ATLAS_PAGE_SIZE;
+		return ui_ctx.shared->atlas.pages[rect->page].gl_texture;
+	}
+	return image_id;
+}
+
+void ui_unload_image(unsigned int image_id)
+{
+	if(image_id == 0 || image_id == ui_ctx.default_image || image_id == ui_ctx.white_texture)
+		return;
+	if(image_id & UI_IMAGE_ATLAS_BIT)
+	{
+		unsigned int index = image_id & ~UI_IMAGE_ATLAS_BIT;
+		ui_shared_lock_();
+		if(index < ui_ctx.shared->atlas.numrects)
+			ui_atlas_remove_(&ui_ctx.shared->atlas, (int)index);
+		ui_shared_unlock_();
+		return;
+	}
+	ui_shared_lock_();
+	UIShared *shared = ui_ctx.shared;
+	ui_resource_remove_(k_EUIResourceTexture, image_id);
+	if(shared->numretired_textures >= shared->maxretired_textures)
+	{
+		shared->maxretired_textures = shared->maxretired_textures == 0 ? 16 : shared->maxretired_textures * 2;
+		shared->retired_textures = realloc(shared->retired_textures, sizeof(GLuint) * shared->maxretired_textures);
+	}
+	shared->retired_textures[shared->numretired_textures++] = image_id;
+	ui_shared_unlock_();
+}
+
+// Deletes unloaded textures and repacks atlas pages, called with the shared lock held once no published
+// list can refer to the old state anymore
+static void ui_shared_retire_(UIShared *shared)
+{
+	if(shared->numretired_textures > 0)
+	{
+		glDeleteTextures((GLsizei)shared->numretired_textures, shared->retired_textures);
+		shared->numretired_textures = 0;
+	}
+	for(size_t i = 0; i < shared->atlas.numpages; ++i)
+	{
+		if(shared->atlas.pages[i].repack_pending)
 		{
-			if(beg == end)
-				break;
+			shared->atlas.pages[i].repack_pending = false;
+			ui_atlas_repack_page_(&shared->atlas, (int)i);
 		}
-		else
+	}
+}
+
+//#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+static void ui_font_build_glyph_table_(UIFont *font)
+{
+	UIGlyphTable *t = &font->glyphs;
+	float ipw = 1.f / font->bitmap_width, iph = 1.f / font->bitmap_height;
+	for(int i = 0; i < 96; ++i)
+	{
+		const stbtt_bakedchar *b = &font->cdata[i];
+		t->xoff[i] = b->xoff + 0.5f;
+		t->yoff[i] = b->yoff + 0.5f;
+		t->width[i] = b->x1 - b->x0;
+		t->height[i] = b->y1 - b->y0;
+		t->s0[i] = b->x0 * ipw;
+		t->t0[i] = b->y0 * iph;
+		t->s1[i] = b->x1 * ipw;
+		t->t1[i] = b->y1 * iph;
+		t->advance[i] = b->xadvance;
+	}
+}
+
+UIFont *ui_load_font(const char *path)
+{
+	if(!ui_on_gl_thread_())
+	{
+		printf("Can't load font '%s' off the GL thread\n", path);
+		return NULL;
+	}
+	UIFont *font = calloc(1, sizeof(UIFont));
+	font->font_size = 16;
+	snprintf(font->path, sizeof(font->path), path);
+
+	if(k_EIOResultOk != io_read_binary_file(font->path, &font->ttf_buffer, NULL, NULL))
+	{
+		printf("Can't load font '%s'\n", font->path);
+		free(font);
+		return NULL;
+	}
+	ui_resource_add_(k_EUIResourceFont, (uintptr_t)font, sizeof(UIFont));
+	stbtt_InitFont(&font->font_info, font->ttf_buffer, 0);
+
+	int ascent, descent, line_gap;
+	stbtt_GetFontVMetrics(&font->font_info, &ascent, &descent, &line_gap);
+	float scale = stbtt_ScaleForPixelHeight(&font->font_info, font->font_size);
+	font->height = (ascent - descent + line_gap) * scale;
+	font->ascent = ascent * scale;
+	unsigned char image[512 * 512 * 4];
+	stbtt_BakeFontBitmap(font->ttf_buffer, 0, font->font_size, image, 512, 512, 32, 96, font->cdata); // no guarantee this fits!
+
+	char *tmp = malloc(512 * 512 * 4);
+	memset(tmp, 255, 512 * 512 * 4);
+	for(int x = 0; x < 512; ++x)
+	{
+		for(int y = 0; y < 512; ++y)
 		{
-			if(!*beg)
-				break;
+			int index = (y * 512 + x) * 4;
+			tmp[index + 3] = image[y * 512 + x];
 		}
-		if(*beg >= 32 && *beg < 128)
+	}
+	#if 0
+	if(!stbi_write_png("bitmap_font.png", 512, 512, 1, image, 0))
+	{
+		printf("Error writing PNG file.\n");
+	}
+	#endif
+	// Bake into the atlas so text batches together with icons and backgrounds
+	int rect_index = ui_atlas_add_(&ui_ctx.shared->atlas, (unsigned char *)tmp, 512, 512, true);
+	if(rect_index >= 0)
+	{
+		UIAtlasRect *rect = &ui_ctx.shared->atlas.rects[rect_index];
+		for(int i = 0; i < 96; ++i)
 		{
-			int advance, lsb, x0, y0, x1, y1;
-			stbtt_GetCodepointHMetrics(&font->font_info, *beg, &advance, &lsb);
-			stbtt_GetCodepointBitmapBox(&font->font_info, *beg, 1, 1, &x0, &y0, &x1, &y1);
-			if(width)
-			{
-				*width += advance * scale;
-			}
+			font->cdata[i].x0 += rect->x;
+			font->cdata[i].x1 += rect->x;
+			font->cdata[i].y0 += rect->y;
+			font->cdata[i].y1 += rect->y;
+		}
+		font->gl_texture = ui_ctx.shared->atlas.pages[rect->page].gl_texture;
+		font->bitmap_width = UI_ATLAS_PAGE_SIZE;
+		font->bitmap_height = UI_ATLAS_PAGE_SIZE;
+		ui_font_build_glyph_table_(font);
+		free(tmp);
+		return font;
+	}
+	font->bitmap_width = 512;
+	font->bitmap_height = 512;
+	ui_font_build_glyph_table_(font);
+	font->owns_texture = true;
+	glGenTextures(1, &font->gl_texture);
+	ui_resource_add_texture_(font->gl_texture, 512, 512, 512 * 512 * 4);
+	glBindTexture(GL_TEXTURE_2D, font->gl_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 512, 512, 0, GL_RGBA, GL_UNSIGNED_BYTE, tmp);
+	SDL_AtomicAdd(&ui_texture_generation_, 1);
+	free(tmp);
 
-			stbtt_aligned_quad q;
-			stbtt_GetBakedQuad(font->cdata, 512, 512, *beg - 32, &x, &y, &q, 1);
-#if 0
-			if(width)
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	return font;
+}
+
+static void ui_free_font_(UIFont *font)
+{
+	if(font->owns_texture)
+	{
+		ui_resource_remove_(k_EUIResourceTexture, font->gl_texture);
+		glDeleteTextures(1, &font->gl_texture);
+	}
+	ui_resource_remove_(k_EUIResourceFont, (uintptr_t)font);
+	free(font->ttf_buffer);
+	free(font);
+}
+// 2x2 box filter, odd trailing rows/columns are dropped
+static void ui_image_halve_(const unsigned char *src, int w, int h, unsigned char *dst)
+{
+	int dw = w / 2, dh = h / 2;
+	for(int y = 0; y < dh; ++y)
+	{
+		const unsigned char *r0 = src + (size_t)(y * 2) * w * 4;
+		const unsigned char *r1 = r0 + (size_t)w * 4;
+		unsigned char *out = dst + (size_t)y * dw * 4;
+		int x = 0;
+#ifdef UI_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		// 8 source pixels from each row make 4 destination pixels
+		for(; x + 4 <= dw; x += 4)
+		{
+			__m128i a0 = _mm_loadu_si128((const __m128i *)(r0 + x * 8));
+			__m128i a1 = _mm_loadu_si128((const __m128i *)(r0 + x * 8 + 16));
+			__m128i b0 = _mm_loadu_si128((const __m128i *)(r1 + x * 8));
+			__m128i b1 = _mm_loadu_si128((const __m128i *)(r1 + x * 8 + 16));
+			__m128i p01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+			__m128i p23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+			__m128i p45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+			__m128i p67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+			p01 = _mm_add_epi16(p01, _mm_srli_si128(p01, 8));
+			p23 = _mm_add_epi16(p23, _mm_srli_si128(p23, 8));
+			p45 = _mm_add_epi16(p45, _mm_srli_si128(p45, 8));
+			p67 = _mm_add_epi16(p67, _mm_srli_si128(p67, 8));
+			__m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(p01, p23), two), 2);
+			__m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(p45, p67), two), 2);
+			_mm_storeu_si128((__m128i *)(out + x * 4), _mm_packus_epi16(lo, hi));
+		}
+#endif
+		for(; x < dw; ++x)
+		{
+			for(int c = 0; c < 4; ++c)
 			{
-				*width += (q.x1 - q.x0);
+				int sum = r0[x * 8 + c] + r0[x * 8 + 4 + c] + r1[x * 8 + c] + r1[x * 8 + 4 + c];
+				out[x * 4 + c] = (unsigned char)((sum + 2) >> 2);
 			}
-			// Unreliable
-			if(height)
+		}
+	}
+}
+
+// Area weighted box filter, used for the last step where the scale factor is below 2
+static void ui_image_box_resample_(const unsigned char *src, int sw, int sh, unsigned char *dst, int dw, int dh)
+{
+	float sx = (float)sw / dw;
+	float sy = (float)sh / dh;
+	for(int y = 0; y < dh; ++y)
+	{
+		float fy0 = y * sy, fy1 = fy0 + sy;
+		for(int x = 0; x < dw; ++x)
+		{
+			float fx0 = x * sx, fx1 = fx0 + sx;
+			float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+			float total = 0.f;
+			for(int iy = (int)fy0; iy < sh && iy < fy1; ++iy)
 			{
-				float h = (q.y1 - q.y0);
-				if(*height == 0.f || h > *height)
+				float wy = min(fy1, iy + 1.f) - max(fy0, (float)iy);
+				for(int ix = (int)fx0; ix < sw && ix < fx1; ++ix)
 				{
-					*height = h;
+					float weight = wy * (min(fx1, ix + 1.f) - max(fx0, (float)ix));
+					const unsigned char *px = src + ((size_t)iy * sw + ix) * 4;
+					for(int c = 0; c < 4; ++c)
+						sum[c] += px[c] * weight;
+					total += weight;
 				}
 			}
-#endif
+			for(int c = 0; c < 4; ++c)
+				dst[((size_t)y * dw + x) * 4 + c] = (unsigned char)(sum[c] / total + 0.5f);
 		}
-		++beg;
 	}
 }
-static UIElement *ui_new_element_(k_EUIElementType type)
+
+// Returns a buffer of dw x dh pixels, either image itself or a new allocation
+static unsigned char *ui_image_downscale_(unsigned char *image, int *w, int *h, int dw, int dh)
 {
-	if(ui_ctx.numelements >= ui_ctx.maxelements)
+	unsigned char *result = image;
+	while(*w / 2 >= dw && *h / 2 >= dh)
 	{
-		size_t n = ui_ctx.maxelements * 2;
-		if(n == 0)
-			n = 7;
-		ui_ctx.elements = realloc(ui_ctx.elements, sizeof(UIElement) * n);
-		ui_ctx.maxelements = n;
+		unsigned char *tmp = malloc((size_t)(*w / 2) * (*h / 2) * 4);
+		ui_image_halve_(result, *w, *h, tmp);
+		if(result != image)
+			free(result);
+		result = tmp;
+		*w /= 2;
+		*h /= 2;
 	}
-	UIElement *e = &ui_ctx.elements[ui_ctx.numelements++];
-	memset(e, 0, sizeof(UIElement));
-	e->type = type;
-	e->index = ui_ctx.numelements - 1;
-	//e->x = ui_ctx.x;
-	//e->y = ui_ctx.y;
+	if(*w != dw || *h != dh)
+	{
+		unsigned char *tmp = malloc((size_t)dw * dh * 4);
+		ui_image_box_resample_(result, *w, *h, tmp, dw, dh);
+		if(result != image)
+			free(result);
+		result = tmp;
+		*w = dw;
+		*h = dh;
+	}
+	return result;
+}
 
-	void ui_element_layout_prev_();
-	ui_element_layout_prev_();
-	return e;
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#define GL_COMPRESSED_SRGB8_ETC2 0x9275
+#define GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2 0x9276
+#define GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2 0x9277
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#define GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC 0x9279
+#endif
+
+#define UI_KTX2_HEADER_SIZE (80)
+#define UI_KTX2_MAX_LEVELS (16)
+static const unsigned char ui_ktx2_identifier_[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+static uint32_t ui_read_u32_le_(const unsigned char *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
 }
 
-bool ui_input_selection_valid()
+static uint64_t ui_read_u64_le_(const unsigned char *p)
 {
-	size_t n = strlen(ui_ctx.active_text_input);
-	return ui_ctx.selection_beg >= 0 && ui_ctx.selection_end <= n && ui_ctx.selection_beg < ui_ctx.selection_end;
+	return (uint64_t)ui_read_u32_le_(p) | (uint64_t)ui_read_u32_le_(p + 4) << 32;
 }
-void ui_input_clear_selection()
+
+// Vulkan formats of the ETC2 family, all core in GLES 3.0
+static GLenum ui_ktx2_gl_format_(uint32_t vk_format, size_t *block_bytes)
 {
-	ui_ctx.selection_beg = -1;
-	ui_ctx.selection_end = -1;
+	*block_bytes = 8;
+	switch(vk_format)
+	{
+		case 147: return GL_COMPRESSED_RGB8_ETC2;
+		case 148: return GL_COMPRESSED_SRGB8_ETC2;
+		case 149: return GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+		case 150: return GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+		case 151: *block_bytes = 16; return GL_COMPRESSED_RGBA8_ETC2_EAC;
+		case 152: *block_bytes = 16; return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+	}
+	return GL_INVALID_ENUM;
 }
-void ui_input_remove_selection()
+
+static bool ui_is_ktx2_(const unsigned char *data, size_t size)
 {
-	size_t n = strlen(ui_ctx.active_text_input);
-	memmove(&ui_ctx.active_text_input[ui_ctx.selection_beg],
-			&ui_ctx.active_text_input[ui_ctx.selection_end + 1],
-			n + 1 - ui_ctx.selection_end);
-	ui_ctx.caret_pos = 0;
-	ui_input_clear_selection();
+	return size >= UI_KTX2_HEADER_SIZE && !memcmp(data, ui_ktx2_identifier_, sizeof(ui_ktx2_identifier_));
 }
 
-bool ui_event(SDL_Event *ev)
+// Pre-compressed levels go to glCompressedTexImage2D as they are, there's no decode and they can't be packed
+// into the RGBA atlas. Levels larger than the requested maximum size are skipped instead of filtered.
+static unsigned int ui_load_ktx2_(const unsigned char *data, size_t size, const UIImageLoadOptions *options, UIImageInfo *out_info)
 {
-	if(SDL_GetRelativeMouseMode())
-		return false;
-	bool ctrl = ui_ctx.scan_code_state[SDL_SCANCODE_LCTRL] || ui_ctx.scan_code_state[SDL_SCANCODE_RCTRL];
-	bool shift = ui_ctx.scan_code_state[SDL_SCANCODE_LSHIFT] || ui_ctx.scan_code_state[SDL_SCANCODE_RSHIFT];
-	switch(ev->type)
+	uint32_t vk_format = ui_read_u32_le_(data + 12);
+	int width = (int)ui_read_u32_le_(data + 20), height = (int)ui_read_u32_le_(data + 24);
+	uint32_t depth = ui_read_u32_le_(data + 28), layers = ui_read_u32_le_(data + 32);
+	uint32_t faces = ui_read_u32_le_(data + 36), numlevels = ui_read_u32_le_(data + 40);
+	uint32_t supercompression = ui_read_u32_le_(data + 44);
+	size_t block_bytes;
+	GLenum format = ui_ktx2_gl_format_(vk_format, &block_bytes);
+	numlevels = max(numlevels, 1u);
+	if(format == GL_INVALID_ENUM || supercompression != 0 || depth > 1 || layers > 1 || faces != 1 || width <= 0
+	   || height <= 0 || numlevels > UI_KTX2_MAX_LEVELS || size < UI_KTX2_HEADER_SIZE + numlevels * 24)
+		return 0;
+	const unsigned char *levels[UI_KTX2_MAX_LEVELS];
+	for(uint32_t i = 0; i < numlevels; ++i)
 	{
-		case SDL_MOUSEMOTION:
-			ui_ctx.mouse.x = ev->motion.x;
-			ui_ctx.mouse.y = ev->motion.y;
-			break;
+		const unsigned char *entry = data + UI_KTX2_HEADER_SIZE + i * 24;
+		uint64_t offset = ui_read_u64_le_(entry), length = ui_read_u64_le_(entry + 8);
+		int w = max(width >> i, 1), h = max(height >> i, 1);
+		if(length != (uint64_t)((w + 3) / 4) * ((h + 3) / 4) * block_bytes || offset > size || length > size - offset)
+			return 0;
+		levels[i] = data + offset;
+	}
+	uint32_t first = 0;
+	while(first + 1 < numlevels && options
+		  && ((options->max_width > 0 && (width >> first) > options->max_width)
+			  || (options->max_height > 0 && (height >> first) > options->max_height)))
+		++first;
+	uint32_t last = options && options->mipmaps ? numlevels : first + 1;
 
-		case SDL_MOUSEBUTTONDOWN: ui_ctx.mouse.buttons[0] = true; break;
-		case SDL_MOUSEBUTTONUP: ui_ctx.mouse.buttons[0] = false; break;
+	UIImageInfo info = { max(width >> first, 1), max(height >> first, 1), width, height, 0 };
+	unsigned int image_id = 0;
+	glGenTextures(1, &image_id);
+	glBindTexture(GL_TEXTURE_2D, image_id);
+	for(uint32_t i = first; i < last; ++i)
+	{
+		int w = max(width >> i, 1), h = max(height >> i, 1);
+		GLsizei length = (GLsizei)(((w + 3) / 4) * ((h + 3) / 4) * block_bytes);
+		glCompressedTexImage2D(GL_TEXTURE_2D, i - first, format, w, h, 0, length, levels[i]);
+		info.bytes += length;
+	}
+	SDL_AtomicAdd(&ui_texture_generation_, 1);
+	ui_resource_add_texture_(image_id, info.width, info.height, info.bytes);
+	// Compressed textures can't use glGenerateMipmap, the chain in the file may stop early
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, last - first - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, last - first > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	if(out_info)
+		*out_info = info;
+	return image_id;
+}
 
-		case SDL_KEYUP:
+static unsigned int ui_load_image_(const char *path, const UIImageLoadOptions *options, UIImageInfo *out_info)
+{
+	if(!ui_on_gl_thread_())
+	{
+		return ui_ctx.default_image;
+	}
+	unsigned char *data = NULL;
+	size_t size = 0;
+	if(k_EIOResultOk != io_read_binary_file(path, &data, &size, NULL))
+	{
+		return ui_ctx.default_image;
+	}
+	if(ui_is_ktx2_(data, size))
+	{
+		unsigned int image_id = ui_load_ktx2_(data, size, options, out_info);
+		free(data);
+		return image_id ? image_id : ui_ctx.default_image;
+	}
+	// Always expanded to RGBA, whatever the file's channel count
+	int width, height, channels;
+	unsigned char *image = stbi_load_from_memory(data, (int)size, &width, &height, &channels, STBI_rgb_alpha);
+	free(data);
+	if(!image)
+	{
+		return ui_ctx.default_image;
+	}
+	UIImageInfo info = { width, height, width, height, 0 };
+	unsigned char *pixels = image;
+	if(options && (options->max_width > 0 || options->max_height > 0))
+	{
+		// One factor for both axes so the aspect ratio survives, the tighter limit wins
+		float scale = 1.f;
+		if(options->max_width > 0)
+			scale = min(scale, (float)options->max_width / width);
+		if(options->max_height > 0)
+			scale = min(scale, (float)options->max_height / height);
+		int dw = max(1, (int)(width * scale + 0.5f));
+		int dh = max(1, (int)(height * scale + 0.5f));
+		pixels = ui_image_downscale_(image, &info.width, &info.height, dw, dh);
+	}
+	bool mipmaps = options && options->mipmaps;
+	unsigned int image_id = 0;
+	if(info.width <= ui_ctx.shared->atlas.max_image_size && info.height <= ui_ctx.shared->atlas.max_image_size)
+	{
+		int index = ui_atlas_add_(&ui_ctx.shared->atlas, pixels, info.width, info.height, false);
+		if(index >= 0)
 		{
-			ui_ctx.scan_code_state[ev->key.keysym.scancode] = false;
+			image_id = UI_IMAGE_ATLAS_BIT | (unsigned int)index;
+			mipmaps = false;
 		}
-		break;
-		case SDL_KEYDOWN:
+	}
+	if(image_id == 0)
+	{
+		glGenTextures(1, &image_id);
+		// A full mip chain adds a third
+		size_t bytes = (size_t)info.width * info.height * 4;
+		ui_resource_add_texture_(image_id, info.width, info.height, mipmaps ? bytes + bytes / 3 : bytes);
+		glBindTexture(GL_TEXTURE_2D, image_id);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, info.width, info.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		SDL_AtomicAdd(&ui_texture_generation_, 1);
+		if(mipmaps)
 		{
-			ui_ctx.scan_code_state[ev->key.keysym.scancode] = true;
-			switch(ev->key.keysym.sym)
-			{
-#if 0
-				case SDLK_LEFT:
-				case SDLK_RIGHT:
-				{
-					if(ui_ctx.active_text_input)
-					{
-						size_t maxchars = ui_ctx.max_active_text_input_length;
-						size_t n = strlen(ui_ctx.active_text_input);
-						if(n > 0)
-						{
-							if(shift)
-							{
-								if(ui_input_selection_valid())
-								{
-									if(ev->key.keysym.sym == SDLK_LEFT)
-									{
-										ui_ctx.selection_end = max(ui_ctx.selection_end + 1, n);
-									}
-								}
-							}
-							else
-							{
-								if(ev->key.keysym.sym == SDLK_LEFT)
-								{
-									ui_ctx.caret_pos = max(ui_ctx.caret_pos - 1, 0);
-								}
-								else
-								{
-									ui_ctx.caret_pos = min(ui_ctx.caret_pos + 1, n);
-								}
-							}
-						}
-					}
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		}
+		else
+		{
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	}
+	if(pixels != image)
+		free(pixels);
+	stbi_image_free(image);
+
+	info.bytes = (size_t)info.width * info.height * 4;
+	if(mipmaps)
+	{
+		// Full mip chain adds a third
+		info.bytes += info.bytes / 3;
+	}
+	if(out_info)
+		*out_info = info;
+	return image_id;
+}
+unsigned int ui_load_image(const char *path)
+{
+	return ui_load_image_ex(path, NULL);
+}
+unsigned int ui_load_image_ex(const char *path, const UIImageLoadOptions *options)
+{
+	ui_shared_lock_();
+	unsigned int image_id = ui_load_image_(path, options, NULL);
+	ui_shared_unlock_();
+	return image_id;
+}
+
+#ifdef UI_KTX2_WRITER
+static const int ui_etc_modifiers_[8][4] = { { 2, 8, -2, -8 },	   { 5, 17, -5, -17 },	 { 9, 29, -9, -29 },
+											 { 13, 42, -13, -42 }, { 18, 60, -18, -60 }, { 24, 80, -24, -80 },
+											 { 33, 106, -33, -106 }, { 47, 183, -47, -183 } };
+
+static const int ui_eac_modifiers_[16][8] = {
+	{ -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 }, { -2, -5, -8, -13, 1, 4, 7, 12 },
+	{ -2, -4, -6, -13, 1, 3, 5, 12 }, { -3, -6, -8, -12, 2, 5, 7, 11 },	 { -3, -7, -9, -11, 2, 6, 8, 10 },
+	{ -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },	 { -2, -6, -8, -10, 1, 5, 7, 9 },
+	{ -2, -5, -8, -10, 1, 4, 7, 9 },  { -2, -4, -8, -10, 1, 3, 7, 9 },	 { -2, -5, -7, -10, 1, 4, 6, 9 },
+	{ -3, -4, -7, -10, 2, 3, 6, 9 },  { -1, -2, -3, -10, 0, 1, 2, 9 },	 { -4, -6, -8, -9, 3, 5, 7, 8 },
+	{ -3, -5, -7, -9, 2, 4, 6, 8 }
+};
+
+static int ui_clamp_byte_(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+// Best table and per pixel modifiers for one half of a block, pixels are numbered x * 4 + y as ETC stores them
+static int ui_etc_fit_subblock_(const unsigned char *block, const int *pixels, const int *base, int *out_table, uint32_t *bits)
+{
+	int best_error = INT32_MAX;
+	uint32_t best_bits = 0;
+	for(int t = 0; t < 8; ++t)
+	{
+		int error = 0;
+		uint32_t tbits = 0;
+		for(int i = 0; i < 8; ++i)
+		{
+			const unsigned char *px = &block[pixels[i] * 4];
+			int best = INT32_MAX, best_index = 0;
+			for(int m = 0; m < 4; ++m)
+			{
+				int e = 0;
+				for(int c = 0; c < 3; ++c)
+				{
+					int d = ui_clamp_byte_(base[c] + ui_etc_modifiers_[t][m]) - px[c];
+					e += d * d;
 				}
-				break;
-#endif
-				case SDLK_BACKSPACE:
+				if(e < best)
 				{
-					if(ui_ctx.active_text_input)
-					{
-						size_t maxchars = ui_ctx.max_active_text_input_length;
-						size_t n = strlen(ui_ctx.active_text_input);
-						if(n > 0)
-						{
-							if(ui_input_selection_valid())
-							{
-								ui_input_remove_selection();
-							}
-							else
-							{
-								ui_ctx.active_text_input[n - 1] = 0;
-							}
-						}
-					}
+					best = e;
+					best_index = m;
 				}
-				break;
-				case SDLK_RETURN:
+			}
+			error += best;
+			tbits |= (uint32_t)(best_index & 1) << pixels[i] | (uint32_t)(best_index >> 1) << (pixels[i] + 16);
+		}
+		if(error < best_error)
+		{
+			best_error = error;
+			best_bits = tbits;
+			*out_table = t;
+		}
+	}
+	*bits = best_bits;
+	return best_error;
+}
+
+// ETC1 compatible individual and differential modes, which ETC2 decoders accept unchanged
+static uint64_t ui_etc2_encode_rgb_(const unsigned char *block)
+{
+	uint64_t best_word = 0;
+	int best_error = INT32_MAX;
+	for(int flip = 0; flip < 2; ++flip)
+	{
+		int pixels[2][8];
+		int average[2][3] = { { 0 } };
+		for(int i = 0, n0 = 0, n1 = 0; i < 16; ++i)
+		{
+			int x = i / 4, y = i % 4;
+			int half = flip ? y >= 2 : x >= 2;
+			if(half)
+				pixels[1][n1++] = i;
+			else
+				pixels[0][n0++] = i;
+			for(int c = 0; c < 3; ++c)
+				average[half][c] += block[i * 4 + c];
+		}
+		for(int diff = 0; diff < 2; ++diff)
+		{
+			int base[2][3], code[2][3];
+			bool valid = true;
+			for(int c = 0; c < 3; ++c)
+			{
+				if(diff)
 				{
-					if(ui_ctx.input_element.input_type != k_EUIInputElementTypeInvalid)
+					code[0][c] = (average[0][c] * 31 + 8 * 255 / 2) / (8 * 255);
+					int delta = (average[1][c] * 31 + 8 * 255 / 2) / (8 * 255) - code[0][c];
+					delta = delta < -4 ? -4 : delta > 3 ? 3 : delta;
+					code[1][c] = code[0][c] + delta;
+					valid = valid && code[1][c] >= 0 && code[1][c] <= 31;
+					for(int h = 0; h < 2; ++h)
+						base[h][c] = code[h][c] << 3 | code[h][c] >> 2;
+				}
+				else
+				{
+					for(int h = 0; h < 2; ++h)
 					{
-						assert(ui_ctx.active_text_input);
-						ui_ctx.text_input_changed = true;
+						code[h][c] = (average[h][c] * 15 + 8 * 255 / 2) / (8 * 255);
+						base[h][c] = code[h][c] * 17;
 					}
 				}
-				break;
-				#if 0
-				case SDLK_a:
+			}
+			if(!valid)
+				continue;
+			int table[2];
+			uint32_t bits[2];
+			int error = ui_etc_fit_subblock_(block, pixels[0], base[0], &table[0], &bits[0])
+						+ ui_etc_fit_subblock_(block, pixels[1], base[1], &table[1], &bits[1]);
+			if(error >= best_error)
+				continue;
+			best_error = error;
+			uint64_t word = 0;
+			for(int c = 0; c < 3; ++c)
+			{
+				int shift = 59 - c * 8;
+				if(diff)
+					word |= (uint64_t)code[0][c] << shift | (uint64_t)((code[1][c] - code[0][c]) & 7) << (shift - 3);
+				else
+					word |= (uint64_t)code[0][c] << (shift + 1) | (uint64_t)code[1][c] << (shift - 3);
+			}
+			word |= (uint64_t)table[0] << 37 | (uint64_t)table[1] << 34 | (uint64_t)diff << 33 | (uint64_t)flip << 32;
+			best_word = word | bits[0] | bits[1];
+		}
+	}
+	return best_word;
+}
+
+static uint64_t ui_eac_encode_alpha_(const unsigned char *block)
+{
+	int lo = 255, hi = 0;
+	for(int i = 0; i < 16; ++i)
+	{
+		lo = min(lo, (int)block[i * 4 + 3]);
+		hi = max(hi, (int)block[i * 4 + 3]);
+	}
+	int base = (lo + hi + 1) / 2;
+	uint64_t best_word = 0;
+	int best_error = INT32_MAX;
+	for(int t = 0; t < 16 && best_error > 0; ++t)
+	{
+		for(int multiplier = 1; multiplier < 16; ++multiplier)
+		{
+			int error = 0;
+			uint64_t indices = 0;
+			for(int i = 0; i < 16; ++i)
+			{
+				int best = INT32_MAX, best_index = 0;
+				for(int m = 0; m < 8; ++m)
 				{
-					if(ctrl && ui_ctx.active_text_input)
+					int d = ui_clamp_byte_(base + ui_eac_modifiers_[t][m] * multiplier) - block[i * 4 + 3];
+					if(d * d < best)
 					{
-						size_t maxchars = ui_ctx.max_active_text_input_length;
-						size_t n = strlen(ui_ctx.active_text_input);
-						if(n > 0)
-						{
-							ui_ctx.selection_beg = 0;
-							ui_ctx.selection_end = n;
-							ui_ctx.caret_pos = n;
-						}
+						best = d * d;
+						best_index = m;
 					}
 				}
-				break;
-				#endif
+				error += best;
+				indices |= (uint64_t)best_index << (45 - i * 3);
+			}
+			if(error < best_error)
+			{
+				best_error = error;
+				best_word = (uint64_t)base << 56 | (uint64_t)multiplier << 52 | (uint64_t)t << 48 | indices;
 			}
 		}
-		break;
-		case SDL_TEXTINPUT:
+	}
+	return best_word;
+}
+
+static void ui_write_u64_be_(unsigned char *p, uint64_t v)
+{
+	for(int i = 0; i < 8; ++i)
+		p[i] = (unsigned char)(v >> (56 - i * 8));
+}
+
+static void ui_write_u32_le_(unsigned char *p, uint32_t v)
+{
+	for(int i = 0; i < 4; ++i)
+		p[i] = (unsigned char)(v >> (i * 8));
+}
+
+static void ui_write_u64_le_(unsigned char *p, uint64_t v)
+{
+	ui_write_u32_le_(p, (uint32_t)v);
+	ui_write_u32_le_(p + 4, (uint32_t)(v >> 32));
+}
+
+static unsigned char *ui_etc2_encode_(const unsigned char *rgba, int w, int h, bool alpha, size_t *out_size)
+{
+	size_t block_bytes = alpha ? 16 : 8;
+	int bw = (w + 3) / 4, bh = (h + 3) / 4;
+	*out_size = (size_t)bw * bh * block_bytes;
+	unsigned char *out = malloc(*out_size);
+	for(int by = 0; by < bh; ++by)
+	{
+		for(int bx = 0; bx < bw; ++bx)
+		{
+			// Edge blocks repeat the last row and column
+			unsigned char block[16 * 4];
+			for(int i = 0; i < 16; ++i)
+			{
+				int x = min(bx * 4 + i / 4, w - 1), y = min(by * 4 + i % 4, h - 1);
+				memcpy(&block[i * 4], &rgba[((size_t)y * w + x) * 4], 4);
+			}
+			unsigned char *dst = out + ((size_t)by * bw + bx) * block_bytes;
+			if(alpha)
+			{
+				ui_write_u64_be_(dst, ui_eac_encode_alpha_(block));
+				dst += 8;
+			}
+			ui_write_u64_be_(dst, ui_etc2_encode_rgb_(block));
+		}
+	}
+	return out;
+}
+
+// Offline conversion, build a tool with UI_KTX2_WRITER and ship the .ktx2 files instead of PNGs. Writes
+// RGB8_ETC2 or RGBA8_ETC2_EAC when any pixel is translucent, with the mip chain down to 1 pixel if asked.
+bool ui_convert_image_ktx2(const char *src_path, const char *dst_path, bool mipmaps)
+{
+	int width, height, channels;
+	unsigned char *image = stbi_load(src_path, &width, &height, &channels, STBI_rgb_alpha);
+	if(!image)
+		return false;
+	bool alpha = false;
+	for(size_t i = 0; i < (size_t)width * height && !alpha; ++i)
+		alpha = image[i * 4 + 3] != 255;
+	size_t block_bytes = alpha ? 16 : 8;
+
+	unsigned char *levels[UI_KTX2_MAX_LEVELS];
+	size_t sizes[UI_KTX2_MAX_LEVELS];
+	uint32_t numlevels = 0;
+	unsigned char *pixels = image;
+	int w = width, h = height;
+	while(1)
+	{
+		levels[numlevels] = ui_etc2_encode_(pixels, w, h, alpha, &sizes[numlevels]);
+		++numlevels;
+		if(!mipmaps || numlevels == UI_KTX2_MAX_LEVELS || (w == 1 && h == 1))
+			break;
+		// Odd sizes round down like GL's level sizes, a 1 pixel side is duplicated instead of halved
+		int nw = max(w / 2, 1), nh = max(h / 2, 1);
+		unsigned char *src = pixels, *padded = NULL;
+		if(w == 1 || h == 1)
+		{
+			padded = malloc((size_t)max(w, 2) * max(h, 2) * 4);
+			for(int y = 0; y < max(h, 2); ++y)
+				for(int x = 0; x < max(w, 2); ++x)
+					memcpy(&padded[((size_t)y * max(w, 2) + x) * 4], &pixels[((size_t)min(y, h - 1) * w + min(x, w - 1)) * 4], 4);
+			src = padded;
+		}
+		unsigned char *next = malloc((size_t)nw * nh * 4);
+		ui_image_halve_(src, max(w, 2), max(h, 2), next);
+		free(padded);
+		if(pixels != image)
+			free(pixels);
+		pixels = next;
+		w = nw;
+		h = nh;
+	}
+	if(pixels != image)
+		free(pixels);
+	stbi_image_free(image);
+
+	// Basic data format descriptor, one ETC2 sample or an alpha and a color sample
+	uint32_t numsamples = alpha ? 2 : 1;
+	uint32_t dfd_size = 4 + 24 + 16 * numsamples;
+	unsigned char dfd[4 + 24 + 16 * 2] = { 0 };
+	ui_write_u32_le_(dfd, dfd_size);
+	ui_write_u32_le_(dfd + 8, 2 | (24 + 16 * numsamples) << 16); // versionNumber, descriptorBlockSize
+	dfd[12] = 161; // KHR_DF_MODEL_ETC2
+	dfd[13] = 1; // BT709 primaries
+	dfd[14] = 1; // Linear, sampled like the GL_RGBA uploads of other images
+	dfd[16] = 3;
+	dfd[17] = 3;
+	dfd[20] = (unsigned char)block_bytes;
+	for(uint32_t i = 0; i < numsamples; ++i)
+	{
+		unsigned char *sample = dfd + 28 + i * 16;
+		sample[0] = (unsigned char)(i * 64); // bitOffset
+		sample[2] = 63; // bitLength - 1
+		sample[3] = alpha && i == 0 ? 15 : 0; // KHR_DF_CHANNEL_ETC2_ALPHA or _COLOR
+		ui_write_u32_le_(sample + 12, UINT32_MAX);
+	}
+
+	unsigned char header[UI_KTX2_HEADER_SIZE + UI_KTX2_MAX_LEVELS * 24] = { 0 };
+	memcpy(header, ui_ktx2_identifier_, sizeof(ui_ktx2_identifier_));
+	ui_write_u32_le_(header + 12, alpha ? 151 : 147);
+	ui_write_u32_le_(header + 16, 1);
+	ui_write_u32_le_(header + 20, width);
+	ui_write_u32_le_(header + 24, height);
+	ui_write_u32_le_(header + 36, 1);
+	ui_write_u32_le_(header + 40, numlevels);
+	size_t index_size = UI_KTX2_HEADER_SIZE + numlevels * 24;
+	ui_write_u32_le_(header + 48, (uint32_t)index_size);
+	ui_write_u32_le_(header + 52, dfd_size);
+	// Smallest level first as the spec recommends, each aligned to the block size
+	size_t offset = index_size + dfd_size;
+	for(uint32_t i = numlevels; i-- > 0;)
+	{
+		offset = (offset + block_bytes - 1) / block_bytes * block_bytes;
+		unsigned char *entry = header + UI_KTX2_HEADER_SIZE + i * 24;
+		ui_write_u64_le_(entry, offset);
+		ui_write_u64_le_(entry + 8, sizes[i]);
+		ui_write_u64_le_(entry + 16, sizes[i]);
+		offset += sizes[i];
+	}
+
+	FILE *fp = fopen(dst_path, "wb");
+	bool ok = fp && fwrite(header, 1, index_size, fp) == index_size && fwrite(dfd, 1, dfd_size, fp) == dfd_size;
+	size_t written = index_size + dfd_size;
+	for(uint32_t i = numlevels; i-- > 0;)
+	{
+		static const unsigned char padding[16];
+		size_t pad = (block_bytes - written % block_bytes) % block_bytes;
+		ok = ok && fwrite(padding, 1, pad, fp) == pad && fwrite(levels[i], 1, sizes[i], fp) == sizes[i];
+		written += pad + sizes[i];
+		free(levels[i]);
+	}
+	if(fp)
+		fclose(fp);
+	if(!ok)
+		remove(dst_path);
+	return ok;
+}
+#endif
+
+static unsigned int ui_hash_string_(const char *str)
+{
+	// FNV-1a
+	unsigned int h = 2166136261u;
+	while(*str)
+	{
+		h ^= (unsigned char)*str++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// FNV-1a continued from h
+static unsigned int ui_hash_bytes_(unsigned int h, const void *data, size_t size)
+{
+	const unsigned char *p = data;
+	for(size_t i = 0; i < size; ++i)
+	{
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static time_t ui_file_mtime_(const char *path)
+{
+	struct stat st;
+	if(stat(path, &st) != 0)
+		return 0;
+	return st.st_mtime;
+}
+
+static void ui_image_cache_unlink_lru_(UIImageCache *cache, UIImageCacheEntry *entry)
+{
+	if(entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		cache->lru_head = entry->lru_next;
+	if(entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		cache->lru_tail = entry->lru_prev;
+	entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void ui_image_cache_touch_(UIImageCache *cache, UIImageCacheEntry *entry)
+{
+	entry->last_frame = ui_ctx.frame;
+	if(cache->lru_head == entry)
+		return;
+	ui_image_cache_unlink_lru_(cache, entry);
+	entry->lru_next = cache->lru_head;
+	if(cache->lru_head)
+		cache->lru_head->lru_prev = entry;
+	cache->lru_head = entry;
+	if(!cache->lru_tail)
+		cache->lru_tail = entry;
+}
+
+static void ui_image_cache_delete_texture_(UIImageCacheEntry *entry)
+{
+	// Failed loads share the default image, ui_unload_image leaves it alone
+	ui_unload_image(entry->image_id);
+	entry->image_id = 0;
+}
+
+static void ui_image_cache_load_(UIImageCache *cache, UIImageCacheEntry *entry, UIVec2 size)
+{
+	UIImageLoadOptions options = { 0 };
+	options.mipmaps = cache->mipmaps;
+	if(cache->downscale)
+	{
+		// Downscaling keeps the aspect ratio, a stretched draw needs the factor that covers both axes
+		if(entry->source_width > 0 && entry->source_height > 0 && size.x > 0.f && size.y > 0.f)
+		{
+			float scale = max(size.x / entry->source_width, size.y / entry->source_height);
+			size.x = entry->source_width * scale;
+			size.y = entry->source_height * scale;
+		}
+		options.max_width = (int)ceilf(size.x);
+		options.max_height = (int)ceilf(size.y);
+	}
+	if(!ui_on_gl_thread_())
+	{
+		// The default image stands in until the next submission loads it
+		if(!entry->deferred)
+			cache->numdeferred++;
+		entry->deferred = true;
+		entry->deferred_size = size;
+		entry->image_id = ui_ctx.default_image;
+		entry->width = entry->height = entry->source_width = entry->source_height = 0;
+		entry->bytes = 0;
+		entry->mtime = ui_file_mtime_(entry->path);
+		entry->last_validated = ticks();
+		return;
+	}
+	UIImageInfo info = { 0 };
+	entry->image_id = ui_load_image_(entry->path, &options, &info);
+	entry->width = info.width;
+	entry->height = info.height;
+	entry->source_width = info.source_width;
+	entry->source_height = info.source_height;
+	entry->bytes = entry->image_id == ui_ctx.default_image ? 0 : info.bytes;
+	entry->mtime = ui_file_mtime_(entry->path);
+	entry->last_validated = ticks();
+	cache->stats.bytes += entry->bytes;
+}
+
+// Whether the entry was downscaled below the size it is drawn at now
+static bool ui_image_cache_too_small_(UIImageCacheEntry *entry, UIVec2 size)
+{
+	if(size.x <= 0.f || size.y <= 0.f)
+	{
+		size.x = (float)entry->source_width;
+		size.y = (float)entry->source_height;
+	}
+	return (entry->width < entry->source_width && size.x > entry->width)
+		   || (entry->height < entry->source_height && size.y > entry->height);
+}
+
+static void ui_image_cache_remove_(UIImageCache *cache, UIImageCacheEntry *entry)
+{
+	UIImageCacheEntry **it = &cache->buckets[entry->hash % cache->numbuckets];
+	while(*it != entry)
+		it = &(*it)->hash_next;
+	*it = entry->hash_next;
+	ui_image_cache_unlink_lru_(cache, entry);
+	ui_image_cache_delete_texture_(entry);
+	if(entry->deferred)
+		cache->numdeferred--;
+	cache->stats.bytes -= entry->bytes;
+	cache->stats.entries--;
+	free(entry->path);
+	free(entry);
+}
+
+static void ui_image_cache_evict_(UIImageCache *cache)
+{
+	UIImageCacheEntry *it = cache->lru_tail;
+	while(it && cache->stats.bytes > cache->stats.budget)
+	{
+		UIImageCacheEntry *prev = it->lru_prev;
+		// Pinned images and images drawn this frame stay resident, even over budget
+		if(it->refcount <= 0 && it->last_frame != ui_ctx.frame)
+		{
+			ui_image_cache_remove_(cache, it);
+			cache->stats.evictions++;
+		}
+		it = prev;
+	}
+}
+
+static void ui_image_cache_grow_(UIImageCache *cache)
+{
+	size_t n = cache->numbuckets * 2;
+	if(n == 0)
+		n = 64;
+	UIImageCacheEntry **buckets = calloc(n, sizeof(UIImageCacheEntry *));
+	for(size_t i = 0; i < cache->numbuckets; ++i)
+	{
+		UIImageCacheEntry *it = cache->buckets[i];
+		while(it)
+		{
+			UIImageCacheEntry *next = it->hash_next;
+			it->hash_next = buckets[it->hash % n];
+			buckets[it->hash % n] = it;
+			it = next;
+		}
+	}
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->numbuckets = n;
+}
+
+static UIImageCacheEntry *ui_image_cache_lookup_(const char *path, UIVec2 size)
+{
+	UIImageCache *cache = &ui_ctx.shared->image_cache;
+	if(cache->stats.entries >= cache->numbuckets)
+	{
+		ui_image_cache_grow_(cache);
+	}
+	unsigned int hash = ui_hash_string_(path);
+	UIImageCacheEntry *entry = cache->buckets[hash % cache->numbuckets];
+	while(entry)
+	{
+		if(entry->hash == hash && !strcmp(entry->path, path))
+			break;
+		entry = entry->hash_next;
+	}
+	if(entry)
+	{
+		unsigned int now = ticks();
+		if(now - entry->last_validated >= UI_IMAGE_CACHE_REVALIDATE_MS)
+		{
+			entry->last_validated = now;
+			if(ui_file_mtime_(entry->path) != entry->mtime)
+				entry->stale = true;
+		}
+		bool reload = entry->stale;
+		if(!reload && cache->downscale && ui_image_cache_too_small_(entry, size))
+		{
+			// Grow by at least half so a zoom animation doesn't reload every frame
+			size.x = max(size.x, entry->width * 1.5f);
+			size.y = max(size.y, entry->height * 1.5f);
+			reload = true;
+		}
+		// Ids handed out by ui_acquire_image stay valid, the old texture is served until the last release
+		if(reload && entry->refcount <= 0)
+		{
+			entry->stale = false;
+			ui_image_cache_delete_texture_(entry);
+			cache->stats.bytes -= entry->bytes;
+			ui_image_cache_load_(cache, entry, size);
+			cache->stats.reloads++;
+			cache->stats.misses++;
+			ui_image_cache_touch_(cache, entry);
+			ui_image_cache_evict_(cache);
+			return entry;
+		}
+		cache->stats.hits++;
+		ui_image_cache_touch_(cache, entry);
+		return entry;
+	}
+	entry = calloc(1, sizeof(UIImageCacheEntry));
+	entry->path = strdup(path);
+	entry->hash = hash;
+	entry->hash_next = cache->buckets[hash % cache->numbuckets];
+	cache->buckets[hash % cache->numbuckets] = entry;
+	cache->stats.entries++;
+	cache->stats.misses++;
+	ui_image_cache_load_(cache, entry, size);
+	ui_image_cache_touch_(cache, entry);
+	ui_image_cache_evict_(cache);
+	return entry;
+}
+
+// Uploads what was loaded off the GL thread, called there with the shared lock held
+static void ui_shared_load_deferred_(UIShared *shared)
+{
+	for(size_t i = 0; i < shared->atlas.numpages; ++i)
+	{
+		UIAtlasPage *page = &shared->atlas.pages[i];
+		if(page->upload_pending)
+		{
+			page->upload_pending = false;
+			ui_atlas_upload_(page, 0, 0, UI_ATLAS_PAGE_SIZE, UI_ATLAS_PAGE_SIZE);
+		}
+	}
+	UIImageCache *cache = &shared->image_cache;
+	for(UIImageCacheEntry *entry = cache->lru_head; entry && cache->numdeferred > 0; entry = entry->lru_next)
+	{
+		if(!entry->deferred)
+			continue;
+		entry->deferred = false;
+		cache->numdeferred--;
+		ui_image_cache_load_(cache, entry, entry->deferred_size);
+	}
+	ui_image_cache_evict_(cache);
+}
+
+unsigned int ui_acquire_image(const char *path)
+{
+	ui_shared_lock_();
+	UIImageCacheEntry *entry = ui_image_cache_lookup_(path, (UIVec2) { 0.f, 0.f });
+	entry->refcount++;
+	unsigned int image_id = entry->image_id;
+	ui_shared_unlock_();
+	return image_id;
+}
+
+void ui_release_image(const char *path)
+{
+	UIImageCache *cache = &ui_ctx.shared->image_cache;
+	ui_shared_lock_();
+	if(!cache->numbuckets)
+	{
+		ui_shared_unlock_();
+		return;
+	}
+	unsigned int hash = ui_hash_string_(path);
+	for(UIImageCacheEntry *it = cache->buckets[hash % cache->numbuckets]; it; it = it->hash_next)
+	{
+		if(it->hash == hash && !strcmp(it->path, path))
+		{
+			assert(it->refcount > 0);
+			it->refcount--;
+			break;
+		}
+	}
+	ui_image_cache_evict_(cache);
+	ui_shared_unlock_();
+}
+
+void ui_image_cache_budget(size_t bytes)
+{
+	ui_shared_lock_();
+	ui_ctx.shared->image_cache.stats.budget = bytes;
+	ui_image_cache_evict_(&ui_ctx.shared->image_cache);
+	ui_shared_unlock_();
+}
+
+void ui_image_cache_options(bool downscale, bool mipmaps)
+{
+	ui_shared_lock_();
+	ui_ctx.shared->image_cache.downscale = downscale;
+	ui_ctx.shared->image_cache.mipmaps = mipmaps;
+	ui_shared_unlock_();
+}
+
+void ui_image_cache_stats(UIImageCacheStats *out_stats)
+{
+	ui_shared_lock_();
+	*out_stats = ui_ctx.shared->image_cache.stats;
+	ui_shared_unlock_();
+}
+
+void ui_image_cache_clear()
+{
+	UIImageCache *cache = &ui_ctx.shared->image_cache;
+	ui_shared_lock_();
+	while(cache->lru_head)
+	{
+		ui_image_cache_remove_(cache, cache->lru_head);
+	}
+	free(cache->buckets);
+	cache->buckets = NULL;
+	cache->numbuckets = 0;
+	ui_shared_unlock_();
+}
+static void *ui_state_ex_(unsigned int id, size_t size, void (*destroy)(void *))
+{
+	UIStateStore *store = &ui_ctx.state_store;
+	if(store->numentries >= store->numbuckets)
+	{
+		size_t n = store->numbuckets == 0 ? 64 : store->numbuckets * 2;
+		UIStateEntry **buckets = calloc(n, sizeof(UIStateEntry *));
+		for(size_t i = 0; i < store->numbuckets; ++i)
+		{
+			UIStateEntry *it = store->buckets[i];
+			while(it)
+			{
+				UIStateEntry *next = it->next;
+				it->next = buckets[it->id % n];
+				buckets[it->id % n] = it;
+				it = next;
+			}
+		}
+		free(store->buckets);
+		store->buckets = buckets;
+		store->numbuckets = n;
+	}
+	UIStateEntry **bucket = &store->buckets[id % store->numbuckets];
+	for(UIStateEntry **link = bucket; *link; link = &(*link)->next)
+	{
+		UIStateEntry *it = *link;
+		if(it->id != id)
+			continue;
+		if(it->size == size && it->destroy == destroy)
+			return it + 1;
+		// A hash collision with another kind of state, start over rather than hand out the wrong block
+		*link = it->next;
+		if(it->destroy)
+			it->destroy(it + 1);
+		free(it);
+		store->numentries--;
+		break;
+	}
+	// Zero initialized state follows the header
+	UIStateEntry *entry = calloc(1, sizeof(UIStateEntry) + size);
+	entry->id = id;
+	entry->size = size;
+	entry->destroy = destroy;
+	entry->next = *bucket;
+	*bucket = entry;
+	store->numentries++;
+	return entry + 1;
+}
+
+static void *ui_state_(unsigned int id, size_t size)
+{
+	return ui_state_ex_(id, size, NULL);
+}
+
+static void ui_state_clear_()
+{
+	UIStateStore *store = &ui_ctx.state_store;
+	for(size_t i = 0; i < store->numbuckets; ++i)
+	{
+		UIStateEntry *it = store->buckets[i];
+		while(it)
+		{
+			UIStateEntry *next = it->next;
+			if(it->destroy)
+				it->destroy(it + 1);
+			free(it);
+			it = next;
+		}
+	}
+	free(store->buckets);
+	memset(store, 0, sizeof(UIStateStore));
+}
+
+static unsigned int ui_id_append_(unsigned int h, const char *str)
+{
+	while(*str)
+	{
+		h ^= (unsigned char)*str++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// Ids are scoped to the enclosing pane so the same label can be reused in different panes
+static unsigned int ui_id_(const char *str)
+{
+	return ui_id_append_(ui_ctx.pane_depth > 0 ? ui_ctx.panes[ui_ctx.pane_depth - 1].id : 2166136261u, str);
+}
+
+void ui_font_measure_text(UIFont *font, const char *beg, const char *end, float *width, float *height)
+{
+	if(width)
+	{
+		*width = 0.f;
+	}
+	#if 0
+	if(height)
+	{
+		*height = 0.f;
+	}
+	#endif
+
+	float scale = stbtt_ScaleForPixelHeight(&font->font_info, font->font_size);
+	#if 1
+	int ascent, descent, lineGap;
+	stbtt_GetFontVMetrics(&font->font_info, &ascent, &descent, &lineGap);
+	if(height)
+	{
+		float h = (ascent - descent + lineGap) * scale;
+		if(*height == 0.f || h > *height)
+		{
+			*height = h;
+		}
+	}
+	#endif
+	float x, y;
+	while(1)
+	{
+		if(end)
+		{
+			if(beg == end)
+				break;
+		}
+		else
+		{
+			if(!*beg)
+				break;
+		}
+		if(*beg >= 32 && *beg < 128)
+		{
+			int advance, lsb, x0, y0, x1, y1;
+			stbtt_GetCodepointHMetrics(&font->font_info, *beg, &advance, &lsb);
+			stbtt_GetCodepointBitmapBox(&font->font_info, *beg, 1, 1, &x0, &y0, &x1, &y1);
+			if(width)
+			{
+				*width += advance * scale;
+			}
+
+			stbtt_aligned_quad q;
+			stbtt_GetBakedQuad(font->cdata, 512, 512, *beg - 32, &x, &y, &q, 1);
+#if 0
+			if(width)
+			{
+				*width += (q.x1 - q.x0);
+			}
+			// Unreliable
+			if(height)
+			{
+				float h = (q.y1 - q.y0);
+				if(*height == 0.f || h > *height)
+				{
+					*height = h;
+				}
+			}
+#endif
+		}
+		++beg;
+	}
+}
+static void ui_text_arena_reset_()
+{
+	if(!ui_ctx.text_arena)
+	{
+		ui_ctx.text_arena_capacity = 4096;
+		ui_ctx.text_arena = malloc(ui_ctx.text_arena_capacity);
+		ui_ctx.width_arena_capacity = 4096;
+		ui_ctx.width_arena = malloc(sizeof(float) * ui_ctx.width_arena_capacity);
+	}
+	ui_ctx.text_arena[0] = 0;
+	ui_ctx.text_arena_size = 1;
+	ui_ctx.width_arena[0] = 0.f;
+	ui_ctx.width_arena_size = 1;
+}
+
+// Offset of n + 1 bytes, pointers into the arena are only stable until the next push
+static size_t ui_text_arena_push_(size_t n)
+{
+	if(!ui_ctx.text_arena)
+		ui_text_arena_reset_();
+	if(ui_ctx.text_arena_size + n + 1 > ui_ctx.text_arena_capacity)
+	{
+		while(ui_ctx.text_arena_size + n + 1 > ui_ctx.text_arena_capacity)
+			ui_ctx.text_arena_capacity *= 2;
+		ui_ctx.text_arena = realloc(ui_ctx.text_arena, ui_ctx.text_arena_capacity);
+	}
+	size_t offset = ui_ctx.text_arena_size;
+	ui_ctx.text_arena_size += n + 1;
+	return offset;
+}
+
+// Prefix sums of the glyph advances, widths[i] is the width of the first i characters
+static size_t ui_text_widths_(const char *text, size_t n)
+{
+	if(n == 0)
+		return 0;
+	if(!ui_ctx.text_arena)
+		ui_text_arena_reset_();
+	if(ui_ctx.width_arena_size + n + 1 > ui_ctx.width_arena_capacity)
+	{
+		while(ui_ctx.width_arena_size + n + 1 > ui_ctx.width_arena_capacity)
+			ui_ctx.width_arena_capacity *= 2;
+		ui_ctx.width_arena = realloc(ui_ctx.width_arena, sizeof(float) * ui_ctx.width_arena_capacity);
+	}
+	size_t offset = ui_ctx.width_arena_size;
+	ui_ctx.width_arena_size += n + 1;
+	const float *advance = ui_ctx.default_font->glyphs.advance;
+	float *widths = &ui_ctx.width_arena[offset];
+	widths[0] = 0.f;
+	for(size_t i = 0; i < n; ++i)
+	{
+		unsigned char g = (unsigned char)text[i] - 32;
+		widths[i + 1] = widths[i] + (g < 96 ? advance[g] : 0.f);
+	}
+	return offset;
+}
+
+// Number of leading characters that fit in max_width
+static size_t ui_text_fit_(const float *widths, size_t n, float max_width)
+{
+	size_t lo = 0, hi = n;
+	while(lo < hi)
+	{
+		size_t mid = hi - (hi - lo) / 2;
+		if(widths[mid] <= max_width)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+// Character boundary closest to x
+static size_t ui_text_hit_(const float *widths, size_t n, float x)
+{
+	size_t i = ui_text_fit_(widths, n, x);
+	if(i < n && widths[i + 1] - x < x - widths[i])
+		++i;
+	return i;
+}
+
+static const char *ui_element_label_(const UIElement *e)
+{
+	return &ui_ctx.text_arena[e->label];
+}
+
+static const float *ui_element_label_widths_(const UIElement *e)
+{
+	return &ui_ctx.width_arena[e->label_widths];
+}
+
+static float ui_element_label_width_(const UIElement *e)
+{
+	return ui_ctx.width_arena[e->label_widths + e->label_length];
+}
+
+static void ui_element_set_label_(UIElement *e, const char *text)
+{
+	size_t n = strlen(text);
+	e->label = ui_text_arena_push_(n);
+	e->label_length = n;
+	memcpy(&ui_ctx.text_arena[e->label], text, n + 1);
+	e->label_widths = ui_text_widths_(&ui_ctx.text_arena[e->label], n);
+}
+
+static void ui_element_format_label_(UIElement *e, const char *fmt, va_list va)
+{
+	va_list copy;
+	va_copy(copy, va);
+	int n = vsnprintf(NULL, 0, fmt, copy);
+	va_end(copy);
+	if(n <= 0)
+		return;
+	e->label = ui_text_arena_push_(n);
+	e->label_length = n;
+	vsnprintf(&ui_ctx.text_arena[e->label], n + 1, fmt, va);
+	e->label_widths = ui_text_widths_(&ui_ctx.text_arena[e->label], n);
+}
+
+static UIElement *ui_new_element_(k_EUIElementType type)
+{
+	if(ui_ctx.numelements >= ui_ctx.maxelements)
+	{
+		size_t n = ui_ctx.maxelements * 2;
+		if(n == 0)
+			n = 7;
+		ui_ctx.elements = realloc(ui_ctx.elements, sizeof(UIElement) * n);
+		ui_ctx.maxelements = n;
+	}
+	UIElement *e = &ui_ctx.elements[ui_ctx.numelements++];
+	memset(e, 0, sizeof(UIElement));
+	e->type = type;
+	e->index = ui_ctx.numelements - 1;
+	e->transform = ui_current_transform_();
+	//e->x = ui_ctx.x;
+	//e->y = ui_ctx.y;
+
+	void ui_element_layout_prev_();
+	ui_element_layout_prev_();
+	return e;
+}
+
+bool ui_input_selection_valid()
+{
+	size_t n = strlen(ui_ctx.active_text_input);
+	return ui_ctx.selection_beg >= 0 && ui_ctx.selection_end <= n && ui_ctx.selection_beg < ui_ctx.selection_end;
+}
+void ui_input_clear_selection()
+{
+	ui_ctx.selection_beg = -1;
+	ui_ctx.selection_end = -1;
+}
+void ui_input_remove_selection()
+{
+	size_t n = strlen(ui_ctx.active_text_input);
+	memmove(&ui_ctx.active_text_input[ui_ctx.selection_beg],
+			&ui_ctx.active_text_input[ui_ctx.selection_end],
+			n + 1 - ui_ctx.selection_end);
+	ui_ctx.caret_pos = ui_ctx.selection_beg;
+	ui_input_clear_selection();
+}
+
+size_t ui_text_buffer_length(UITextBuffer *b)
+{
+	return b->capacity - (b->gap_end - b->gap_start);
+}
+
+static char ui_text_buffer_at_(UITextBuffer *b, size_t pos)
+{
+	return pos < b->gap_start ? b->data[pos] : b->data[pos + (b->gap_end - b->gap_start)];
+}
+
+static void ui_text_buffer_move_gap_(UITextBuffer *b, size_t pos)
+{
+	if(pos < b->gap_start)
+	{
+		size_t n = b->gap_start - pos;
+		memmove(b->data + b->gap_end - n, b->data + pos, n);
+		b->gap_start -= n;
+		b->gap_end -= n;
+	}
+	else if(pos > b->gap_start)
+	{
+		size_t n = pos - b->gap_start;
+		memmove(b->data + b->gap_start, b->data + b->gap_end, n);
+		b->gap_start += n;
+		b->gap_end += n;
+	}
+}
+
+static void ui_text_buffer_reserve_lines_(UITextBuffer *b, size_t n)
+{
+	if(b->numlines + n <= b->maxlines)
+		return;
+	while(b->maxlines < b->numlines + n)
+		b->maxlines = b->maxlines == 0 ? 256 : b->maxlines * 2;
+	b->lines = realloc(b->lines, sizeof(size_t) * b->maxlines);
+	b->line_widths = realloc(b->line_widths, sizeof(float) * b->maxlines);
+}
+
+// Line containing pos
+static size_t ui_text_buffer_line_of_(UITextBuffer *b, size_t pos)
+{
+	size_t lo = 0, hi = b->numlines;
+	while(hi - lo > 1)
+	{
+		size_t mid = (lo + hi) / 2;
+		if(b->lines[mid] <= pos)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Offset past the last character of a line, excluding the newline
+static size_t ui_text_buffer_line_end_(UITextBuffer *b, size_t line)
+{
+	return line + 1 < b->numlines ? b->lines[line + 1] - 1 : ui_text_buffer_length(b);
+}
+
+static void ui_text_buffer_insert_(UITextBuffer *b, size_t pos, const char *text, size_t n)
+{
+	if(n > b->gap_end - b->gap_start)
+	{
+		size_t length = ui_text_buffer_length(b);
+		size_t capacity = max(b->capacity * 2, length + n + 64);
+		char *data = malloc(capacity);
+		memcpy(data, b->data, b->gap_start);
+		size_t tail = b->capacity - b->gap_end;
+		memcpy(data + capacity - tail, b->data + b->gap_end, tail);
+		free(b->data);
+		b->data = data;
+		b->gap_end = capacity - tail;
+		b->capacity = capacity;
+	}
+	ui_text_buffer_move_gap_(b, pos);
+	memcpy(b->data + b->gap_start, text, n);
+	b->gap_start += n;
+
+	size_t line = ui_text_buffer_line_of_(b, pos);
+	size_t newlines = 0;
+	for(size_t i = 0; i < n; ++i)
+		newlines += text[i] == '\n';
+	ui_text_buffer_reserve_lines_(b, newlines);
+	size_t tail = b->numlines - line - 1;
+	memmove(b->lines + line + 1 + newlines, b->lines + line + 1, sizeof(size_t) * tail);
+	memmove(b->line_widths + line + 1 + newlines, b->line_widths + line + 1, sizeof(float) * tail);
+	for(size_t i = line + 1 + newlines; i < b->numlines + newlines; ++i)
+		b->lines[i] += n;
+	size_t k = line + 1;
+	for(size_t i = 0; i < n; ++i)
+	{
+		if(text[i] == '\n')
+		{
+			b->lines[k] = pos + i + 1;
+			b->line_widths[k] = -1.f;
+			++k;
+		}
+	}
+	b->numlines += newlines;
+	b->line_widths[line] = -1.f;
+	b->changed = true;
+}
+
+static void ui_text_buffer_erase_(UITextBuffer *b, size_t from, size_t to)
+{
+	if(from >= to)
+		return;
+	size_t first = ui_text_buffer_line_of_(b, from);
+	size_t last = ui_text_buffer_line_of_(b, to);
+	ui_text_buffer_move_gap_(b, from);
+	b->gap_end += to - from;
+	// Lines starting inside the erased range merge into the first one
+	size_t removed = last - first;
+	size_t tail = b->numlines - last - 1;
+	memmove(b->lines + first + 1, b->lines + last + 1, sizeof(size_t) * tail);
+	memmove(b->line_widths + first + 1, b->line_widths + last + 1, sizeof(float) * tail);
+	b->numlines -= removed;
+	for(size_t i = first + 1; i < b->numlines; ++i)
+		b->lines[i] -= to - from;
+	b->line_widths[first] = -1.f;
+	b->changed = true;
+}
+
+UITextBuffer *ui_create_text_buffer(const char *text, size_t length)
+{
+	UITextBuffer *b = calloc(1, sizeof(UITextBuffer));
+	b->capacity = length + 4096;
+	b->data = malloc(b->capacity);
+	b->gap_start = 0;
+	b->gap_end = b->capacity;
+	ui_text_buffer_reserve_lines_(b, 1);
+	b->lines[0] = 0;
+	b->line_widths[0] = -1.f;
+	b->numlines = 1;
+	ui_text_buffer_insert_(b, 0, text, length);
+	b->changed = false;
+	return b;
+}
+
+void ui_destroy_text_buffer(UITextBuffer *b)
+{
+	if(ui_ctx.active_editor == b)
+		ui_ctx.active_editor = NULL;
+	free(b->data);
+	free(b->lines);
+	free(b->line_widths);
+	free(b);
+}
+
+size_t ui_text_buffer_copy(UITextBuffer *b, char *out, size_t out_size)
+{
+	size_t length = ui_text_buffer_length(b);
+	if(out_size == 0)
+		return length;
+	size_t n = min(length, out_size - 1);
+	size_t head = min(n, b->gap_start);
+	memcpy(out, b->data, head);
+	memcpy(out + head, b->data + b->gap_end, n - head);
+	out[n] = 0;
+	return length;
+}
+
+static float ui_glyph_advance_(UIFont *font, char c)
+{
+	if(c < 32 || c >= 127)
+		return 0.f;
+	return font->cdata[c - 32].xadvance;
+}
+
+static float ui_text_buffer_measure_(UITextBuffer *b, size_t from, size_t to)
+{
+	float w = 0.f;
+	for(size_t i = from; i < to; ++i)
+		w += ui_glyph_advance_(ui_ctx.default_font, ui_text_buffer_at_(b, i));
+	return w;
+}
+
+static float ui_text_buffer_line_width_(UITextBuffer *b, size_t line)
+{
+	if(b->line_widths[line] < 0.f)
+	{
+		b->line_widths[line] = ui_text_buffer_measure_(b, b->lines[line], ui_text_buffer_line_end_(b, line));
+		b->max_width = max(b->max_width, b->line_widths[line]);
+	}
+	return b->line_widths[line];
+}
+
+// Doesn't fill the cache, for vertex workers. ui_text_editor measures the visible lines while building.
+static float ui_text_buffer_cached_line_width_(UITextBuffer *b, size_t line)
+{
+	if(b->line_widths[line] < 0.f)
+		return ui_text_buffer_measure_(b, b->lines[line], ui_text_buffer_line_end_(b, line));
+	return b->line_widths[line];
+}
+
+// Character offset on a line closest to x
+static size_t ui_text_buffer_hit_(UITextBuffer *b, size_t line, float x)
+{
+	size_t end = ui_text_buffer_line_end_(b, line);
+	float pen = 0.f;
+	for(size_t i = b->lines[line]; i < end; ++i)
+	{
+		float advance = ui_glyph_advance_(ui_ctx.default_font, ui_text_buffer_at_(b, i));
+		if(x < pen + advance * 0.5f)
+			return i;
+		pen += advance;
+	}
+	return end;
+}
+
+static void ui_text_buffer_set_caret_(UITextBuffer *b, size_t pos, bool extend)
+{
+	b->caret = pos;
+	if(!extend)
+		b->anchor = pos;
+	size_t line = ui_text_buffer_line_of_(b, pos);
+	b->desired_x = ui_text_buffer_measure_(b, b->lines[line], pos);
+}
+
+static bool ui_text_buffer_erase_selection_(UITextBuffer *b)
+{
+	if(b->anchor == b->caret)
+		return false;
+	size_t from = min(b->anchor, b->caret), to = max(b->anchor, b->caret);
+	ui_text_buffer_erase_(b, from, to);
+	ui_text_buffer_set_caret_(b, from, false);
+	return true;
+}
+
+static void ui_text_buffer_type_(UITextBuffer *b, const char *text, size_t n)
+{
+	ui_text_buffer_erase_selection_(b);
+	ui_text_buffer_insert_(b, b->caret, text, n);
+	ui_text_buffer_set_caret_(b, b->caret + n, false);
+}
+
+static void ui_text_buffer_move_line_(UITextBuffer *b, long delta, bool extend)
+{
+	size_t line = ui_text_buffer_line_of_(b, b->caret);
+	long target = (long)line + delta;
+	target = max(0, min(target, (long)b->numlines - 1));
+	b->caret = ui_text_buffer_hit_(b, (size_t)target, b->desired_x);
+	if(!extend)
+		b->anchor = b->caret;
+}
+
+static bool ui_text_editor_event_(SDL_Event *ev, bool ctrl, bool shift)
+{
+	UITextBuffer *b = ui_ctx.active_editor;
+	size_t length = ui_text_buffer_length(b);
+	switch(ev->type)
+	{
+		case SDL_TEXTINPUT:
+			if(ctrl)
+				return false;
+			ui_text_buffer_type_(b, ev->text.text, strlen(ev->text.text));
+			return true;
+		case SDL_KEYDOWN:
+		{
+			size_t line = ui_text_buffer_line_of_(b, b->caret);
+			switch(ev->key.keysym.sym)
+			{
+				case SDLK_LEFT:
+					if(b->anchor != b->caret && !shift)
+						ui_text_buffer_set_caret_(b, min(b->anchor, b->caret), false);
+					else if(b->caret > 0)
+						ui_text_buffer_set_caret_(b, b->caret - 1, shift);
+					break;
+				case SDLK_RIGHT:
+					if(b->anchor != b->caret && !shift)
+						ui_text_buffer_set_caret_(b, max(b->anchor, b->caret), false);
+					else if(b->caret < length)
+						ui_text_buffer_set_caret_(b, b->caret + 1, shift);
+					break;
+				case SDLK_UP: ui_text_buffer_move_line_(b, -1, shift); break;
+				case SDLK_DOWN: ui_text_buffer_move_line_(b, 1, shift); break;
+				case SDLK_PAGEUP: ui_text_buffer_move_line_(b, -(long)max(b->page_lines, 1), shift); break;
+				case SDLK_PAGEDOWN: ui_text_buffer_move_line_(b, (long)max(b->page_lines, 1), shift); break;
+				case SDLK_HOME: ui_text_buffer_set_caret_(b, ctrl ? 0 : b->lines[line], shift); break;
+				case SDLK_END: ui_text_buffer_set_caret_(b, ctrl ? length : ui_text_buffer_line_end_(b, line), shift); break;
+				case SDLK_BACKSPACE:
+					if(!ui_text_buffer_erase_selection_(b) && b->caret > 0)
+					{
+						ui_text_buffer_erase_(b, b->caret - 1, b->caret);
+						ui_text_buffer_set_caret_(b, b->caret - 1, false);
+					}
+					break;
+				case SDLK_DELETE:
+					if(!ui_text_buffer_erase_selection_(b) && b->caret < length)
+					{
+						ui_text_buffer_erase_(b, b->caret, b->caret + 1);
+						ui_text_buffer_set_caret_(b, b->caret, false);
+					}
+					break;
+				case SDLK_RETURN: ui_text_buffer_type_(b, "\n", 1); break;
+				case SDLK_TAB: ui_text_buffer_type_(b, "    ", 4); break;
+				case SDLK_a:
+					if(!ctrl)
+						return false;
+					b->anchor = 0;
+					ui_text_buffer_set_caret_(b, length, true);
+					break;
+				// Escape, function keys and shortcuts are left to the application
+				default:
+					return false;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+static void ui_queue_mouse_event_(SDL_Event *ev)
+{
+	UIInputEvent in;
+	memset(&in, 0, sizeof(in));
+	in.timestamp = ev->common.timestamp;
+	switch(ev->type)
+	{
+		case SDL_MOUSEMOTION:
+			in.type = k_EUIInputEventMotion;
+			in.x = ev->motion.x;
+			in.y = ev->motion.y;
+			break;
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+			// Left, Middle, Right like UIMouseState
+			if(ev->button.button < SDL_BUTTON_LEFT || ev->button.button > SDL_BUTTON_RIGHT)
+				return;
+			in.type = ev->type == SDL_MOUSEBUTTONDOWN ? k_EUIInputEventButtonDown : k_EUIInputEventButtonUp;
+			in.button = ev->button.button - SDL_BUTTON_LEFT;
+			in.x = ev->button.x;
+			in.y = ev->button.y;
+			break;
+		case SDL_MOUSEWHEEL:
+			in.type = k_EUIInputEventWheel;
+			in.wheel_x = (float)ev->wheel.x;
+			in.wheel_y = (float)ev->wheel.y;
+			break;
+	}
+	ui_ctx.input_stats.events++;
+	// Only the latest position of a run of motion matters, wheel deltas add up
+	UIInputEvent *last = ui_ctx.numinput_events > 0 ? &ui_ctx.input_queue[ui_ctx.numinput_events - 1] : NULL;
+	if(last && last->type == in.type && (in.type == k_EUIInputEventMotion || in.type == k_EUIInputEventWheel))
+	{
+		last->x = in.x;
+		last->y = in.y;
+		last->wheel_x += in.wheel_x;
+		last->wheel_y += in.wheel_y;
+		ui_ctx.input_stats.coalesced++;
+		return;
+	}
+	if(ui_ctx.numinput_events >= ui_ctx.maxinput_events)
+	{
+		ui_ctx.maxinput_events = ui_ctx.maxinput_events == 0 ? 64 : ui_ctx.maxinput_events * 2;
+		ui_ctx.input_queue = realloc(ui_ctx.input_queue, sizeof(UIInputEvent) * ui_ctx.maxinput_events);
+	}
+	ui_ctx.input_queue[ui_ctx.numinput_events++] = in;
+}
+
+// Replays the queue into the mouse state, every press is kept even if released within the same frame
+static void ui_apply_input_queue_()
+{
+	ui_ctx.numpresses = 0;
+	ui_ctx.input_timestamp = 0;
+	for(size_t i = 0; i < ui_ctx.numinput_events; ++i)
+	{
+		UIInputEvent *in = &ui_ctx.input_queue[i];
+		if(ui_ctx.input_timestamp == 0 || (int32_t)(in->timestamp - ui_ctx.input_timestamp) < 0)
+			ui_ctx.input_timestamp = in->timestamp;
+		switch(in->type)
+		{
+			case k_EUIInputEventMotion:
+				ui_ctx.mouse.x = in->x;
+				ui_ctx.mouse.y = in->y;
+				break;
+			case k_EUIInputEventButtonDown:
+				ui_ctx.mouse.buttons[in->button] = true;
+				ui_ctx.mouse.x = in->x;
+				ui_ctx.mouse.y = in->y;
+				// Widgets only take left presses, the other buttons are tracked as held state
+				if(in->button != 0)
+					break;
+				if(ui_ctx.numpresses >= ui_ctx.maxpresses)
+				{
+					ui_ctx.maxpresses = ui_ctx.maxpresses == 0 ? 8 : ui_ctx.maxpresses * 2;
+					ui_ctx.presses = realloc(ui_ctx.presses, sizeof(UIMousePress) * ui_ctx.maxpresses);
+				}
+				ui_ctx.presses[ui_ctx.numpresses++] = (UIMousePress) { in->button, in->x, in->y, in->timestamp, false };
+				break;
+			case k_EUIInputEventButtonUp:
+				ui_ctx.mouse.buttons[in->button] = false;
+				ui_ctx.mouse.x = in->x;
+				ui_ctx.mouse.y = in->y;
+				break;
+			case k_EUIInputEventWheel:
+				ui_ctx.mouse.wheel_x += in->wheel_x;
+				ui_ctx.mouse.wheel_y += in->wheel_y;
+				break;
+		}
+	}
+	ui_ctx.numinput_events = 0;
+}
+
+void ui_input_stats(UIInputStats *out_stats)
+{
+	SDL_LockMutex(ui_ctx.draw_mutex);
+	*out_stats = ui_ctx.input_stats;
+	SDL_UnlockMutex(ui_ctx.draw_mutex);
+}
+
+bool ui_event(SDL_Event *ev)
+{
+	if(SDL_GetRelativeMouseMode())
+		return false;
+	bool ctrl = ui_ctx.scan_code_state[SDL_SCANCODE_LCTRL] || ui_ctx.scan_code_state[SDL_SCANCODE_RCTRL];
+	bool shift = ui_ctx.scan_code_state[SDL_SCANCODE_LSHIFT] || ui_ctx.scan_code_state[SDL_SCANCODE_RSHIFT];
+	if(ev->type == SDL_KEYDOWN || ev->type == SDL_KEYUP)
+	{
+		ui_ctx.scan_code_state[ev->key.keysym.scancode] = ev->type == SDL_KEYDOWN;
+	}
+	if(ui_ctx.active_editor && ui_text_editor_event_(ev, ctrl, shift))
+	{
+		return true;
+	}
+	switch(ev->type)
+	{
+		case SDL_MOUSEMOTION:
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+		case SDL_MOUSEWHEEL:
+			ui_queue_mouse_event_(ev);
+			break;
+
+		case SDL_KEYUP:
+		{
+			ui_ctx.scan_code_state[ev->key.keysym.scancode] = false;
+		}
+		break;
+		case SDL_KEYDOWN:
+		{
+			ui_ctx.scan_code_state[ev->key.keysym.scancode] = true;
+			switch(ev->key.keysym.sym)
+			{
+#if 0
+				case SDLK_LEFT:
+				case SDLK_RIGHT:
+				{
+					if(ui_ctx.active_text_input)
+					{
+						size_t maxchars = ui_ctx.max_active_text_input_length;
+						size_t n = strlen(ui_ctx.active_text_input);
+						if(n > 0)
+						{
+							if(shift)
+							{
+								if(ui_input_selection_valid())
+								{
+									if(ev->key.keysym.sym == SDLK_LEFT)
+									{
+										ui_ctx.selection_end = max(ui_ctx.selection_end + 1, n);
+									}
+								}
+							}
+							else
+							{
+								if(ev->key.keysym.sym == SDLK_LEFT)
+								{
+									ui_ctx.caret_pos = max(ui_ctx.caret_pos - 1, 0);
+								}
+								else
+								{
+									ui_ctx.caret_pos = min(ui_ctx.caret_pos + 1, n);
+								}
+							}
+						}
+					}
+				}
+				break;
+#endif
+				case SDLK_BACKSPACE:
+				{
+					if(ui_ctx.active_text_input)
+					{
+						size_t maxchars = ui_ctx.max_active_text_input_length;
+						size_t n = strlen(ui_ctx.active_text_input);
+						if(n > 0)
+						{
+							if(ui_input_selection_valid())
+							{
+								ui_input_remove_selection();
+							}
+							else if(ui_ctx.caret_pos > 0)
+							{
+								size_t caret = min((size_t)ui_ctx.caret_pos, n);
+								memmove(&ui_ctx.active_text_input[caret - 1], &ui_ctx.active_text_input[caret], n + 1 - caret);
+								ui_ctx.caret_pos = caret - 1;
+							}
+						}
+					}
+				}
+				break;
+				case SDLK_RETURN:
+				{
+					if(ui_ctx.input_element.input_type != k_EUIInputElementTypeInvalid)
+					{
+						assert(ui_ctx.active_text_input);
+						ui_ctx.text_input_changed = true;
+					}
+				}
+				break;
+				#if 0
+				case SDLK_a:
+				{
+					if(ctrl && ui_ctx.active_text_input)
+					{
+						size_t maxchars = ui_ctx.max_active_text_input_length;
+						size_t n = strlen(ui_ctx.active_text_input);
+						if(n > 0)
+						{
+							ui_ctx.selection_beg = 0;
+							ui_ctx.selection_end = n;
+							ui_ctx.caret_pos = n;
+						}
+					}
+				}
+				break;
+				#endif
+			}
+		}
+		break;
+		case SDL_TEXTINPUT:
+		{
+			if(!ctrl && ui_ctx.active_text_input)
+			{
+				size_t maxchars = ui_ctx.max_active_text_input_length;
+				size_t n = strlen(ui_ctx.active_text_input);
+				if(ui_input_selection_valid())
+				{
+					ui_input_remove_selection();
+					n = strlen(ui_ctx.active_text_input);
+				}
+				// Inserted at the caret, which a click can place anywhere in the text
+				if(n + 1 < maxchars)
+				{
+					size_t caret = min((size_t)max(ui_ctx.caret_pos, 0), n);
+					size_t length = min(strlen(ev->text.text), maxchars - n - 1);
+					memmove(&ui_ctx.active_text_input[caret + length], &ui_ctx.active_text_input[caret], n + 1 - caret);
+					memcpy(&ui_ctx.active_text_input[caret], ev->text.text, length);
+					ui_ctx.caret_pos = caret + length;
+				}
+			}
+		}
+		break;
+	}
+	return true;
+}
+
+void inherit_style(UIStyle *dst, UIStyle *src)
+{
+	if(dst == src)
+	{
+		dst->hovered = dst->initial;
+		dst->active = dst->initial;
+		dst->focused = dst->initial;
+	}
+	else
+	{
+		memcpy(dst, src, sizeof(UIStyle));
+	}
+}
+#define UI_PROGRAM_BINARY_MAGIC (0x42505549u) // "UIPB"
+
+typedef struct
+{
+	const char *name;
+	const char **vertex_source;
+	const char **fragment_source;
+} UIProgramVariant;
+
+static const UIProgramVariant ui_program_variants[k_EUIProgramMax] = {
+	{ "default", &vertex_shader_source, &fragment_shader_source },
+};
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t key;
+	uint32_t format;
+	uint32_t length;
+	char driver[256]; // Compared in full, the key alone could collide
+} UIProgramBinaryHeader;
+
+static void ui_program_driver_(char *out, size_t out_size)
+{
+	snprintf(out,
+			 out_size,
+			 "%s|%s|%s",
+			 (const char *)glGetString(GL_VENDOR),
+			 (const char *)glGetString(GL_RENDERER),
+			 (const char *)glGetString(GL_VERSION));
+}
+
+static GLuint ui_program_load_binary_(const char *path, const UIProgramBinaryHeader *expected)
+{
+	FILE *fp = fopen(path, "rb");
+	if(!fp)
+		return 0;
+	UIProgramBinaryHeader header;
+	void *binary = NULL;
+	GLuint program = 0;
+	if(fread(&header, sizeof(header), 1, fp) == 1 && header.magic == expected->magic && header.key == expected->key
+	   && !strncmp(header.driver, expected->driver, sizeof(header.driver)) && header.length > 0)
+	{
+		binary = malloc(header.length);
+		if(fread(binary, 1, header.length, fp) == header.length)
+		{
+			program = glCreateProgram();
+			glProgramBinary(program, header.format, binary, (GLsizei)header.length);
+			// Drivers reject binaries from other versions at link time
+			GLint linked = 0;
+			glGetProgramiv(program, GL_LINK_STATUS, &linked);
+			if(!linked)
+			{
+				glDeleteProgram(program);
+				program = 0;
+			}
+		}
+	}
+	free(binary);
+	fclose(fp);
+	return program;
+}
+
+static void ui_program_save_binary_(const char *path, GLuint program, UIProgramBinaryHeader *header)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0)
+		return;
+	void *binary = malloc(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary);
+	header->format = format;
+	header->length = (uint32_t)length;
+	FILE *fp = fopen(path, "wb");
+	if(fp)
+	{
+		bool ok = fwrite(header, sizeof(*header), 1, fp) == 1 && fwrite(binary, 1, length, fp) == (size_t)length;
+		fclose(fp);
+		// A partial file would only fail the key check later, but don't leave it around
+		if(!ok)
+			remove(path);
+	}
+	free(binary);
+}
+
+static GLuint ui_program_compile_(GLenum type, const char *source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	GLint compiled = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if(!compiled)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("Can't compile shader: %s\n", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+// create_program links right away, a program meant for the binary cache needs
+// GL_PROGRAM_BINARY_RETRIEVABLE_HINT set before that or some drivers return no binary
+static GLuint ui_program_link_retrievable_(const char *vertex_source, const char *fragment_source)
+{
+	GLuint vs = ui_program_compile_(GL_VERTEX_SHADER, vertex_source);
+	GLuint fs = ui_program_compile_(GL_FRAGMENT_SHADER, fragment_source);
+	GLuint program = 0;
+	if(vs && fs)
+	{
+		program = glCreateProgram();
+		glAttachShader(program, vs);
+		glAttachShader(program, fs);
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(program);
+		glDetachShader(program, vs);
+		glDetachShader(program, fs);
+		GLint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if(!linked)
+		{
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+	return program;
+}
+
+// Links a program variant the first time it's needed, from the binary cache if the driver accepts it
+static GLuint ui_program_(k_EUIProgram variant)
+{
+	UIShared *shared = ui_ctx.shared;
+	if(shared->programs[variant])
+		return shared->programs[variant];
+	ui_shared_lock_();
+	if(!shared->programs[variant])
+	{
+		const UIProgramVariant *v = &ui_program_variants[variant];
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		bool cache = formats > 0 && shared->program_cache_dir[0];
+
+		UIProgramBinaryHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = UI_PROGRAM_BINARY_MAGIC;
+		ui_program_driver_(header.driver, sizeof(header.driver));
+		unsigned int key = ui_hash_string_(header.driver);
+		key = ui_id_append_(key, *v->vertex_source);
+		key = ui_id_append_(key, *v->fragment_source);
+		header.key = key;
+		char path[512];
+		snprintf(path, sizeof(path), "%s/ui_%s_%08x.bin", shared->program_cache_dir, v->name, key);
+
+		GLuint program = cache ? ui_program_load_binary_(path, &header) : 0;
+		if(!program && cache)
+		{
+			program = ui_program_link_retrievable_(*v->vertex_source, *v->fragment_source);
+			if(program)
+				ui_program_save_binary_(path, program, &header);
+		}
+		if(!program)
+		{
+			GLuint create_program(const char *path, const char *vs_source, const char *fs_source);
+			program = create_program("#ui", *v->vertex_source, *v->fragment_source);
+		}
+		if(program)
+			ui_resource_add_(k_EUIResourceProgram, program, 0);
+		shared->programs[variant] = program;
+	}
+	ui_shared_unlock_();
+	return shared->programs[variant];
+}
+
+void ui_program_cache_directory(const char *dir)
+{
+	ui_shared_lock_();
+	snprintf(ui_ctx.shared->program_cache_dir, sizeof(ui_ctx.shared->program_cache_dir), "%s", dir ? dir : "");
+	ui_shared_unlock_();
+}
+
+static UIShared *ui_create_shared_()
+{
+	UIShared *shared = calloc(1, sizeof(UIShared));
+	shared->refcount = 1;
+	shared->lock = SDL_CreateMutex();
+	shared->gl_thread = SDL_ThreadID();
+	// Font loading packs into the atlas of the context being created
+	ui_ctx.shared = shared;
+	shared->default_cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_ARROW);
+	shared->hand_cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_HAND);
+	shared->text_cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_IBEAM);
+	ui_resource_add_(k_EUIResourceCursor, (uintptr_t)shared->default_cursor, 0);
+	ui_resource_add_(k_EUIResourceCursor, (uintptr_t)shared->hand_cursor, 0);
+	ui_resource_add_(k_EUIResourceCursor, (uintptr_t)shared->text_cursor, 0);
+	ui_atlas_init_(&shared->atlas);
+	shared->default_font = ui_load_font("C:/Windows/Fonts/arial.ttf");
+	shared->image_cache.stats.budget = UI_IMAGE_CACHE_DEFAULT_BUDGET;
+	glGenTextures(1, &shared->default_image);
+	ui_resource_add_texture_(shared->default_image, 2, 2, 2 * 2 * 4);
+	glBindTexture(GL_TEXTURE_2D, shared->default_image);
+	static const unsigned char default_image_data[] = {
+		255, 0, 0, 255,
+		255, 255, 255, 255,
+		255, 255, 255, 255,
+		255, 0, 0, 255
+	};
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, default_image_data);
+	SDL_AtomicAdd(&ui_texture_generation_, 1);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	// glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	glGenTextures(1, &shared->white_texture);
+	ui_resource_add_texture_(shared->white_texture, 1, 1, 4);
+	glBindTexture(GL_TEXTURE_2D, shared->white_texture);
+	static const unsigned char image[] = { 255, 255, 255, 255 };
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+	SDL_AtomicAdd(&ui_texture_generation_, 1);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	// glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	return shared;
+}
+
+static void ui_release_shared_(UIShared *shared)
+{
+	SDL_LockMutex(shared->lock);
+	bool last = --shared->refcount == 0;
+	SDL_UnlockMutex(shared->lock);
+	if(!last)
+		return;
+	ui_image_cache_clear();
+	if(shared->default_font)
+		ui_free_font_(shared->default_font);
+	glDeleteTextures((GLsizei)shared->numretired_textures, shared->retired_textures);
+	free(shared->retired_textures);
+	ui_atlas_free_(&shared->atlas);
+	// Programs, the default textures and cursors only live in the registry, as does anything the
+	// application loaded and never unloaded
+	UIResourceRegistry *r = &shared->resources;
+	while(r->numentries > 0)
+	{
+		// Popped first, freeing a font removes its texture from the registry
+		UIResource res = r->entries[--r->numentries];
+		GLuint name = (GLuint)res.handle;
+		switch(res.type)
+		{
+			case k_EUIResourceTexture: glDeleteTextures(1, &name); break;
+			case k_EUIResourceBuffer: glDeleteBuffers(1, &name); break;
+			case k_EUIResourceVertexArray: glDeleteVertexArrays(1, &name); break;
+			case k_EUIResourceProgram: glDeleteProgram(name); break;
+			case k_EUIResourceFont: ui_free_font_((UIFont *)res.handle); break;
+			case k_EUIResourceCursor: SDL_FreeCursor((SDL_Cursor *)res.handle); break;
+			default: break;
+		}
+	}
+	free(r->entries);
+	SDL_DestroyMutex(shared->lock);
+	free(shared);
+}
+
+static void ui_init_context_(int width, int height, UIShared *share)
+{
+	if(share)
+	{
+		SDL_LockMutex(share->lock);
+		share->refcount++;
+		SDL_UnlockMutex(share->lock);
+		ui_ctx.shared = share;
+	}
+	else
+	{
+		ui_create_shared_();
+	}
+	// Handles are copied, the objects behind them are never modified after creation
+	ui_ctx.default_font = ui_ctx.shared->default_font;
+	ui_ctx.white_texture = ui_ctx.shared->white_texture;
+	ui_ctx.default_image = ui_ctx.shared->default_image;
+	ui_ctx.width = width;
+	ui_ctx.height = height;
+	ui_ctx.draw_list = &ui_ctx.draw_lists[0];
+	ui_ctx.published_list = -1;
+	ui_ctx.submitting_list = -1;
+	ui_ctx.draw_mutex = SDL_CreateMutex();
+	ui_ctx.draw_cond = SDL_CreateCond();
+
+	{
+		UIStyleProps *style = &ui_ctx.styles[k_EUIStyleSelectorDefault].initial;
+		style->background_color[0] = 1.f;
+		style->background_color[1] = 1.f;
+		style->background_color[2] = 1.f;
+		style->background_color[3] = 0.f;
+		style->text_color[0] = 0.f;
+		style->text_color[1] = 0.f;
+		style->text_color[2] = 0.f;
+		style->text_color[3] = 1.f;
+		style->border_color[0] = 0.f;
+		style->border_color[1] = 0.f;
+		style->border_color[2] = 0.f;
+		style->border_color[3] = 0.f;
+		style->margin = 5.f;
+		style->padding_y = 2.5f;
+		style->padding_x = 10.f;
+		style->border_thickness = 1.f;
+		ui_ctx.styles[k_EUIStyleSelectorDefault].hovered = ui_ctx.styles[k_EUIStyleSelectorDefault].initial;
+		ui_ctx.styles[k_EUIStyleSelectorDefault].active = ui_ctx.styles[k_EUIStyleSelectorDefault].initial;
+		ui_ctx.styles[k_EUIStyleSelectorDefault].focused = ui_ctx.styles[k_EUIStyleSelectorDefault].initial;
+		for(size_t i = 1; i < k_EUIStyleSelectorMax; ++i)
+		{
+			ui_ctx.styles[i] = ui_ctx.styles[k_EUIStyleSelectorDefault];
+		}
+	}
+
+	{
+		UIStyleProps *style = &ui_ctx.styles[k_EUIStyleSelectorInput].initial;
+		style->background_color[3] = 1.f;
+		style->border_color[0] = 143.f / 255.f;
+		style->border_color[1] = 143.f / 255.f;
+		style->border_color[2] = 157.f / 255.f;
+		style->border_color[3] = 1.f;
+		style->background_color[0] = 233.f / 255.f;
+		style->background_color[1] = 233.f / 255.f;
+		style->background_color[2] = 237.f / 255.f;
+		style->background_color[3] = 1.f;
+		style->text_color[0] = 0.f;
+		style->text_color[1] = 0.f;
+		style->text_color[2] = 0.f;
+		style->text_color[3] = 1.f;
+		ui_ctx.styles[k_EUIStyleSelectorInput].hovered = ui_ctx.styles[k_EUIStyleSelectorInput].initial;
+		ui_ctx.styles[k_EUIStyleSelectorInput].active = ui_ctx.styles[k_EUIStyleSelectorInput].initial;
+		ui_ctx.styles[k_EUIStyleSelectorInput].focused = ui_ctx.styles[k_EUIStyleSelectorInput].initial;
+	}
+	{
+		UIStyleProps *style = &ui_ctx.styles[k_EUIStyleSelectorInput].hovered;
+		style->background_color[0] = 180.f / 255.f;
+		style->background_color[1] = 180.f / 255.f;
+		style->background_color[2] = 184.f / 255.f;
+	}
+	{
+		UIStyleProps *style = &ui_ctx.styles[k_EUIStyleSelectorInput].focused;
+		style->border_color[0] = 0.f;
+		style->border_color[1] = 0.f;
+		style->border_color[2] = 1.f;
+	}
+}
+
+static void ui_vertex_pool_destroy_(struct UIVertexPool_s *pool);
+
+UIContext *ui_create_context(int width, int height, UIContext *share)
+{
+	UIContext *prev = ui_current_ctx_;
+	UIContext *ctx = calloc(1, sizeof(UIContext));
+	ui_current_ctx_ = ctx;
+	ui_init_context_(width, height, share ? share->shared : NULL);
+	ui_current_ctx_ = prev;
+	return ctx;
+}
+
+void ui_destroy_context(UIContext *ctx)
+{
+	UIContext *prev = ui_current_ctx_;
+	ui_current_ctx_ = ctx;
+	ui_state_clear_();
+	if(ui_ctx.list_unsubmitted)
+	{
+		ui_shared_lock_();
+		ui_ctx.shared->unsubmitted_lists--;
+		ui_shared_unlock_();
+	}
+	for(int i = 0; i < 2; ++i)
+	{
+		free(ui_ctx.draw_lists[i].vertices);
+		free(ui_ctx.draw_lists[i].commands);
+		free(ui_ctx.draw_lists[i].tiled_images);
+	}
+	SDL_DestroyCond(ui_ctx.draw_cond);
+	SDL_DestroyMutex(ui_ctx.draw_mutex);
+	if(ui_ctx.vertex_pool)
+		ui_vertex_pool_destroy_(ui_ctx.vertex_pool);
+	free(ui_ctx.layout_items);
+	free(ui_ctx.transforms);
+	free(ui_ctx.number_cache);
+	free(ui_ctx.text_arena);
+	free(ui_ctx.width_arena);
+	free(ui_ctx.style_table);
+	free(ui_ctx.style_buckets);
+	free(ui_ctx.input_queue);
+	free(ui_ctx.presses);
+	free(ui_ctx.elements);
+	if(ui_ctx.vao)
+	{
+		ui_resource_remove_(k_EUIResourceVertexArray, ui_ctx.vao);
+		glDeleteVertexArrays(1, &ui_ctx.vao);
+	}
+	if(ui_ctx.vbo)
+	{
+		ui_resource_remove_(k_EUIResourceBuffer, ui_ctx.vbo);
+		glDeleteBuffers(1, &ui_ctx.vbo);
+	}
+	ui_release_shared_(ui_ctx.shared);
+	free(ctx);
+	ui_current_ctx_ = prev == ctx ? NULL : prev;
+}
+
+void ui_resource_stats(UIResourceStats *out_stats)
+{
+	memset(out_stats, 0, sizeof(UIResourceStats));
+	ui_shared_lock_();
+	UIResourceRegistry *r = &ui_ctx.shared->resources;
+	for(size_t i = 0; i < r->numentries; ++i)
+	{
+		out_stats->count[r->entries[i].type]++;
+		out_stats->bytes[r->entries[i].type] += r->entries[i].bytes;
+	}
+	out_stats->atlas_bytes = ui_ctx.shared->atlas.numpages * UI_ATLAS_PAGE_SIZE * UI_ATLAS_PAGE_SIZE * 4;
+	ui_shared_unlock_();
+
+	size_t bytes = sizeof(UIContext) + sizeof(UIElement) * ui_ctx.maxelements;
+	for(int i = 0; i < 2; ++i)
+	{
+		UIDrawList *dl = &ui_ctx.draw_lists[i];
+		bytes += sizeof(UIGLVertex) * dl->maxvertices + sizeof(UIDrawCommand) * dl->maxcommands;
+		bytes += sizeof(UITiledImage *) * dl->maxtiled_images;
+	}
+	bytes += sizeof(UIAffine) * ui_ctx.maxtransforms;
+	bytes += ui_ctx.text_arena_capacity + sizeof(float) * ui_ctx.width_arena_capacity;
+	bytes += sizeof(UILayoutItem) * ui_ctx.maxlayout_items;
+	bytes += sizeof(UIResolvedStyle) * ui_ctx.maxstyles + sizeof(uint32_t) * ui_ctx.numstyle_buckets;
+	bytes += sizeof(UIInputEvent) * ui_ctx.maxinput_events + sizeof(UIMousePress) * ui_ctx.maxpresses;
+	if(ui_ctx.number_cache)
+		bytes += sizeof(UINumberCacheEntry) * UI_NUMBER_CACHE_SIZE;
+	UIStateStore *store = &ui_ctx.state_store;
+	bytes += sizeof(UIStateEntry *) * store->numbuckets;
+	for(size_t i = 0; i < store->numbuckets; ++i)
+	{
+		for(UIStateEntry *it = store->buckets[i]; it; it = it->next)
+			bytes += sizeof(UIStateEntry) + it->size;
+	}
+	out_stats->context_bytes = bytes;
+}
+
+void ui_set_context(UIContext *ctx)
+{
+	ui_current_ctx_ = ctx;
+}
+
+UIContext *ui_get_context()
+{
+	return ui_current_ctx_;
+}
+
+bool ui_init(int width, int height)
+{
+	ui_default_ctx_ = ui_create_context(width, height, NULL);
+	ui_set_context(ui_default_ctx_);
+	return true;
+}
+
+void ui_inherit_style(int style, UIStyle *out_style)
+{
+	*out_style = ui_ctx.styles[style];
+}
+void ui_default_style(UIStyle *out_style)
+{
+	*out_style = ui_ctx.styles[k_EUIStyleSelectorDefault];
+}
+void ui_save_style(UIStyle *style)
+{
+	//*style = ui_ctx.custom_style;
+	//ui_ctx.style = &ui_ctx.custom_style;
+	ui_ctx.custom_style = *style;
+	ui_ctx.style = style;
+}
+void ui_restore_style(UIStyle *style)
+{
+	//ui_ctx.custom_style = *style;
+	*style = ui_ctx.custom_style;
+	ui_ctx.style = NULL;
+}
+
+
+static void ui_pack_color_(const float *color, unsigned char *out)
+{
+	for(int i = 0; i < 4; ++i)
+	{
+		float c = color[i] < 0.f ? 0.f : (color[i] > 1.f ? 1.f : color[i]);
+		out[i] = (unsigned char)(c * 255.f + 0.5f);
+	}
+}
+
+static void ui_style_table_reset_()
+{
+	ui_ctx.numstyles = 0;
+	if(ui_ctx.style_buckets)
+		memset(ui_ctx.style_buckets, 0, sizeof(uint32_t) * ui_ctx.numstyle_buckets);
+	memset(ui_ctx.style_memo, 0, sizeof(ui_ctx.style_memo));
+	static const UIStyleProps empty;
+	uint16_t ui_intern_style_(const UIStyleProps *props);
+	ui_intern_style_(&empty);
+}
+
+static void ui_style_table_rehash_(size_t numbuckets)
+{
+	free(ui_ctx.style_buckets);
+	ui_ctx.style_buckets = calloc(numbuckets, sizeof(uint32_t));
+	ui_ctx.numstyle_buckets = numbuckets;
+	for(size_t i = 0; i < ui_ctx.numstyles; ++i)
+	{
+		size_t b = ui_hash_bytes_(2166136261u, &ui_ctx.style_table[i], sizeof(UIResolvedStyle)) & (numbuckets - 1);
+		while(ui_ctx.style_buckets[b])
+			b = (b + 1) & (numbuckets - 1);
+		ui_ctx.style_buckets[b] = (uint32_t)i + 1;
+	}
+}
+
+// Width and height are per element and not part of the interned style
+uint16_t ui_intern_style_(const UIStyleProps *props)
+{
+	UIStyleMemo *memo = &ui_ctx.style_memo[((uintptr_t)props >> 3) & (UI_STYLE_MEMO_SIZE - 1)];
+	if(memo->valid && memo->src == props && !memcmp(&memo->props, props, sizeof(UIStyleProps)))
+		return memo->index;
+
+	UIResolvedStyle rs;
+	memset(&rs, 0, sizeof(rs)); // Hashed and compared as bytes
+	rs.border_thickness = props->border_thickness;
+	rs.margin = props->margin;
+	rs.max_width = props->max_width;
+	rs.max_height = props->max_height;
+	rs.padding_x = props->padding_x;
+	rs.padding_y = props->padding_y;
+	ui_pack_color_(props->border_color, rs.border_color);
+	ui_pack_color_(props->background_color, rs.background_color);
+	ui_pack_color_(props->text_color, rs.text_color);
+
+	if((ui_ctx.numstyles + 1) * 2 > ui_ctx.numstyle_buckets)
+		ui_style_table_rehash_(ui_ctx.numstyle_buckets == 0 ? 64 : ui_ctx.numstyle_buckets * 2);
+	size_t mask = ui_ctx.numstyle_buckets - 1;
+	size_t b = ui_hash_bytes_(2166136261u, &rs, sizeof(rs)) & mask;
+	uint16_t index = 0;
+	for(;; b = (b + 1) & mask)
+	{
+		uint32_t slot = ui_ctx.style_buckets[b];
+		if(slot == 0)
+		{
+			// Out of indices until the table is reset next frame, falls back to the empty style
+			if(ui_ctx.numstyles >= UI_MAX_STYLES)
+				return 0;
+			if(ui_ctx.numstyles >= ui_ctx.maxstyles)
+			{
+				ui_ctx.maxstyles = ui_ctx.maxstyles == 0 ? 64 : ui_ctx.maxstyles * 2;
+				ui_ctx.style_table = realloc(ui_ctx.style_table, sizeof(UIResolvedStyle) * ui_ctx.maxstyles);
+			}
+			index = (uint16_t)ui_ctx.numstyles;
+			ui_ctx.style_table[ui_ctx.numstyles++] = rs;
+			ui_ctx.style_buckets[b] = (uint32_t)index + 1;
+			break;
+		}
+		if(!memcmp(&ui_ctx.style_table[slot - 1], &rs, sizeof(rs)))
+		{
+			index = (uint16_t)(slot - 1);
+			break;
+		}
+	}
+	memo->src = props;
+	memo->props = *props;
+	memo->index = index;
+	memo->valid = true;
+	return index;
+}
+
+static const UIResolvedStyle *ui_element_style_props_(const UIElement *e)
+{
+	return &ui_ctx.style_table[e->style];
+}
+
+static UIGLVertex *ui_draw_list_alloc_(UIDrawList *dl, GLuint texture, size_t n)
+{
+	if(dl->numvertices + n > dl->maxvertices)
+	{
+		size_t max = dl->maxvertices == 0 ? 1024 : dl->maxvertices * 2;
+		while(max < dl->numvertices + n)
+			max *= 2;
+		dl->vertices = realloc(dl->vertices, sizeof(UIGLVertex) * max);
+		dl->maxvertices = max;
+	}
+	UIDrawCommand *cmd = dl->numcommands > 0 ? &dl->commands[dl->numcommands - 1] : NULL;
+	if(!cmd || dl->sealed || cmd->texture != texture || cmd->clipped != dl->clipped
+	   || (dl->clipped && memcmp(&cmd->clip, &dl->clip, sizeof(UIRectangle))))
+	{
+		if(dl->numcommands >= dl->maxcommands)
+		{
+			dl->maxcommands = dl->maxcommands == 0 ? 64 : dl->maxcommands * 2;
+			dl->commands = realloc(dl->commands, sizeof(UIDrawCommand) * dl->maxcommands);
+		}
+		cmd = &dl->commands[dl->numcommands++];
+		dl->sealed = false;
+		cmd->texture = texture;
+		cmd->first = dl->numvertices;
+		cmd->count = 0;
+		cmd->clip = dl->clip;
+		cmd->clipped = dl->clipped;
+	}
+	cmd->count += n;
+	UIGLVertex *v = &dl->vertices[dl->numvertices];
+	dl->numvertices += n;
+	return v;
+}
+
+static void ui_draw_list_reset_(UIDrawList *dl)
+{
+	dl->numvertices = 0;
+	dl->numcommands = 0;
+	dl->numtiled_images = 0;
+	dl->clipped = false;
+	dl->sealed = false;
+	dl->width = ui_ctx.width;
+	dl->height = ui_ctx.height;
+	dl->frame = ui_ctx.frame;
+	dl->input_timestamp = ui_ctx.input_timestamp;
+}
+
+static void ui_draw_list_clip_(UIDrawList *dl, const UIRectangle *clip)
+{
+	dl->clipped = clip != NULL;
+	if(clip)
+		dl->clip = *clip;
+}
+
+static void ui_draw_rect_(float x0,
+						  float y0,
+						  float x1,
+						  float y1,
+						  float s0,
+						  float t0,
+						  float s1,
+						  float t1,
+						  const unsigned char *color,
+						  GLuint texture)
+{
+	UIGLVertex *v = ui_draw_list_alloc_(ui_draw_target_(), texture, 6);
+	// GL_QUADS is not available in GLES/core profiles, two triangles per rectangle
+	UIGLVertex quad[] = { { { x0, y0 }, { s0, t0 } }, { { x1, y0 }, { s1, t0 } }, { { x0, y1 }, { s0, t1 } },
+						  { { x1, y0 }, { s1, t0 } }, { { x1, y1 }, { s1, t1 } }, { { x0, y1 }, { s0, t1 } } };
+	for(int i = 0; i < 6; ++i)
+	{
+		v[i] = quad[i];
+		memcpy(v[i].color, color, 4);
+	}
+}
+
+#define UI_GLYPH_RUN_CHUNK (256)
+
+static void ui_glyph_quad_(UIGLVertex *v, float x0, float y0, float x1, float y1, float s0, float t0, float s1, float t1, uint32_t color)
+{
+	UIGLVertex quad[] = { { { x0, y0 }, { s0, t0 } }, { { x1, y0 }, { s1, t0 } }, { { x0, y1 }, { s0, t1 } },
+						  { { x1, y0 }, { s1, t0 } }, { { x1, y1 }, { s1, t1 } }, { { x0, y1 }, { s0, t1 } } };
+	for(int i = 0; i < 6; ++i)
+	{
+		v[i] = quad[i];
+		memcpy(v[i].color, &color, 4);
+	}
+}
+
+#ifdef UI_SSE2
+static inline __m128 ui_floor_ps_(__m128 v)
+{
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.f)));
+}
+
+// Position and texcoord are adjacent in UIGLVertex, one unaligned store writes both
+static inline void ui_glyph_vertices_sse_(UIGLVertex *v, __m128 p00, __m128 p10, __m128 p01, __m128 p11, uint32_t color)
+{
+	_mm_storeu_ps(v[0].position, p00);
+	_mm_storeu_ps(v[1].position, p10);
+	_mm_storeu_ps(v[2].position, p01);
+	_mm_storeu_ps(v[3].position, p10);
+	_mm_storeu_ps(v[4].position, p11);
+	_mm_storeu_ps(v[5].position, p01);
+	for(int i = 0; i < 6; ++i)
+		memcpy(v[i].color, &color, 4);
+}
+#endif
+
+// Glyph indices (character - 32) to quads, written straight into the draw list. The pen positions are a
+// prefix sum of the advances, so four glyphs are placed per step with SSE2.
+static void ui_emit_glyph_run_(UIFont *font, const unsigned char *glyphs, size_t n, float *x, float y, const unsigned char *color)
+{
+	if(n == 0)
+		return;
+	const UIGlyphTable *t = &font->glyphs;
+	UIGLVertex *v = ui_draw_list_alloc_(ui_draw_target_(), font->gl_texture, n * 6);
+	uint32_t rgba;
+	memcpy(&rgba, color, 4);
+	float pen = *x;
+	size_t i = 0;
+#ifdef UI_SSE2
+	__m128 base = _mm_set1_ps(pen), yy = _mm_set1_ps(y);
+	for(; i + 4 <= n; i += 4, v += 24)
+	{
+		const unsigned char *g = glyphs + i;
+#define UI_GATHER_(a) _mm_setr_ps(t->a[g[0]], t->a[g[1]], t->a[g[2]], t->a[g[3]])
+		__m128 adv = UI_GATHER_(advance);
+		__m128 sum = _mm_add_ps(adv, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(adv), 4)));
+		sum = _mm_add_ps(sum, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(sum), 8)));
+		__m128 x0 = ui_floor_ps_(_mm_add_ps(_mm_add_ps(base, _mm_sub_ps(sum, adv)), UI_GATHER_(xoff)));
+		__m128 y0 = ui_floor_ps_(_mm_add_ps(yy, UI_GATHER_(yoff)));
+		__m128 x1 = _mm_add_ps(x0, UI_GATHER_(width));
+		__m128 y1 = _mm_add_ps(y0, UI_GATHER_(height));
+		__m128 s0 = UI_GATHER_(s0), t0 = UI_GATHER_(t0), s1 = UI_GATHER_(s1), t1 = UI_GATHER_(t1);
+#undef UI_GATHER_
+		base = _mm_add_ps(base, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 3, 3)));
+
+		// Interleave to one (x, y, s, t) vector per corner, glyphs 0/1 from the low halves and 2/3 from the high
+		__m128 pos[4][2] = { { _mm_unpacklo_ps(x0, y0), _mm_unpackhi_ps(x0, y0) },
+							 { _mm_unpacklo_ps(x1, y0), _mm_unpackhi_ps(x1, y0) },
+							 { _mm_unpacklo_ps(x0, y1), _mm_unpackhi_ps(x0, y1) },
+							 { _mm_unpacklo_ps(x1, y1), _mm_unpackhi_ps(x1, y1) } };
+		__m128 uv[4][2] = { { _mm_unpacklo_ps(s0, t0), _mm_unpackhi_ps(s0, t0) },
+							{ _mm_unpacklo_ps(s1, t0), _mm_unpackhi_ps(s1, t0) },
+							{ _mm_unpacklo_ps(s0, t1), _mm_unpackhi_ps(s0, t1) },
+							{ _mm_unpacklo_ps(s1, t1), _mm_unpackhi_ps(s1, t1) } };
+		for(int k = 0; k < 2; ++k)
+		{
+			ui_glyph_vertices_sse_(v + k * 12,
+								   _mm_movelh_ps(pos[0][k], uv[0][k]),
+								   _mm_movelh_ps(pos[1][k], uv[1][k]),
+								   _mm_movelh_ps(pos[2][k], uv[2][k]),
+								   _mm_movelh_ps(pos[3][k], uv[3][k]),
+								   rgba);
+			ui_glyph_vertices_sse_(v + k * 12 + 6,
+								   _mm_movehl_ps(uv[0][k], pos[0][k]),
+								   _mm_movehl_ps(uv[1][k], pos[1][k]),
+								   _mm_movehl_ps(uv[2][k], pos[2][k]),
+								   _mm_movehl_ps(uv[3][k], pos[3][k]),
+								   rgba);
+		}
+	}
+	pen = _mm_cvtss_f32(base);
+#endif
+	for(; i < n; ++i, v += 6)
+	{
+		unsigned char g = glyphs[i];
+		float x0 = floorf(pen + t->xoff[g]), y0 = floorf(y + t->yoff[g]);
+		ui_glyph_quad_(v, x0, y0, x0 + t->width[g], y0 + t->height[g], t->s0[g], t->t0[g], t->s1[g], t->t1[g], rgba);
+		pen += t->advance[g];
+	}
+	*x = pen;
+}
+
+static void ui_render_text_run_(UIFont *font, float *x, float y, const char *text, size_t length, const unsigned char *color)
+{
+	unsigned char glyphs[UI_GLYPH_RUN_CHUNK];
+	const char *end = text + length;
+	while(text < end)
+	{
+		size_t n = 0;
+		for(; text < end && n < UI_GLYPH_RUN_CHUNK; ++text)
+		{
+			unsigned char g = (unsigned char)*text - 32;
+			if(g < 96)
+				glyphs[n++] = g;
+		}
+		ui_emit_glyph_run_(font, glyphs, n, x, y, color);
+	}
+}
+
+// Every character renders, labels and input values are fitted with ui_render_label_ and ui_render_value_
+static bool ui_render_text_rgba_(UIFont *font, float *x, float *y, const char *text, const unsigned char *color)
+{
+	ui_render_text_run_(font, x, *y, text, strlen(text), color);
+	return false;
+}
+
+// Cuts the label at the last character that leaves room for an ellipsis when it is wider than max_width
+static void ui_render_label_(UIFont *font, float *x, float y, float max_width, const UIElement *e, const unsigned char *color)
+{
+	const char *text = ui_element_label_(e);
+	const float *widths = ui_element_label_widths_(e);
+	if(max_width <= 0.f || widths[e->label_length] <= max_width)
+	{
+		ui_render_text_run_(font, x, y, text, e->label_length, color);
+		return;
+	}
+	float ellipsis = font->glyphs.advance['.' - 32] * 3.f;
+	size_t n = ui_text_fit_(widths, e->label_length, max_width - ellipsis);
+	ui_render_text_run_(font, x, y, text, n, color);
+	ui_render_text_run_(font, x, y, "...", 3, color);
+}
+
+bool ui_render_text_(UIFont *font, float *x, float *y, const char *text, const float *textcolor)
+{
+	unsigned char color[4];
+	ui_pack_color_(textcolor, color);
+	return ui_render_text_rgba_(font, x, y, text, color);
+}
+
+// Any left button press this frame, consumed or not
+bool ui_clicked()
+{
+	for(size_t i = 0; i < ui_ctx.numpresses; ++i)
+	{
+		if(ui_ctx.presses[i].button == 0)
+			return true;
+	}
+	return false;
+}
+
+static const UIMousePress *ui_first_press_(int button)
+{
+	for(size_t i = 0; i < ui_ctx.numpresses; ++i)
+	{
+		if(ui_ctx.presses[i].button == button)
+			return &ui_ctx.presses[i];
+	}
+	return NULL;
+}
+
+/*
+bool ui_hovering_element()
+{
+	return false;
+}*/
+static void ui_affine_apply_(const float *m, float x, float y, float *out_x, float *out_y)
+{
+	*out_x = m[0] * x + m[2] * y + m[4];
+	*out_y = m[1] * x + m[3] * y + m[5];
+}
+
+static void ui_affine_multiply_(const float *a, const float *b, float *out)
+{
+	float r[6];
+	r[0] = a[0] * b[0] + a[2] * b[1];
+	r[1] = a[1] * b[0] + a[3] * b[1];
+	r[2] = a[0] * b[2] + a[2] * b[3];
+	r[3] = a[1] * b[2] + a[3] * b[3];
+	r[4] = a[0] * b[4] + a[2] * b[5] + a[4];
+	r[5] = a[1] * b[4] + a[3] * b[5] + a[5];
+	memcpy(out, r, sizeof(r));
+}
+
+static void ui_affine_invert_(const float *m, float *out)
+{
+	float det = m[0] * m[3] - m[1] * m[2];
+	float inv = fabsf(det) > FLT_EPSILON ? 1.f / det : 0.f;
+	out[0] = m[3] * inv;
+	out[1] = -m[1] * inv;
+	out[2] = -m[2] * inv;
+	out[3] = m[0] * inv;
+	out[4] = -(out[0] * m[4] + out[2] * m[5]);
+	out[5] = -(out[1] * m[4] + out[3] * m[5]);
+}
+
+// Axis aligned bounds of a transformed rectangle
+static void ui_affine_bounds_(const float *m, const UIRectangle *r, UIRectangle *out)
+{
+	float xs[4], ys[4];
+	ui_affine_apply_(m, r->x, r->y, &xs[0], &ys[0]);
+	ui_affine_apply_(m, r->x + r->w, r->y, &xs[1], &ys[1]);
+	ui_affine_apply_(m, r->x, r->y + r->h, &xs[2], &ys[2]);
+	ui_affine_apply_(m, r->x + r->w, r->y + r->h, &xs[3], &ys[3]);
+	float x0 = xs[0], x1 = xs[0], y0 = ys[0], y1 = ys[0];
+	for(int i = 1; i < 4; ++i)
+	{
+		x0 = min(x0, xs[i]);
+		x1 = max(x1, xs[i]);
+		y0 = min(y0, ys[i]);
+		y1 = max(y1, ys[i]);
+	}
+	out->x = x0;
+	out->y = y0;
+	out->w = x1 - x0;
+	out->h = y1 - y0;
+}
+
+// Composes m with the current transform, NULL pushes the identity as transform 0 at the start of a frame
+static void ui_push_affine_(const float *m)
+{
+	assert(ui_ctx.transform_depth < UI_MAX_TRANSFORM_DEPTH);
+	if(ui_ctx.numtransforms >= ui_ctx.maxtransforms)
+	{
+		ui_ctx.maxtransforms = ui_ctx.maxtransforms == 0 ? 16 : ui_ctx.maxtransforms * 2;
+		ui_ctx.transforms = realloc(ui_ctx.transforms, sizeof(UIAffine) * ui_ctx.maxtransforms);
+	}
+	UIAffine *t = &ui_ctx.transforms[ui_ctx.numtransforms];
+	static const float identity[] = { 1.f, 0.f, 0.f, 1.f, 0.f, 0.f };
+	if(!m)
+	{
+		memcpy(t->m, identity, sizeof(identity));
+		memcpy(t->inverse, identity, sizeof(identity));
+		ui_ctx.numtransforms++;
+		return;
+	}
+	ui_affine_multiply_(ui_ctx.transforms[ui_current_transform_()].m, m, t->m);
+	ui_affine_invert_(t->m, t->inverse);
+	ui_ctx.transform_stack[ui_ctx.transform_depth++] = (int)ui_ctx.numtransforms++;
+}
+
+void ui_push_transform(const UITransform *transform)
+{
+	// Rotation and scale pivot around the cursor, so a subtree scales in place
+	float sx = transform->scale[0] != 0.f ? transform->scale[0] : 1.f;
+	float sy = transform->scale[1] != 0.f ? transform->scale[1] : 1.f;
+	float c = cosf(transform->rotation), s = sinf(transform->rotation);
+	float px = ui_ctx.x, py = ui_ctx.y;
+	float m[6] = { c * sx, s * sx, -s * sy, c * sy, 0.f, 0.f };
+	m[4] = px + transform->translation[0] - (m[0] * px + m[2] * py);
+	m[5] = py + transform->translation[1] - (m[1] * px + m[3] * py);
+	ui_push_affine_(m);
+}
+
+void ui_pop_transform()
+{
+	assert(ui_ctx.transform_depth > 0);
+	ui_ctx.transform_depth--;
+}
+
+// Transforms positions in place, a batch shares one matrix
+static void ui_transform_vertices_(UIGLVertex *v, size_t n, const float *m)
+{
+	size_t i = 0;
+#ifdef UI_SSE2
+	// Two vertices per iteration, lanes are x0 y0 x1 y1
+	__m128 ab = _mm_setr_ps(m[0], m[1], m[0], m[1]);
+	__m128 cd = _mm_setr_ps(m[2], m[3], m[2], m[3]);
+	__m128 ef = _mm_setr_ps(m[4], m[5], m[4], m[5]);
+	for(; i + 2 <= n; i += 2)
+	{
+		__m128 p = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)v[i].position);
+		p = _mm_loadh_pi(p, (const __m64 *)v[i + 1].position);
+		__m128 xx = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 0, 0));
+		__m128 yy = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 1, 1));
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ab, xx), _mm_mul_ps(cd, yy)), ef);
+		_mm_storel_pi((__m64 *)v[i].position, r);
+		_mm_storeh_pi((__m64 *)v[i + 1].position, r);
+	}
+#endif
+	for(; i < n; ++i)
+	{
+		ui_affine_apply_(m, v[i].position[0], v[i].position[1], &v[i].position[0], &v[i].position[1]);
+	}
+}
+
+static bool ui_point_test_rectangle_(const UIRectangle *rect, int transform, float px, float py)
+{
+	float x = px, y = py;
+	if(transform != 0)
+		ui_affine_apply_(ui_ctx.transforms[transform].inverse, px, py, &x, &y);
+	return (x >= rect->x && x <= rect->x + rect->w) && (y >= rect->y && y <= rect->y + rect->h);
+}
+
+static bool ui_mouse_test_rectangle_ex_(const UIRectangle *rect, int transform)
+{
+	return ui_point_test_rectangle_(rect, transform, (float)ui_ctx.mouse.x, (float)ui_ctx.mouse.y);
+}
+
+// The mouse is mapped into the space of the current transform
+bool ui_mouse_test_rectangle(UIRectangle *rect)
+{
+	return ui_mouse_test_rectangle_ex_(rect, ui_current_transform_());
+}
+
+// Hidden parts of elements inside a pane can't be hovered
+static bool ui_element_hovered_(UIElement *e)
+{
+	if(e->culled)
+		return false;
+	return ui_mouse_test_rectangle_ex_(&e->rect, e->transform)
+		   && (!e->clipped || ui_mouse_test_rectangle_ex_(&e->clip, e->clip_transform));
+}
+
+static bool ui_element_hit_(UIElement *e, const UIMousePress *press)
+{
+	if(e->culled)
+		return false;
+	return ui_point_test_rectangle_(&e->rect, e->transform, (float)press->x, (float)press->y)
+		   && (!e->clipped || ui_point_test_rectangle_(&e->clip, e->clip_transform, (float)press->x, (float)press->y));
+}
+
+// First left press of this frame that landed on the element
+static const UIMousePress *ui_element_press_(UIElement *e)
+{
+	for(size_t i = 0; i < ui_ctx.numpresses; ++i)
+	{
+		if(ui_ctx.presses[i].button == 0 && ui_element_hit_(e, &ui_ctx.presses[i]))
+			return &ui_ctx.presses[i];
+	}
+	return NULL;
+}
+
+static bool ui_element_pressed_(UIElement *e)
+{
+	return ui_element_press_(e) != NULL;
+}
+
+// Takes the oldest unconsumed left press on the element, so every click is delivered exactly once
+static bool ui_element_take_click_(UIElement *e)
+{
+	for(size_t i = 0; i < ui_ctx.numpresses; ++i)
+	{
+		UIMousePress *press = &ui_ctx.presses[i];
+		if(press->button == 0 && !press->consumed && ui_element_hit_(e, press))
+		{
+			press->consumed = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Character boundary of the input's value nearest to the press
+static int ui_input_caret_from_press_(UIElement *e, const UIMousePress *press)
+{
+	const UIInputElement *input = &e->u.input;
+	if(!input->value_measured)
+		return 0;
+	const UIResolvedStyle *props = ui_element_style_props_(e);
+	const float *advance = ui_ctx.default_font->glyphs.advance;
+	float x = (float)press->x, y = (float)press->y;
+	if(e->transform != 0)
+		ui_affine_apply_(ui_ctx.transforms[e->transform].inverse, x, y, &x, &y);
+	float value_x = e->rect.x + props->border_thickness + props->padding_x / 2.f + props->margin / 2.f
+					+ ui_element_label_width_(e) + advance[':' - 32] + advance[' ' - 32];
+	return (int)ui_text_hit_(&ui_ctx.width_arena[input->value_widths], input->value_length, x - value_x);
+}
+
+// Width of the first index characters of the displayed value
+static float ui_input_value_offset_(const UIElement *e, const char *text, int index)
+{
+	const UIInputElement *input = &e->u.input;
+	if(input->value_measured)
+		return ui_ctx.width_arena[input->value_widths + min((size_t)index, input->value_length)];
+	float width = 0.f;
+	ui_font_measure_text(ui_ctx.default_font, text, text + min((size_t)index, strlen(text)), &width, NULL);
+	return width;
+}
+
+static float ui_input_value_width_(const UIElement *e, const char *text)
+{
+	return ui_input_value_offset_(e, text, (int)strlen(text));
+}
+
+// Cuts an input value at the last character that ends within max_width
+static void ui_render_value_(UIFont *font, float *x, float y, float max_width, const UIElement *e, const char *text, const unsigned char *color)
+{
+	const UIInputElement *input = &e->u.input;
+	size_t length = strlen(text), n = 0;
+	if(input->value_measured)
+	{
+		n = ui_text_fit_(&ui_ctx.width_arena[input->value_widths], min(length, input->value_length), max_width);
+	}
+	else
+	{
+		for(float width = 0.f; n < length; ++n)
+		{
+			unsigned char g = (unsigned char)text[n] - 32;
+			width += g < 96 ? font->glyphs.advance[g] : 0.f;
+			if(width > max_width)
+				break;
+		}
+	}
+	ui_render_text_run_(font, x, y, text, n, color);
+}
+
+static bool ui_rectangle_intersect_(const UIRectangle *a, const UIRectangle *b, UIRectangle *out)
+{
+	float x0 = max(a->x, b->x), y0 = max(a->y, b->y);
+	float x1 = min(a->x + a->w, b->x + b->w), y1 = min(a->y + a->h, b->y + b->h);
+	if(out)
+	{
+		out->x = x0;
+		out->y = y0;
+		out->w = max(0.f, x1 - x0);
+		out->h = max(0.f, y1 - y0);
+	}
+	return x0 < x1 && y0 < y1;
+}
+
+static void ui_element_cull_(UIElement *e)
+{
+	if(e->transform == e->clip_transform)
+	{
+		e->culled = !ui_rectangle_intersect_(&e->rect, &e->clip, NULL);
+		return;
+	}
+	// Different spaces, compare screen space bounds
+	UIRectangle rect, clip;
+	ui_affine_bounds_(ui_ctx.transforms[e->transform].m, &e->rect, &rect);
+	ui_affine_bounds_(ui_ctx.transforms[e->clip_transform].m, &e->clip, &clip);
+	e->culled = !ui_rectangle_intersect_(&rect, &clip, NULL);
+}
+
+static void ui_render_quad_rgba_(float x, float y, float width, float height, const unsigned char *color, unsigned int image_id)
+{
+	if(color[3] == 0)
+	{
+		return;
+	}
+	float uv[4];
+	GLuint texture = ui_image_texture_(image_id, uv);
+	ui_draw_rect_(x, y, x + width, y + height, uv[0], uv[1], uv[2], uv[3], color, texture);
+}
+
+void ui_render_quad_(float x, float y, float width, float height, const float *bgcolor, unsigned int image_id)
+{
+	unsigned char color[4];
+	ui_pack_color_(bgcolor, color);
+	ui_render_quad_rgba_(x, y, width, height, color, image_id);
+}
+
+static void ui_draw_list_submit_(UIDrawList *dl, GLuint program)
+{
+	if(dl->numvertices == 0)
+	{
+		return;
+	}
+	mat4x4 proj;
+	mat4x4_identity(proj);
+	mat4x4_ortho(proj, 0.f, (float)dl->width, (float)dl->height, 0.f, -(1 << 16), (1 << 16));
+	glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, &proj[0][0]);
+
+	mat4x4 identity;
+	mat4x4_identity(identity);
+	glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, &identity[0][0]);
+
+	size_t vbo_size = sizeof(UIGLVertex) * dl->numvertices;
+	glBufferData(GL_ARRAY_BUFFER, vbo_size, dl->vertices, GL_STREAM_DRAW);
+	if(vbo_size != ui_ctx.vbo_size)
+	{
+		ui_ctx.vbo_size = vbo_size;
+		ui_resource_resize_(k_EUIResourceBuffer, ui_ctx.vbo, vbo_size);
+	}
+	bool scissor = false;
+	for(size_t i = 0; i < dl->numcommands; ++i)
+	{
+		UIDrawCommand *cmd = &dl->commands[i];
+		if(cmd->clipped != scissor)
+		{
+			scissor = cmd->clipped;
+			if(scissor)
+				glEnable(GL_SCISSOR_TEST);
+			else
+				glDisable(GL_SCISSOR_TEST);
+		}
+		if(scissor)
+		{
+			// GL's origin is the bottom left corner
+			int x0 = (int)floorf(cmd->clip.x), y0 = (int)floorf(cmd->clip.y);
+			int x1 = (int)ceilf(cmd->clip.x + cmd->clip.w), y1 = (int)ceilf(cmd->clip.y + cmd->clip.h);
+			glScissor(x0, dl->height - y1, max(0, x1 - x0), max(0, y1 - y0));
+		}
+		glBindTexture(GL_TEXTURE_2D, cmd->texture);
+		glDrawArrays(GL_TRIANGLES, (GLint)cmd->first, (GLsizei)cmd->count);
+	}
+	if(scissor)
+		glDisable(GL_SCISSOR_TEST);
+	CHECK_GL_ERROR();
+}
+#define UI_TILED_IMAGE_QUEUE_SIZE (64)
+#define UI_TILED_IMAGE_UPLOADS_PER_FRAME (8)
+#define UI_TILED_IMAGE_WORKERS (2)
+
+typedef enum
+{
+	k_EUITileStateFree,
+	k_EUITileStateQueued,
+	k_EUITileStateLoading,
+	k_EUITileStateLoaded, // Pixels decoded, waiting for upload on the GL thread
+	k_EUITileStateResident,
+	k_EUITileStateFailed
+} k_EUITileState;
+
+typedef struct
+{
+	int level, x, y;
+	k_EUITileState state;
+	GLuint gl_texture;
+	unsigned char *pixels;
+	size_t last_frame;
+	int next; // Hash chain
+} UITile;
+
+struct UITiledImage_s
+{
+	UITileSource source;
+	char path_format[256];
+	int levels;
+	UITile *tiles;
+	size_t maxtiles;
+	int *buckets;
+	size_t numbuckets;
+	int queue[UI_TILED_IMAGE_QUEUE_SIZE]; // Newest request last, workers take from the back
+	size_t queue_length;
+	// Coarsest level tiles, the fallback for everything else, are loaded first and never dropped
+	int fallback_queue[UI_TILED_IMAGE_QUEUE_SIZE];
+	size_t fallback_length;
+	size_t upload_frame;
+	int uploads;
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+	SDL_Thread *workers[UI_TILED_IMAGE_WORKERS];
+	bool quit;
+};
+
+static unsigned int ui_tile_hash_(int level, int x, int y)
+{
+	return (unsigned int)level * 73856093u ^ (unsigned int)x * 19349663u ^ (unsigned int)y * 83492791u;
+}
+
+static int ui_tile_find_(UITiledImage *image, int level, int x, int y)
+{
+	int slot = image->buckets[ui_tile_hash_(level, x, y) % image->numbuckets];
+	while(slot >= 0)
+	{
+		UITile *tile = &image->tiles[slot];
+		if(tile->level == level && tile->x == x && tile->y == y)
+			return slot;
+		slot = tile->next;
+	}
+	return -1;
+}
+
+static void ui_tile_unlink_(UITiledImage *image, int slot)
+{
+	UITile *tile = &image->tiles[slot];
+	int *it = &image->buckets[ui_tile_hash_(tile->level, tile->x, tile->y) % image->numbuckets];
+	while(*it != slot)
+		it = &image->tiles[*it].next;
+	*it = tile->next;
+	free(tile->pixels);
+	tile->pixels = NULL;
+	tile->state = k_EUITileStateFree;
+}
+
+// Slots being decoded, queued or drawn this frame are never taken
+static int ui_tile_alloc_(UITiledImage *image)
+{
+	int best = -1;
+	for(size_t i = 0; i < image->maxtiles; ++i)
+	{
+		UITile *tile = &image->tiles[i];
+		if(tile->state == k_EUITileStateFree)
+			return (int)i;
+		if(tile->state == k_EUITileStateQueued || tile->state == k_EUITileStateLoading)
+			continue;
+		if(tile->last_frame == ui_ctx.frame)
+			continue;
+		if(best < 0 || tile->last_frame < image->tiles[best].last_frame)
+			best = (int)i;
+	}
+	if(best >= 0)
+		ui_tile_unlink_(image, best);
+	return best;
+}
+
+// Called with the mutex held
+static void ui_tile_request_(UITiledImage *image, int level, int x, int y)
+{
+	if(ui_tile_find_(image, level, x, y) >= 0)
+		return;
+	bool fallback = level == image->levels - 1;
+	if(fallback && image->fallback_length == UI_TILED_IMAGE_QUEUE_SIZE)
+		return;
+	if(!fallback && image->queue_length == UI_TILED_IMAGE_QUEUE_SIZE)
+	{
+		// Oldest request is most likely scrolled out of view by now
+		ui_tile_unlink_(image, image->queue[0]);
+		memmove(image->queue, image->queue + 1, sizeof(int) * (UI_TILED_IMAGE_QUEUE_SIZE - 1));
+		image->queue_length--;
+	}
+	int slot = ui_tile_alloc_(image);
+	if(slot < 0)
+		return;
+	UITile *tile = &image->tiles[slot];
+	tile->level = level;
+	tile->x = x;
+	tile->y = y;
+	tile->state = k_EUITileStateQueued;
+	tile->last_frame = ui_ctx.frame;
+	unsigned int bucket = ui_tile_hash_(level, x, y) % image->numbuckets;
+	tile->next = image->buckets[bucket];
+	image->buckets[bucket] = slot;
+	if(fallback)
+		image->fallback_queue[image->fallback_length++] = slot;
+	else
+		image->queue[image->queue_length++] = slot;
+	SDL_CondSignal(image->cond);
+}
+
+static int ui_tiled_image_worker_(void *data)
+{
+	UITiledImage *image = data;
+	size_t tile_bytes = (size_t)image->source.tile_size * image->source.tile_size * 4;
+	SDL_LockMutex(image->mutex);
+	while(!image->quit)
+	{
+		if(image->queue_length == 0 && image->fallback_length == 0)
+		{
+			SDL_CondWait(image->cond, image->mutex);
+			continue;
+		}
+		int slot = image->fallback_length > 0 ? image->fallback_queue[--image->fallback_length] : image->queue[--image->queue_length];
+		UITile *tile = &image->tiles[slot];
+		tile->state = k_EUITileStateLoading;
+		int level = tile->level, x = tile->x, y = tile->y;
+		SDL_UnlockMutex(image->mutex);
+
+		unsigned char *pixels = calloc(tile_bytes, 1);
+		bool ok = image->source.load_tile(image->source.userdata, level, x, y, image->source.tile_size, pixels);
+
+		SDL_LockMutex(image->mutex);
+		if(ok)
+		{
+			tile->pixels = pixels;
+			tile->state = k_EUITileStateLoaded;
+		}
+		else
+		{
+			free(pixels);
+			tile->state = k_EUITileStateFailed;
+		}
+	}
+	SDL_UnlockMutex(image->mutex);
+	return 0;
+}
+
+static bool ui_tile_file_load_(void *userdata, int level, int x, int y, int tile_size, unsigned char *out_rgba)
+{
+	UITiledImage *image = userdata;
+	char path[512];
+	snprintf(path, sizeof(path), image->path_format, level, x, y);
+	int w, h, channels;
+	unsigned char *pixels = stbi_load(path, &w, &h, &channels, STBI_rgb_alpha);
+	if(!pixels)
+		return false;
+	int cw = min(w, tile_size);
+	for(int row = 0; row < h && row < tile_size; ++row)
+	{
+		memcpy(out_rgba + (size_t)row * tile_size * 4, pixels + (size_t)row * w * 4, cw * 4);
+	}
+	stbi_image_free(pixels);
+	return true;
+}
+
+UITiledImage *ui_create_tiled_image(const UITileSource *source, size_t max_tiles)
+{
+	UITiledImage *image = calloc(1, sizeof(UITiledImage));
+	image->source = *source;
+	image->levels = source->levels;
+	if(image->levels <= 0)
+	{
+		image->levels = 1;
+		while((source->width >> (image->levels - 1)) > source->tile_size
+			  || (source->height >> (image->levels - 1)) > source->tile_size)
+		{
+			image->levels++;
+		}
+	}
+	image->maxtiles = max_tiles;
+	image->tiles = calloc(max_tiles, sizeof(UITile));
+	image->numbuckets = max_tiles * 2;
+	image->buckets = malloc(sizeof(int) * image->numbuckets);
+	for(size_t i = 0; i < image->numbuckets; ++i)
+		image->buckets[i] = -1;
+	image->mutex = SDL_CreateMutex();
+	image->cond = SDL_CreateCond();
+	for(int i = 0; i < UI_TILED_IMAGE_WORKERS; ++i)
+	{
+		image->workers[i] = SDL_CreateThread(ui_tiled_image_worker_, "ui_tiles", image);
+	}
+	return image;
+}
+
+UITiledImage *ui_open_tiled_image(const char *path_format, int width, int height, int tile_size, size_t max_tiles)
+{
+	UITileSource source = { 0 };
+	source.width = width;
+	source.height = height;
+	source.tile_size = tile_size;
+	source.load_tile = ui_tile_file_load_;
+	UITiledImage *image = ui_create_tiled_image(&source, max_tiles);
+	snprintf(image->path_format, sizeof(image->path_format), "%s", path_format);
+	// Workers only read userdata once a request is queued, which happens after this
+	image->source.userdata = image;
+	return image;
+}
+
+void ui_destroy_tiled_image(UITiledImage *image)
+{
+	SDL_LockMutex(image->mutex);
+	image->quit = true;
+	SDL_CondBroadcast(image->cond);
+	SDL_UnlockMutex(image->mutex);
+	for(int i = 0; i < UI_TILED_IMAGE_WORKERS; ++i)
+	{
+		SDL_WaitThread(image->workers[i], NULL);
+	}
+	for(size_t i = 0; i < image->maxtiles; ++i)
+	{
+		if(image->tiles[i].gl_texture)
+		{
+			ui_resource_remove_(k_EUIResourceTexture, image->tiles[i].gl_texture);
+			glDeleteTextures(1, &image->tiles[i].gl_texture);
+		}
+		free(image->tiles[i].pixels);
+	}
+	SDL_DestroyCond(image->cond);
+	SDL_DestroyMutex(image->mutex);
+	free(image->buckets);
+	free(image->tiles);
+	free(image);
+}
+
+static void ui_tile_upload_(UITiledImage *image, UITile *tile)
+{
+	int size = image->source.tile_size;
+	if(!tile->gl_texture)
+	{
+		glGenTextures(1, &tile->gl_texture);
+		ui_resource_add_texture_(tile->gl_texture, size, size, (size_t)size * size * 4);
+		glBindTexture(GL_TEXTURE_2D, tile->gl_texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, tile->gl_texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, tile->pixels);
+	SDL_AtomicAdd(&ui_texture_generation_, 1);
+	free(tile->pixels);
+	tile->pixels = NULL;
+	tile->state = k_EUITileStateResident;
+}
+
+static void ui_tiled_image_upload_(UITiledImage *image, size_t frame)
+{
+	SDL_LockMutex(image->mutex);
+	if(image->upload_frame != frame)
+	{
+		image->upload_frame = frame;
+		image->uploads = 0;
+	}
+	for(size_t i = 0; i < image->maxtiles && image->uploads < UI_TILED_IMAGE_UPLOADS_PER_FRAME; ++i)
+	{
+		if(image->tiles[i].state == k_EUITileStateLoaded)
+		{
+			ui_tile_upload_(image, &image->tiles[i]);
+			image->uploads++;
+		}
+	}
+	SDL_UnlockMutex(image->mutex);
+}
+
+// Draws the part of a tile that covers the given rectangle in full resolution coordinates, clipped to clip
+static void ui_tile_draw_(UITiledImage *image,
+						  UITile *tile,
+						  float x0,
+						  float y0,
+						  float x1,
+						  float y1,
+						  float origin_x,
+						  float origin_y,
+						  float zoom,
+						  const UIRectangle *clip)
+{
+	float tile_size = (float)image->source.tile_size;
+	float level_scale = (float)(1 << tile->level);
+	float sx0 = origin_x + x0 * zoom, sx1 = origin_x + x1 * zoom;
+	float sy0 = origin_y + y0 * zoom, sy1 = origin_y + y1 * zoom;
+	float cx0 = max(sx0, clip->x), cx1 = min(sx1, clip->x + clip->w);
+	float cy0 = max(sy0, clip->y), cy1 = min(sy1, clip->y + clip->h);
+	if(cx0 >= cx1 || cy0 >= cy1)
+		return;
+	// Map the clipped screen rectangle back to texels of this tile
+	float s0 = ((x0 + (cx0 - sx0) / zoom) / level_scale - tile->x * tile_size) / tile_size;
+	float s1 = ((x0 + (cx1 - sx0) / zoom) / level_scale - tile->x * tile_size) / tile_size;
+	float t0 = ((y0 + (cy0 - sy0) / zoom) / level_scale - tile->y * tile_size) / tile_size;
+	float t1 = ((y0 + (cy1 - sy0) / zoom) / level_scale - tile->y * tile_size) / tile_size;
+	static const unsigned char white[] = { 255, 255, 255, 255 };
+	ui_draw_rect_(cx0, cy0, cx1, cy1, s0, t0, s1, t1, white, tile->gl_texture);
+	tile->last_frame = ui_ctx.frame;
+}
+
+static void ui_render_tiled_image_(UIElement *e)
+{
+	UITiledImage *image = e->u.image.tiled;
+	float zoom = e->u.image.zoom > 0.f ? e->u.image.zoom : 1.f;
+	int tile_size = image->source.tile_size;
+	UIRectangle *clip = &e->rect;
+
+	// Screen pixels of a level's texel fall in [0.5, 1) or above at the finest level
+	int level = 0;
+	for(float s = zoom; s < 0.5f && level < image->levels - 1; s *= 2.f)
+		++level;
+	float left = e->u.image.center.x - clip->w / (2.f * zoom);
+	float top = e->u.image.center.y - clip->h / (2.f * zoom);
+	float right = left + clip->w / zoom;
+	float bottom = top + clip->h / zoom;
+	float origin_x = clip->x - left * zoom;
+	float origin_y = clip->y - top * zoom;
+
+	// Uploads happen at submission, tiles become drawable in the frame after that
+	UIDrawList *dl = ui_draw_target_();
+	if(dl->numtiled_images >= dl->maxtiled_images)
+	{
+		dl->maxtiled_images = dl->maxtiled_images == 0 ? 8 : dl->maxtiled_images * 2;
+		dl->tiled_images = realloc(dl->tiled_images, sizeof(UITiledImage *) * dl->maxtiled_images);
+	}
+	dl->tiled_images[dl->numtiled_images++] = image;
+
+	SDL_LockMutex(image->mutex);
+
+	// The coarsest level goes to its own queue, workers load it before anything else
+	int top_level = image->levels - 1;
+	int top_span = tile_size << top_level;
+	for(int ty = max(0, (int)(top / top_span)); ty <= (int)(bottom / top_span) && ty * top_span < image->source.height; ++ty)
+		for(int tx = max(0, (int)(left / top_span)); tx <= (int)(right / top_span) && tx * top_span < image->source.width; ++tx)
+			ui_tile_request_(image, top_level, tx, ty);
+
+	int span = tile_size << level;
+	int tx0 = max(0, (int)floorf(left / span)), tx1 = (int)floorf(right / span);
+	int ty0 = max(0, (int)floorf(top / span)), ty1 = (int)floorf(bottom / span);
+	for(int ty = ty0; ty <= ty1 && ty * span < image->source.height; ++ty)
+	{
+		for(int tx = tx0; tx <= tx1 && tx * span < image->source.width; ++tx)
+		{
+			float x0 = (float)(tx * span), y0 = (float)(ty * span);
+			float x1 = min(x0 + span, (float)image->source.width);
+			float y1 = min(y0 + span, (float)image->source.height);
+			// Use the closest resident ancestor until this tile streams in
+			for(int l = level; l < image->levels; ++l)
+			{
+				int slot = ui_tile_find_(image, l, tx >> (l - level), ty >> (l - level));
+				if(l == level && slot < 0)
+					ui_tile_request_(image, level, tx, ty);
+				if(slot >= 0 && image->tiles[slot].state == k_EUITileStateResident)
+				{
+					ui_tile_draw_(image, &image->tiles[slot], x0, y0, x1, y1, origin_x, origin_y, zoom, clip);
+					break;
+				}
+			}
+		}
+	}
+	SDL_UnlockMutex(image->mutex);
+}
+
+char *ui_element_input_to_string(UIElement *e, char *input_str_repr_buf, size_t input_str_repr_buf_sz)
+{
+	if(ui_ctx.input_element.out_value == e->u.input.out_value)
+	{
+		if(ui_ctx.active_text_input)
+		{
+			return ui_ctx.active_text_input;
+		}
+	}
+	assert(input_str_repr_buf_sz >= 1);
+	input_str_repr_buf[0] = 0;
+	if(e->type != k_EUIElementTypeInput)
+		return NULL;
+	switch(e->u.input.input_type)
+	{
+		case k_EUIInputElementTypeInteger:
+		{
+			if(e->u.input.value_cached)
+				return e->u.input.value_text;
+			snprintf(input_str_repr_buf, input_str_repr_buf_sz, "%d", *(int*)e->u.input.out_value);
+		}
+		break;
+		case k_EUIInputElementTypeFloat:
+		{
+			if(e->u.input.value_cached)
+				return e->u.input.value_text;
+			snprintf(input_str_repr_buf, input_str_repr_buf_sz, "%f", *(float*)e->u.input.out_value);
+		}
+		break;
+		case k_EUIInputElementTypeText: return (char*)e->u.input.out_value;
+	}
+	return input_str_repr_buf;
+}
+static void ui_render_plot_(UIElement *e, float x, float y, float w, float h)
+{
+	UIPlotState *state = e->u.plot.state;
+	if(state->numcolumns == 0)
+		return;
+	float uv[4];
+	GLuint texture = ui_image_texture_(0, uv);
+	unsigned char color[4];
+	ui_pack_color_(e->u.plot.color, color);
+	float range = state->hi - state->lo;
+	float scale = range > 0.f ? h / range : 0.f;
+	// One quad per pixel column spanning its min/max, all in a single draw
+	UIGLVertex *v = ui_draw_list_alloc_(ui_draw_target_(), texture, state->numcolumns * 6);
+	float prev_lo = state->column_min[0], prev_hi = state->column_max[0];
+	for(size_t i = 0; i < state->numcolumns; ++i)
+	{
+		// Extend to the previous column so steep slopes stay connected
+		float lo = min(state->column_min[i], prev_hi);
+		float hi = max(state->column_max[i], prev_lo);
+		prev_lo = state->column_min[i];
+		prev_hi = state->column_max[i];
+		float y0 = y + h - (hi - state->lo) * scale;
+		float y1 = y + h - (lo - state->lo) * scale;
+		if(y1 - y0 < 1.f)
+			y1 = y0 + 1.f;
+		float x0 = x + state->column_x0[i], x1 = min(max(x + state->column_x1[i], x0 + 1.f), x + w);
+		UIGLVertex quad[] = { { { x0, y0 }, { uv[0], uv[1] } }, { { x1, y0 }, { uv[0], uv[1] } },
+							  { { x0, y1 }, { uv[0], uv[1] } }, { { x1, y0 }, { uv[0], uv[1] } },
+							  { { x1, y1 }, { uv[0], uv[1] } }, { { x0, y1 }, { uv[0], uv[1] } } };
+		for(int j = 0; j < 6; ++j)
+		{
+			v[j] = quad[j];
+			memcpy(v[j].color, color, 4);
+		}
+		v += 6;
+	}
+}
+
+#define UI_CONSOLE_LINE_SIZE (256)
+#define UI_CONSOLE_RUN_CACHE_SIZE (256)
+
+typedef struct
+{
+	// Seqlock, 2 * (index + 1) once line index is complete, odd while it is being written
+	SDL_atomic_t seq;
+	unsigned short length;
+	char text[UI_CONSOLE_LINE_SIZE];
+} UIConsoleLine;
+
+typedef struct
+{
+	float x0, y0, x1, y1;
+	float s0, t0, s1, t1;
+} UIGlyphQuad;
+
+// Glyph quads of a line relative to its pen origin, built once per line
+typedef struct
+{
+	uint32_t line;
+	bool valid;
+	float width;
+	UIGlyphQuad *glyphs;
+	size_t numglyphs, maxglyphs;
+} UIConsoleRun;
+
+struct UIConsole_s
+{
+	UIConsoleLine *lines;
+	uint32_t capacity;
+	SDL_atomic_t write; // Wraps, line indices are compared modulo 2^32
+	uint64_t end; // Lines before this are complete, only touched by the UI thread
+	bool follow; // Keep the view scrolled to the newest line
+	UIConsoleRun runs[UI_CONSOLE_RUN_CACHE_SIZE];
+};
+
+UIConsole *ui_create_console(size_t max_lines)
+{
+	UIConsole *console = calloc(1, sizeof(UIConsole));
+	console->lines = calloc(max_lines, sizeof(UIConsoleLine));
+	console->capacity = (uint32_t)max_lines;
+	console->follow = true;
+	return console;
+}
+
+void ui_destroy_console(UIConsole *console)
+{
+	for(size_t i = 0; i < UI_CONSOLE_RUN_CACHE_SIZE; ++i)
+		free(console->runs[i].glyphs);
+	free(console->lines);
+	free(console);
+}
+
+// Takes the slot for line index with an odd sequence, false if a newer line already has it. Waits while a
+// writer that was lapped by the ring is still filling the slot.
+static bool ui_console_claim_(UIConsoleLine *line, uint32_t index)
+{
+	uint32_t claim = index * 2u + 1u;
+	for(;;)
+	{
+		uint32_t seq = (uint32_t)SDL_AtomicGet(&line->seq);
+		if((int32_t)(seq - claim) >= 0)
+			return false;
+		if(seq & 1u)
+		{
+			SDL_Delay(0);
+			continue;
+		}
+		if(SDL_AtomicCAS(&line->seq, (int)seq, (int)claim))
+		{
+			// Readers must not see the new text with the old, even sequence
+			SDL_MemoryBarrierRelease();
+			return true;
+		}
+	}
+}
+
+// Lines overwritten before they were written are formatted here and dropped
+static UI_THREAD_LOCAL char ui_console_discard_[UI_CONSOLE_LINE_SIZE];
+
+char *ui_console_begin_line(UIConsole *console, uint32_t *out_ticket)
+{
+	uint32_t index = (uint32_t)SDL_AtomicAdd(&console->write, 1);
+	UIConsoleLine *line = &console->lines[index % console->capacity];
+	*out_ticket = index;
+	if(!ui_console_claim_(line, index))
+		return ui_console_discard_;
+	return line->text;
+}
+
+void ui_console_end_line(UIConsole *console, uint32_t ticket, size_t length)
+{
+	UIConsoleLine *line = &console->lines[ticket % console->capacity];
+	if((uint32_t)SDL_AtomicGet(&line->seq) != ticket * 2u + 1u)
+		return;
+	line->length = (unsigned short)min(length, UI_CONSOLE_LINE_SIZE - 1);
+	line->text[line->length] = 0;
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&line->seq, (int)(ticket * 2u + 2u));
+}
+
+void ui_console_append(UIConsole *console, const char *text, size_t length)
+{
+	// Longer lines continue in the next slots, reserved in one go so they stay together
+	size_t chunks = length == 0 ? 1 : (length + UI_CONSOLE_LINE_SIZE - 2) / (UI_CONSOLE_LINE_SIZE - 1);
+	uint32_t index = (uint32_t)SDL_AtomicAdd(&console->write, (int)chunks);
+	for(size_t i = 0; i < chunks; ++i, ++index)
+	{
+		UIConsoleLine *line = &console->lines[index % console->capacity];
+		size_t n = min(length, UI_CONSOLE_LINE_SIZE - 1);
+		if(!ui_console_claim_(line, index))
+		{
+			text += n;
+			length -= n;
+			continue;
+		}
+		memcpy(line->text, text, n);
+		line->text[n] = 0;
+		line->length = (unsigned short)n;
+		text += n;
+		length -= n;
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicSet(&line->seq, (int)(index * 2u + 2u));
+	}
+}
+
+// Advances console->end over lines that are complete, skipping lines already overwritten
+static void ui_console_poll_(UIConsole *console)
+{
+	// The 32-bit write counter extended against end, it can't have moved 2^32 lines ahead since the last poll
+	uint64_t write = console->end + (uint32_t)((uint32_t)SDL_AtomicGet(&console->write) - (uint32_t)console->end);
+	if(write - console->end > console->capacity)
+		console->end = write - console->capacity;
+	while(console->end != write)
+	{
+		uint32_t index = (uint32_t)console->end;
+		UIConsoleLine *line = &console->lines[index % console->capacity];
+		uint32_t seq = (uint32_t)SDL_AtomicGet(&line->seq);
+		uint32_t expected = index * 2u + 2u;
+		if(seq == expected || (int32_t)(seq - expected) > 0)
+			console->end++;
+		else
+			break;
+	}
+}
+
+static UIConsoleRun *ui_console_run_(UIConsole *console, uint32_t index, UIFont *font)
+{
+	UIConsoleRun *run = &console->runs[index % UI_CONSOLE_RUN_CACHE_SIZE];
+	if(run->valid && run->line == index)
+		return run;
+	UIConsoleLine *line = &console->lines[index % console->capacity];
+	char text[UI_CONSOLE_LINE_SIZE];
+	uint32_t seq = (uint32_t)SDL_AtomicGet(&line->seq);
+	SDL_MemoryBarrierAcquire();
+	size_t length = min(line->length, UI_CONSOLE_LINE_SIZE - 1);
+	memcpy(text, line->text, length);
+	SDL_MemoryBarrierAcquire();
+	// Torn or overwritten by a newer line, don't cache
+	if(seq != index * 2u + 2u || (uint32_t)SDL_AtomicGet(&line->seq) != seq)
+		return NULL;
+	if(length > run->maxglyphs)
+	{
+		run->maxglyphs = UI_CONSOLE_LINE_SIZE;
+		run->glyphs = realloc(run->glyphs, sizeof(UIGlyphQuad) * run->maxglyphs);
+	}
+	float x = 0.f, y = 0.f;
+	run->numglyphs = 0;
+	for(size_t i = 0; i < length; ++i)
+	{
+		if(text[i] < 32 || text[i] >= 127)
+			continue;
+		stbtt_aligned_quad q;
+		stbtt_GetBakedQuad(font->cdata, font->bitmap_width, font->bitmap_height, text[i] - 32, &x, &y, &q, 1);
+		UIGlyphQuad *g = &run->glyphs[run->numglyphs++];
+		g->x0 = q.x0;
+		g->y0 = q.y0;
+		g->x1 = q.x1;
+		g->y1 = q.y1;
+		g->s0 = q.s0;
+		g->t0 = q.t0;
+		g->s1 = q.s1;
+		g->t1 = q.t1;
+	}
+	run->width = x;
+	run->line = index;
+	run->valid = true;
+	return run;
+}
+
+static void ui_render_console_(UIElement *e)
+{
+	UIConsoleElement *c = &e->u.console;
+	UIFont *font = ui_ctx.default_font;
+	unsigned char color[4];
+	ui_pack_color_(c->color, color);
+	float y = e->rect.y;
+	for(uint32_t i = c->first; i != c->last; ++i, y += c->line_height)
+	{
+		// Read only, ui_console filled the cache while building and vertex workers may run this concurrently
+		const UIConsoleRun *run = &c->console->runs[i % UI_CONSOLE_RUN_CACHE_SIZE];
+		if(!run->valid || run->line != i || run->numglyphs == 0)
+			continue;
+		UIGLVertex *v = ui_draw_list_alloc_(ui_draw_target_(), font->gl_texture, run->numglyphs * 6);
+		float ox = e->rect.x, oy = y + font->ascent;
+		for(size_t j = 0; j < run->numglyphs; ++j, v += 6)
+		{
+			UIGlyphQuad *g = &run->glyphs[j];
+			UIGLVertex quad[] = { { { ox + g->x0, oy + g->y0 }, { g->s0, g->t0 } },
+								  { { ox + g->x1, oy + g->y0 }, { g->s1, g->t0 } },
+								  { { ox + g->x0, oy + g->y1 }, { g->s0, g->t1 } },
+								  { { ox + g->x1, oy + g->y0 }, { g->s1, g->t0 } },
+								  { { ox + g->x1, oy + g->y1 }, { g->s1, g->t1 } },
+								  { { ox + g->x0, oy + g->y1 }, { g->s0, g->t1 } } };
+			for(int k = 0; k < 6; ++k)
+			{
+				v[k] = quad[k];
+				memcpy(v[k].color, color, 4);
+			}
+		}
+	}
+}
+
+static void ui_render_editor_(UIElement *e)
+{
+	static const float selection_color[] = { 0.f, 0.f, 1.f, 0.3f };
+	UIEditorElement *ed = &e->u.editor;
+	UITextBuffer *b = ed->buffer;
+	UIFont *font = ui_ctx.default_font;
+	float clip_right = e->clipped ? e->clip.x + e->clip.w : (float)ui_ctx.width;
+	size_t sel_from = min(b->anchor, b->caret), sel_to = max(b->anchor, b->caret);
+	const unsigned char *color = ui_element_style_props_(e)->text_color;
+	float y = e->rect.y;
+	for(size_t line = ed->first; line < ed->last; ++line, y += ed->line_height)
+	{
+		size_t begin = b->lines[line], end = ui_text_buffer_line_end_(b, line);
+		if(sel_from < sel_to && sel_from <= end && sel_to >= begin)
+		{
+			float x0 = ui_text_buffer_measure_(b, begin, max(sel_from, begin));
+			float x1 = sel_to > end ? ui_text_buffer_cached_line_width_(b, line) + font->cdata[0].xadvance
+									: x0 + ui_text_buffer_measure_(b, max(sel_from, begin), sel_to);
+			ui_render_quad_(e->rect.x + x0, y, x1 - x0, ed->line_height, selection_color, 0);
+		}
+		float x = e->rect.x, run_x = x;
+		unsigned char glyphs[UI_GLYPH_RUN_CHUNK];
+		size_t n = 0;
+		for(size_t i = begin; i < end && x < clip_right; ++i)
+		{
+			char c = ui_text_buffer_at_(b, i);
+			if(c < 32 || c >= 127)
+				continue;
+			glyphs[n++] = c - 32;
+			x += font->glyphs.advance[c - 32];
+			if(n == UI_GLYPH_RUN_CHUNK)
+			{
+				ui_emit_glyph_run_(font, glyphs, n, &run_x, y + font->ascent, color);
+				n = 0;
+			}
+		}
+		ui_emit_glyph_run_(font, glyphs, n, &run_x, y + font->ascent, color);
+	}
+	size_t caret_line = ui_text_buffer_line_of_(b, b->caret);
+	if(ed->focused && caret_line >= ed->first && caret_line < ed->last && (ticks() / 600) % 2 == 0)
+	{
+		float caret_x = ui_text_buffer_measure_(b, b->lines[caret_line], b->caret);
+		ui_render_quad_rgba_(e->rect.x + caret_x,
+							 e->rect.y + (caret_line - ed->first) * ed->line_height,
+							 1.f,
+							 ed->line_height,
+							 color,
+							 0);
+	}
+}
+
+void ui_render_element_(UIElement *e)
+{
+	UIFont *font = ui_ctx.default_font;
+	//bool hovering = ui_mouse_test_rectangle(&e->rect);
+	bool draw_caret = ui_ctx.caret_visible;
+	
+	const UIResolvedStyle *props = ui_element_style_props_(e);
+
+	float x = e->rect.x;
+	float y = e->rect.y;
+	float w = e->rect.w;
+	float h = e->rect.h;
+	float content_x = x + props->border_thickness + props->padding_x / 2.f + props->margin / 2.f;
+	float content_y = y + props->border_thickness + props->padding_y / 2.f + props->margin / 2.f;
+	ui_render_quad_rgba_(x, y, w, h, props->border_color, 0);
+
+	ui_render_quad_rgba_(x + props->border_thickness,
+						 y + props->border_thickness,
+						 w - 2.0f * props->border_thickness,
+						 h - 2.0f * props->border_thickness,
+						 props->background_color,
+						 0);
+
+	switch(e->type)
+	{
+		case k_EUIElementTypeButton:
+		case k_EUIElementTypeLabel:
+			content_y += e->content_height;
+			ui_render_label_(font, &content_x, content_y, e->width, e, props->text_color);
+			break;
+		case k_EUIElementTypeConsole:
+			ui_render_console_(e);
+			break;
+		case k_EUIElementTypeEditor:
+			ui_render_editor_(e);
+			break;
+		case k_EUIElementTypePlot:
+			ui_render_plot_(e,
+							x + props->border_thickness,
+							y + props->border_thickness,
+							w - 2.0f * props->border_thickness,
+							h - 2.0f * props->border_thickness);
+			break;
+		case k_EUIElementTypePane:
+		{
+			static const float bar_color[] = { 0.f, 0.f, 0.f, 0.35f };
+			UIPaneState *state = e->u.pane.state;
+			float inner_h = h - 2.0f * props->border_thickness;
+			if(state->content_height > inner_h)
+			{
+				float bar_h = max(inner_h * inner_h / (float)state->content_height, 8.f);
+				float bar_y = (float)((inner_h - bar_h) * state->scroll_y / (state->content_height - inner_h));
+				ui_render_quad_(x + w - props->border_thickness - UI_PANE_SCROLLBAR_WIDTH,
+								y + props->border_thickness + bar_y,
+								UI_PANE_SCROLLBAR_WIDTH,
+								bar_h,
+								bar_color,
+								0);
+			}
+		} break;
+		case k_EUIElementTypeImage:
+			if(e->u.image.tiled)
+				ui_render_tiled_image_(e);
+			else
+				ui_render_quad_(x, y, w, h, ui_color_white, e->u.image.image_id);
+			break;
+		case k_EUIElementTypeInput:
+		{
+			float value_y = content_y;
+			float content_end = content_x + e->width;
+			content_y += e->content_height;
+			char input_str_repr_buf[128];
+			char *input_str_repr = e->u.input.out_value ? ui_element_input_to_string(e, input_str_repr_buf, sizeof(input_str_repr_buf)) : "";
+			// The label gives way to the value first, the value is then cut at the end of the content box
+			float separator = font->glyphs.advance[':' - 32] + font->glyphs.advance[' ' - 32];
+			float label_max = max(e->width - separator - ui_input_value_width_(e, input_str_repr), FLT_MIN);
+			ui_render_label_(font, &content_x, content_y, label_max, e, props->text_color);
+			ui_render_text_rgba_(font, &content_x, &content_y, ": ", props->text_color);
+			if(e->u.input.out_value)
+			{
+				float value_x = content_x;
+				ui_render_value_(font, &content_x, content_y, content_end - value_x, e, input_str_repr, props->text_color);
+				bool active = ui_ctx.active_text_input == e->u.input.out_value
+							  && e->u.input.input_type == k_EUIInputElementTypeText;
+				if(active && draw_caret && ui_ctx.caret_pos >= 0)
+				{
+					float caret_x = value_x + ui_input_value_offset_(e, input_str_repr, ui_ctx.caret_pos) - 1.f;
+					ui_render_text_rgba_(font, &caret_x, &content_y, "|", props->text_color);
+				}
+				if(active && ui_ctx.selection_beg >= 0 && ui_ctx.selection_beg < ui_ctx.selection_end)
+				{
+					static const float selcol[] = { 0.f, 0.f, 1.f, 0.5f };
+					float x0 = ui_input_value_offset_(e, input_str_repr, ui_ctx.selection_beg);
+					float x1 = ui_input_value_offset_(e, input_str_repr, ui_ctx.selection_end);
+					ui_render_quad_(value_x + x0, value_y, x1 - x0, e->content_height, selcol, 0);
+				}
+			}
+		} break;
+		case k_EUIElementTypeCheckbox:
+		{
+			static const float color[] = { 0.f, 0.f, 1.f, 1.f };
+			static const float color2[] = { 1.f, 1.f, 1.f, 1.f };
+			content_y += e->content_height;
+			float sz = e->content_height;
+			float separator = font->glyphs.advance[':' - 32] + font->glyphs.advance[' ' - 32];
+			ui_render_label_(font, &content_x, content_y, max(e->width - separator - sz, FLT_MIN), e, props->text_color);
+			ui_render_text_rgba_(font, &content_x, &content_y, ": ", props->text_color);
+			ui_render_quad_(content_x,
+							content_y - sz,
+							sz, sz, color, 0);
+			if(!*e->u.checkbox.state)
+			{
+				ui_render_quad_(content_x + sz / 4.f,
+								content_y - e->content_height + sz / 4.f,
+								sz / 2.f,
+								sz / 2.f,
+								color2,
+								0);
+			}
+		} break;
+	}
+}
+
+void ui_begin_frame()
+{
+	ui_ctx.interact_active = SDL_GetRelativeMouseMode();
+	ui_ctx.x = 0;
+	ui_ctx.y = 0;
+	ui_ctx.frame++;
+	ui_apply_input_queue_();
+	// Styles normally repeat every frame, only animated ones keep adding entries
+	if(ui_ctx.numstyles == 0 || ui_ctx.numstyles > UI_MAX_STYLES / 2)
+		ui_style_table_reset_();
+	ui_text_arena_reset_();
+	ui_ctx.numelements = 0;
+	ui_ctx.pane_depth = 0;
+	ui_ctx.layout_depth = 0;
+	ui_ctx.numlayout_items = 0;
+	ui_ctx.transform_depth = 0;
+	ui_ctx.numtransforms = 0;
+	ui_push_affine_(NULL);
+	ui_ctx.sameline = false;
+	ui_ctx.sameline_count = 0;
+}
+void ui_end_frame()
+{
+	ui_ctx.text_input_changed = false;
+	assert(ui_ctx.pane_depth == 0);
+	ui_ctx.mouse_prev_frame = ui_ctx.mouse;
+	ui_ctx.numpresses = 0;
+	ui_ctx.mouse.wheel_x = 0.f;
+	ui_ctx.mouse.wheel_y = 0.f;
+}
+
+void ui_translate(float x, float y)
+{
+	ui_ctx.x = x;
+	ui_ctx.y = y;
+}
+
+#define UI_VERTEX_PARALLEL_MIN_ELEMENTS (4096)
+#define UI_VERTEX_CHUNK_SIZE (512)
+#define UI_MAX_VERTEX_WORKERS (16)
+
+static void ui_generate_vertices_(size_t first, size_t last)
+{
+	UIDrawList *dl = ui_draw_target_();
+	// Consecutive elements under the same transform are transformed as one batch
+	int transform = 0;
+	size_t batch = dl->numvertices;
+	for(size_t i = first; i < last; ++i)
+	{
+		UIElement *e = &ui_ctx.elements[i];
+		if(e->culled)
+			continue;
+		if(e->transform != transform)
+		{
+			if(transform != 0)
+				ui_transform_vertices_(dl->vertices + batch, dl->numvertices - batch, ui_ctx.transforms[transform].m);
+			transform = e->transform;
+			batch = dl->numvertices;
+		}
+		if(e->clipped && e->clip_transform != 0)
+		{
+			// Scissoring is axis aligned, a rotated clip is approximated by its bounds
+			UIRectangle clip;
+			ui_affine_bounds_(ui_ctx.transforms[e->clip_transform].m, &e->clip, &clip);
+			ui_draw_list_clip_(dl, &clip);
+		}
+		else
+		{
+			ui_draw_list_clip_(dl, e->clipped ? &e->clip : NULL);
+		}
+		ui_render_element_(e);
+	}
+	if(transform != 0)
+		ui_transform_vertices_(dl->vertices + batch, dl->numvertices - batch, ui_ctx.transforms[transform].m);
+}
+
+typedef struct
+{
+	int worker;
+	size_t first_vertex, numvertices;
+	size_t first_command, numcommands;
+	size_t first_tiled_image, numtiled_images;
+} UIVertexChunk;
+
+// Chunk range owned by a worker, the others steal from it once their own range is drained
+typedef struct
+{
+	SDL_atomic_t next;
+	int end;
+} UIVertexQueue;
+
+typedef struct UIVertexPool_s
+{
+	UIContext *ctx;
+	int numworkers; // Including the building thread, which is worker 0
+	SDL_Thread *threads[UI_MAX_VERTEX_WORKERS];
+	UIDrawList arenas[UI_MAX_VERTEX_WORKERS];
+	UIVertexQueue queues[UI_MAX_VERTEX_WORKERS];
+	UIVertexChunk *chunks;
+	size_t numchunks, maxchunks;
+	SDL_mutex *mutex;
+	SDL_cond *start, *done;
+	unsigned int job;
+	int busy;
+	bool quit;
+} UIVertexPool;
+
+static void ui_vertex_pool_run_(UIVertexPool *pool, int worker)
+{
+	UIDrawList *arena = &pool->arenas[worker];
+	ui_worker_draw_list_ = arena;
+	for(int k = 0; k < pool->numworkers; ++k)
+	{
+		UIVertexQueue *queue = &pool->queues[(worker + k) % pool->numworkers];
+		for(;;)
+		{
+			int c = SDL_AtomicAdd(&queue->next, 1);
+			if(c >= queue->end)
+				break;
+			UIVertexChunk *chunk = &pool->chunks[c];
+			chunk->worker = worker;
+			chunk->first_vertex = arena->numvertices;
+			chunk->first_command = arena->numcommands;
+			chunk->first_tiled_image = arena->numtiled_images;
+			// Commands never span chunks, stitching merges them again where possible
+			arena->sealed = true;
+			size_t first = (size_t)c * UI_VERTEX_CHUNK_SIZE;
+			ui_generate_vertices_(first, min(first + UI_VERTEX_CHUNK_SIZE, pool->ctx->numelements));
+			chunk->numvertices = arena->numvertices - chunk->first_vertex;
+			chunk->numcommands = arena->numcommands - chunk->first_command;
+			chunk->numtiled_images = arena->numtiled_images - chunk->first_tiled_image;
+		}
+	}
+	ui_worker_draw_list_ = NULL;
+}
+
+typedef struct
+{
+	UIVertexPool *pool;
+	int worker;
+} UIVertexWorkerArgs;
+
+static int ui_vertex_worker_(void *data)
+{
+	UIVertexWorkerArgs args = *(UIVertexWorkerArgs *)data;
+	free(data);
+	UIVertexPool *pool = args.pool;
+	ui_current_ctx_ = pool->ctx;
+	unsigned int seen = 0;
+	for(;;)
+	{
+		SDL_LockMutex(pool->mutex);
+		while(pool->job == seen && !pool->quit)
+			SDL_CondWait(pool->start, pool->mutex);
+		seen = pool->job;
+		bool quit = pool->quit;
+		SDL_UnlockMutex(pool->mutex);
+		if(quit)
+			break;
+		ui_vertex_pool_run_(pool, args.worker);
+		SDL_LockMutex(pool->mutex);
+		if(--pool->busy == 0)
+			SDL_CondSignal(pool->done);
+		SDL_UnlockMutex(pool->mutex);
+	}
+	return 0;
+}
+
+static UIVertexPool *ui_vertex_pool_(UIContext *ctx)
+{
+	if(ctx->vertex_pool)
+		return ctx->vertex_pool->numworkers > 1 ? ctx->vertex_pool : NULL;
+	UIVertexPool *pool = calloc(1, sizeof(UIVertexPool));
+	ctx->vertex_pool = pool;
+	pool->ctx = ctx;
+	pool->numworkers = max(1, min(SDL_GetCPUCount(), UI_MAX_VERTEX_WORKERS));
+	pool->mutex = SDL_CreateMutex();
+	pool->start = SDL_CreateCond();
+	pool->done = SDL_CreateCond();
+	for(int i = 1; i < pool->numworkers; ++i)
+	{
+		UIVertexWorkerArgs *args = malloc(sizeof(UIVertexWorkerArgs));
+		args->pool = pool;
+		args->worker = i;
+		pool->threads[i] = SDL_CreateThread(ui_vertex_worker_, "ui_vertices", args);
+	}
+	return pool->numworkers > 1 ? pool : NULL;
+}
+
+static void ui_vertex_pool_destroy_(UIVertexPool *pool)
+{
+	SDL_LockMutex(pool->mutex);
+	pool->quit = true;
+	SDL_CondBroadcast(pool->start);
+	SDL_UnlockMutex(pool->mutex);
+	for(int i = 1; i < pool->numworkers; ++i)
+	{
+		SDL_WaitThread(pool->threads[i], NULL);
+	}
+	for(int i = 0; i < pool->numworkers; ++i)
+	{
+		free(pool->arenas[i].vertices);
+		free(pool->arenas[i].commands);
+		free(pool->arenas[i].tiled_images);
+	}
+	SDL_DestroyCond(pool->start);
+	SDL_DestroyCond(pool->done);
+	SDL_DestroyMutex(pool->mutex);
+	free(pool->chunks);
+	free(pool);
+}
+
+// Appends a chunk of a worker arena to the frame's list in element order
+static void ui_draw_list_append_(UIDrawList *dl, UIDrawList *arena, const UIVertexChunk *chunk)
+{
+	size_t base = dl->numvertices;
+	for(size_t i = 0; i < chunk->numcommands; ++i)
+	{
+		UIDrawCommand *src = &arena->commands[chunk->first_command + i];
+		dl->clip = src->clip;
+		dl->clipped = src->clipped;
+		UIGLVertex *v = ui_draw_list_alloc_(dl, src->texture, src->count);
+		memcpy(v, &arena->vertices[src->first], sizeof(UIGLVertex) * src->count);
+	}
+	assert(dl->numvertices - base == chunk->numvertices);
+	for(size_t i = 0; i < chunk->numtiled_images; ++i)
+	{
+		if(dl->numtiled_images >= dl->maxtiled_images)
+		{
+			dl->maxtiled_images = dl->maxtiled_images == 0 ? 8 : dl->maxtiled_images * 2;
+			dl->tiled_images = realloc(dl->tiled_images, sizeof(UITiledImage *) * dl->maxtiled_images);
+		}
+		dl->tiled_images[dl->numtiled_images++] = arena->tiled_images[chunk->first_tiled_image + i];
+	}
+}
+
+static void ui_vertex_pool_generate_(UIVertexPool *pool)
+{
+	size_t numchunks = (pool->ctx->numelements + UI_VERTEX_CHUNK_SIZE - 1) / UI_VERTEX_CHUNK_SIZE;
+	if(numchunks > pool->maxchunks)
+	{
+		pool->maxchunks = numchunks;
+		pool->chunks = realloc(pool->chunks, sizeof(UIVertexChunk) * numchunks);
+	}
+	pool->numchunks = numchunks;
+	// Contiguous ranges per worker keep neighbouring elements, and their textures, on the same arena
+	for(int i = 0; i < pool->numworkers; ++i)
+	{
+		ui_draw_list_reset_(&pool->arenas[i]);
+		SDL_AtomicSet(&pool->queues[i].next, (int)(numchunks * i / pool->numworkers));
+		pool->queues[i].end = (int)(numchunks * (i + 1) / pool->numworkers);
+	}
+	SDL_LockMutex(pool->mutex);
+	pool->busy = pool->numworkers - 1;
+	pool->job++;
+	SDL_CondBroadcast(pool->start);
+	SDL_UnlockMutex(pool->mutex);
+
+	ui_vertex_pool_run_(pool, 0);
+
+	SDL_LockMutex(pool->mutex);
+	while(pool->busy > 0)
+		SDL_CondWait(pool->done, pool->mutex);
+	SDL_UnlockMutex(pool->mutex);
+
+	UIDrawList *dl = ui_ctx.draw_list;
+	for(size_t i = 0; i < numchunks; ++i)
+	{
+		UIVertexChunk *chunk = &pool->chunks[i];
+		ui_draw_list_append_(dl, &pool->arenas[chunk->worker], chunk);
+	}
+	dl->clipped = false;
+}
+
+void ui_build_draw_list()
+{
+	// Wait until the render thread is done with the list we are about to overwrite
+	SDL_LockMutex(ui_ctx.draw_mutex);
+	int index = ui_ctx.published_list == 0 ? 1 : 0;
+	while(ui_ctx.submitting_list == index)
+		SDL_CondWait(ui_ctx.draw_cond, ui_ctx.draw_mutex);
+	SDL_UnlockMutex(ui_ctx.draw_mutex);
+	ui_ctx.draw_list = &ui_ctx.draw_lists[index];
+
+	//float color[] = { 1.f, 0.f, 0.f, 1.f };
+	//ui_render_quad_(ui_ctx.mouse.x, ui_ctx.mouse.y, 8.f, 8.f, color);
+	// Vertex generation reads atlas rectangles, keep other contexts from repacking meanwhile
+	ui_shared_lock_();
+	// Nothing else would get to retire for a group of headless contexts
+	if(!ui_ctx.submits_lists && ui_on_gl_thread_())
+	{
+		ui_shared_load_deferred_(ui_ctx.shared);
+		if(ui_ctx.shared->unsubmitted_lists == 0)
+			ui_shared_retire_(ui_ctx.shared);
+	}
+	ui_draw_list_reset_(ui_ctx.draw_list);
+	UIElement *active_element = NULL;
+	UIElement *hovered_element = NULL;
+	unsigned int now = ticks();
+	if(now - ui_ctx.caret_blink_time >= 600)
+	{
+		ui_ctx.caret_visible ^= 1;
+		ui_ctx.caret_blink_time += 600;
+	}
+	// Interaction first, vertex generation below only reads the resulting state
+	for(size_t i = 0; i < ui_ctx.numelements; ++i)
+	{
+		UIElement *e = &ui_ctx.elements[i];
+		if(e->culled)
+			continue;
+		if(ui_element_hovered_(e))
+		{
+			hovered_element = e;
+		}
+		const UIMousePress *press = ui_element_press_(e);
+		if(press)
+		{
+			active_element = e;
+			if(e->type == k_EUIElementTypeInput && ui_ctx.active_text_input
+			   && ui_ctx.input_element.out_value == e->u.input.out_value)
+			{
+				ui_ctx.caret_pos = ui_input_caret_from_press_(e, press);
+				void ui_input_clear_selection();
+				ui_input_clear_selection();
+			}
+			else if(e->type == k_EUIElementTypeInput)
+			{
+				if(e->u.input.input_type == k_EUIInputElementTypeText)
+				{
+					ui_ctx.active_text_input = e->u.input.out_value;
+					ui_ctx.active_text_input[0] = 0;
+					ui_ctx.max_active_text_input_length = e->u.input.out_value_length;
+				}
+				else
+				{
+					ui_ctx.small_input_buffer[0] = 0;
+					ui_ctx.active_text_input = ui_ctx.small_input_buffer;
+					ui_ctx.max_active_text_input_length = sizeof(ui_ctx.small_input_buffer);
+				}
+				ui_ctx.input_element = e->u.input;
+				ui_ctx.active_editor = NULL;
+				ui_ctx.caret_pos = 0;
+				ui_ctx.text_input_changed = false;
+				void ui_input_clear_selection();
+				ui_input_clear_selection();
+			}
+		}
+	}
+	if(ui_ctx.numelements >= UI_VERTEX_PARALLEL_MIN_ELEMENTS && ui_vertex_pool_(&ui_ctx))
+	{
+		ui_vertex_pool_generate_(ui_ctx.vertex_pool);
+	}
+	else
+	{
+		ui_generate_vertices_(0, ui_ctx.numelements);
+	}
+	// Cursor and text input are window state, ui_submit_draw_list applies them on the thread that owns the window
+	UIDrawList *dl = ui_ctx.draw_list;
+	dl->cursor = ui_ctx.shared->default_cursor;
+	if(hovered_element)
+	{
+		//TODO: add cursor to style props
+		if(hovered_element->type == k_EUIElementTypeButton || hovered_element->type == k_EUIElementTypeCheckbox)
+		{
+			dl->cursor = ui_ctx.shared->hand_cursor;
+		}
+		else if(hovered_element->type == k_EUIElementTypeInput || hovered_element->type == k_EUIElementTypeEditor)
+		{
+			dl->cursor = ui_ctx.shared->text_cursor;
+		}
+	}
+	if(ui_clicked() && !active_element)
+	{
+		ui_ctx.input_element.input_type = k_EUIInputElementTypeInvalid;
+		ui_ctx.active_text_input = NULL;
+		ui_ctx.active_editor = NULL;
+	}
+	dl->text_input = ui_ctx.active_text_input || ui_ctx.active_editor;
+	// Published before the lock is released, a submission can't retire what this list still uses
+	SDL_LockMutex(ui_ctx.draw_mutex);
+	dl->generation = ++ui_ctx.published_generation;
+	ui_ctx.published_list = index;
+	SDL_UnlockMutex(ui_ctx.draw_mutex);
+	if(ui_ctx.submits_lists && !ui_ctx.list_unsubmitted)
+	{
+		ui_ctx.list_unsubmitted = true;
+		ui_ctx.shared->unsubmitted_lists++;
+	}
+	ui_shared_unlock_();
+}
+
+// GL state for drawing lists with the current context's buffers, returns the program
+static GLuint ui_bind_renderer_()
+{
+	GLuint program = ui_program_(k_EUIProgramDefault);
+	glUseProgram(program);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glUniform1i(glGetUniformLocation(program, "s_texture"), 0);
+	glActiveTexture(GL_TEXTURE0);
+	glDisable(GL_DEPTH_TEST);
+	if(ui_ctx.vao == 0)
+	{
+		glGenVertexArrays(1, &ui_ctx.vao);
+		ui_resource_add_(k_EUIResourceVertexArray, ui_ctx.vao, 0);
+		glBindVertexArray(ui_ctx.vao);
+		if(ui_ctx.vbo == 0)
+		{
+			glGenBuffers(1, &ui_ctx.vbo);
+			ui_resource_add_(k_EUIResourceBuffer, ui_ctx.vbo, 0);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, ui_ctx.vbo);
+
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(UIGLVertex), (void *)offsetof(UIGLVertex, position));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(UIGLVertex), (void *)offsetof(UIGLVertex, texCoord));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(UIGLVertex), (void *)offsetof(UIGLVertex, color));
+		glEnableVertexAttribArray(2);
+	}
+	glBindVertexArray(ui_ctx.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, ui_ctx.vbo);
+	return program;
+}
+
+void ui_submit_draw_list()
+{
+	SDL_LockMutex(ui_ctx.draw_mutex);
+	int index = ui_ctx.published_list;
+	ui_ctx.submitting_list = index;
+	SDL_UnlockMutex(ui_ctx.draw_mutex);
+	if(index < 0)
+		return;
+	UIDrawList *dl = &ui_ctx.draw_lists[index];
+	SDL_SetCursor(dl->cursor);
+	if(dl->text_input)
+		SDL_StartTextInput();
+	else
+		SDL_StopTextInput();
+	// Images looked up by contexts built on other threads are loaded here, the next build picks them up
+	ui_shared_lock_();
+	ui_shared_load_deferred_(ui_ctx.shared);
+	ui_shared_unlock_();
+	GLuint program = ui_bind_renderer_();
+	for(size_t i = 0; i < dl->numtiled_images; ++i)
+	{
+		ui_tiled_image_upload_(dl->tiled_images[i], dl->frame);
+	}
+	ui_draw_list_submit_(dl, program);
+
+	// Lists of this context built before the one just drawn are never submitted anymore. A list published
+	// while drawing still counts as unsubmitted, it can refer to textures and rectangles retiring would free.
+	ui_shared_lock_();
+	ui_ctx.submits_lists = true;
+	SDL_LockMutex(ui_ctx.draw_mutex);
+	bool latest = ui_ctx.published_generation == dl->generation;
+	SDL_UnlockMutex(ui_ctx.draw_mutex);
+	if(latest && ui_ctx.list_unsubmitted)
+	{
+		ui_ctx.list_unsubmitted = false;
+		ui_ctx.shared->unsubmitted_lists--;
+	}
+	else if(!latest && !ui_ctx.list_unsubmitted)
+	{
+		// Published before the first submission set submits_lists
+		ui_ctx.list_unsubmitted = true;
+		ui_ctx.shared->unsubmitted_lists++;
+	}
+	if(ui_ctx.shared->unsubmitted_lists == 0)
+		ui_shared_retire_(ui_ctx.shared);
+	ui_shared_unlock_();
+
+	SDL_LockMutex(ui_ctx.draw_mutex);
+	if(dl->input_timestamp)
+	{
+		// Measured when the GL commands are issued, the swap adds whatever the driver queues on top
+		UIInputStats *stats = &ui_ctx.input_stats;
+		stats->last_ms = (float)(SDL_GetTicks() - dl->input_timestamp);
+		stats->average_ms = stats->frames == 0 ? stats->last_ms : stats->average_ms * 0.9f + stats->last_ms * 0.1f;
+		stats->max_ms = max(stats->max_ms, stats->last_ms);
+		stats->frames++;
+		// Submitting the same list twice doesn't count twice
+		dl->input_timestamp = 0;
+	}
+	ui_ctx.submitting_list = -1;
+	SDL_CondSignal(ui_ctx.draw_cond);
+	SDL_UnlockMutex(ui_ctx.draw_mutex);
+}
+
+void ui_render()
+{
+	ui_build_draw_list();
+	ui_submit_draw_list();
+}
+
+#define UI_STREAM_MAGIC (0x53495543u) // "CUIS"
+#define UI_STREAM_READ_SIZE (64 * 1024)
+#define UI_STREAM_MAX_MESSAGE (256 * 1024 * 1024)
+#define UI_LZ_HASH_BITS (16)
+#define UI_LZ_MIN_MATCH (4)
+
+typedef enum
+{
+	k_EUIStreamMessageFrame,
+	k_EUIStreamMessageTexture,
+	k_EUIStreamMessageEvent
+} k_EUIStreamMessage;
+
+enum
+{
+	k_EUIStreamFlagDelta = 1, // LZ matches may reach back into the previous payload of the same key
+	k_EUIStreamFlagLZ = 2
+};
+
+// Fields are written in host byte order, both ends are expected to share it
+typedef struct
+{
+	uint32_t magic;
+	uint32_t type;
+	uint32_t flags;
+	uint32_t key; // Sender's texture name for texture messages
+	uint32_t raw_size;
+	uint32_t body_size;
+} UIStreamMessageHeader;
+
+typedef struct
+{
+	uint32_t frame;
+	int32_t width, height;
+	uint32_t numvertices, numcommands;
+} UIStreamFrameHeader;
+
+typedef struct
+{
+	uint32_t texture;
+	uint32_t first, count;
+	float clip[4];
+	uint32_t clipped;
+} UIStreamCommand;
+
+typedef struct
+{
+	uint32_t width, height;
+} UIStreamTextureHeader;
+
+typedef struct
+{
+	unsigned char *data;
+	size_t size, capacity;
+} UIStreamBuffer;
+
+typedef struct
+{
+	uint32_t key; // Texture name on the sending side
+	GLuint texture; // Local copy on the viewer
+	UIStreamBuffer previous; // Last payload sent or received, base of the next delta
+	size_t checked_frame;
+} UIStreamTexture;
+
+struct UIStream_s
+{
+	UIStreamTransport transport;
+	bool compress;
+	bool connected;
+	UIStreamBuffer in;
+	UIStreamBuffer scratch, encoded, readback, frame;
+	UIStreamBuffer previous_frame;
+	uint32_t *lz_table;
+	GLuint readback_fbo;
+	void *owned_userdata; // Freed with the stream
+	UIStreamTexture *textures;
+	size_t numtextures;
+	int texture_generation;
+	size_t sent_frame;
+	// Last frame received by a viewer, drawn by ui_stream_render
+	UIDrawList list;
+	bool has_frame;
+	UIStreamStats stats;
+};
+
+static void ui_stream_buffer_reserve_(UIStreamBuffer *b, size_t capacity)
+{
+	if(capacity <= b->capacity)
+		return;
+	size_t n = b->capacity == 0 ? 4096 : b->capacity;
+	while(n < capacity)
+		n *= 2;
+	b->data = realloc(b->data, n);
+	b->capacity = n;
+}
+
+static void ui_stream_buffer_append_(UIStreamBuffer *b, const void *data, size_t size)
+{
+	ui_stream_buffer_reserve_(b, b->size + size);
+	memcpy(b->data + b->size, data, size);
+	b->size += size;
+}
+
+static void ui_stream_buffer_free_(UIStreamBuffer *b)
+{
+	free(b->data);
+	memset(b, 0, sizeof(UIStreamBuffer));
+}
+
+static size_t ui_lz_bound_(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+static unsigned char *ui_lz_put_length_(unsigned char *op, size_t length)
+{
+	while(length >= 255)
+	{
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (unsigned char)length;
+	return op;
+}
+
+static size_t ui_lz_varint_size_(size_t value)
+{
+	size_t n = 1;
+	while(value >= 128)
+	{
+		value >>= 7;
+		++n;
+	}
+	return n;
+}
+
+// Length of the match between ip and position ref of dict followed by in, stopping at the end of dict
+static size_t ui_lz_match_(const unsigned char *dict, size_t dict_size, const unsigned char *in, size_t ref, const unsigned char *ip, const unsigned char *end)
+{
+	const unsigned char *r = ref < dict_size ? dict + ref : in + (ref - dict_size);
+	size_t limit = end - ip;
+	if(ref < dict_size)
+		limit = min(limit, dict_size - ref);
+	size_t n = 0;
+	while(n < limit && r[n] == ip[n])
+		++n;
+	return n;
+}
+
+static uint32_t ui_lz_hash_(const unsigned char *p)
+{
+	uint32_t seq;
+	memcpy(&seq, p, 4);
+	return (seq * 2654435761u) >> (32 - UI_LZ_HASH_BITS);
+}
+
+// LZ4 style sequences: token (literal length << 4 | match length - 4), literals, varint offset.
+// Offsets count back from the current position through in and then into dict, the previous
+// payload, so data that moved between frames still matches. The last sequence only has literals.
+// out needs ui_lz_bound_(size) bytes, table 1 << UI_LZ_HASH_BITS entries.
+static size_t ui_lz_compress_(const unsigned char *dict, size_t dict_size, const unsigned char *in, size_t size, unsigned char *out, uint32_t *table)
+{
+	memset(table, 0xff, sizeof(uint32_t) << UI_LZ_HASH_BITS);
+	for(size_t i = 0; i + UI_LZ_MIN_MATCH <= dict_size; ++i)
+		table[ui_lz_hash_(dict + i)] = (uint32_t)i;
+	const unsigned char *ip = in, *anchor = in, *end = in + size;
+	unsigned char *op = out;
+	// Unchanged data sits at the same place in the previous payload, tried before the hash
+	size_t repeat = dict_size;
+	while(ip + UI_LZ_MIN_MATCH <= end)
+	{
+		size_t pos = dict_size + (ip - in);
+		uint32_t h = ui_lz_hash_(ip);
+		size_t ref = table[h];
+		table[h] = (uint32_t)pos;
+		size_t match = 0, offset = 0;
+		if(repeat > 0 && repeat <= pos)
+		{
+			match = ui_lz_match_(dict, dict_size, in, pos - repeat, ip, end);
+			offset = repeat;
+		}
+		if(match < UI_LZ_MIN_MATCH && ref < pos)
+		{
+			match = ui_lz_match_(dict, dict_size, in, ref, ip, end);
+			offset = pos - ref;
+		}
+		// Long offsets only pay off for longer matches, which also keeps the output within ui_lz_bound_
+		if(match < UI_LZ_MIN_MATCH || match < ui_lz_varint_size_(offset) + 2)
+		{
+			++ip;
+			continue;
+		}
+		size_t literals = ip - anchor;
+		size_t m = match - UI_LZ_MIN_MATCH;
+		*op++ = (unsigned char)((min(literals, 15) << 4) | min(m, 15));
+		if(literals >= 15)
+			op = ui_lz_put_length_(op, literals - 15);
+		memcpy(op, anchor, literals);
+		op += literals;
+		for(size_t v = offset; ; v >>= 7)
+		{
+			*op++ = (unsigned char)((v & 127) | (v >= 128 ? 128 : 0));
+			if(v < 128)
+				break;
+		}
+		if(m >= 15)
+			op = ui_lz_put_length_(op, m - 15);
+		repeat = offset;
+		ip += match;
+		anchor = ip;
+	}
+	size_t literals = end - anchor;
+	*op++ = (unsigned char)(min(literals, 15) << 4);
+	if(literals >= 15)
+		op = ui_lz_put_length_(op, literals - 15);
+	memcpy(op, anchor, literals);
+	op += literals;
+	return op - out;
+}
+
+static bool ui_lz_get_length_(const unsigned char **ip, const unsigned char *end, size_t *length)
+{
+	unsigned char b;
+	do
+	{
+		if(*ip >= end)
+			return false;
+		b = *(*ip)++;
+		*length += b;
+	} while(b == 255);
+	return true;
+}
+
+static bool ui_lz_get_varint_(const unsigned char **ip, const unsigned char *end, size_t *value)
+{
+	*value = 0;
+	for(int shift = 0; shift < 35; shift += 7)
+	{
+		if(*ip >= end)
+			return false;
+		unsigned char b = *(*ip)++;
+		*value |= (size_t)(b & 127) << shift;
+		if(!(b & 128))
+			return true;
+	}
+	return false;
+}
+
+// Decodes exactly size bytes against the same dict the sender used, false on malformed input
+static bool ui_lz_decompress_(const unsigned char *dict, size_t dict_size, const unsigned char *in, size_t in_size, unsigned char *out, size_t size)
+{
+	const unsigned char *ip = in, *end = in + in_size;
+	unsigned char *op = out, *out_end = out + size;
+	while(ip < end)
+	{
+		unsigned char token = *ip++;
+		size_t literals = token >> 4;
+		if(literals == 15 && !ui_lz_get_length_(&ip, end, &literals))
+			return false;
+		if(literals > (size_t)(end - ip) || literals > (size_t)(out_end - op))
+			return false;
+		memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+		if(ip == end)
+			break;
+		size_t offset;
+		if(!ui_lz_get_varint_(&ip, end, &offset))
+			return false;
+		size_t match = token & 15;
+		if(match == 15 && !ui_lz_get_length_(&ip, end, &match))
+			return false;
+		match += UI_LZ_MIN_MATCH;
+		size_t done = op - out;
+		if(offset == 0 || offset > done + dict_size || match > (size_t)(out_end - op))
+			return false;
+		if(offset > done)
+		{
+			// Starts in dict, whatever is left continues at the start of out
+			size_t from = dict_size - (offset - done);
+			size_t n = min(match, dict_size - from);
+			memcpy(op, dict + from, n);
+			op += n;
+			match -= n;
+		}
+		// Byte by byte, the match may overlap what it writes
+		const unsigned char *ref = op - offset;
+		for(size_t i = 0; i < match; ++i)
+			op[i] = ref[i];
+		op += match;
+	}
+	return op == out_end;
+}
+
+static bool ui_stream_write_(UIStream *stream, const void *data, size_t size)
+{
+	const unsigned char *p = data;
+	while(stream->connected && size > 0)
+	{
+		int n = stream->transport.write(stream->transport.userdata, p, size);
+		if(n < 0)
+			stream->connected = false;
+		else
+		{
+			p += n;
+			size -= n;
+		}
+	}
+	return stream->connected;
+}
+
+// Sends raw compressed against previous when compressing, previous then holds raw for the next one
+static bool ui_stream_send_(UIStream *stream, k_EUIStreamMessage type, uint32_t key, const unsigned char *raw, size_t size, UIStreamBuffer *previous)
+{
+	UIStreamMessageHeader header = { UI_STREAM_MAGIC, type, 0, key, (uint32_t)size, (uint32_t)size };
+	const unsigned char *body = raw;
+	if(stream->compress)
+	{
+		if(!stream->lz_table)
+			stream->lz_table = malloc(sizeof(uint32_t) << UI_LZ_HASH_BITS);
+		const unsigned char *dict = previous ? previous->data : NULL;
+		size_t dict_size = previous ? previous->size : 0;
+		ui_stream_buffer_reserve_(&stream->encoded, ui_lz_bound_(size));
+		size_t encoded = ui_lz_compress_(dict, dict_size, raw, size, stream->encoded.data, stream->lz_table);
+		if(encoded < size)
+		{
+			header.flags |= k_EUIStreamFlagLZ | (dict_size > 0 ? k_EUIStreamFlagDelta : 0);
+			header.body_size = (uint32_t)encoded;
+			body = stream->encoded.data;
+		}
+	}
+	if(previous)
+	{
+		previous->size = 0;
+		ui_stream_buffer_append_(previous, raw, size);
+	}
+	stream->stats.raw_bytes += sizeof(header) + size;
+	stream->stats.sent_bytes += sizeof(header) + header.body_size;
+	return ui_stream_write_(stream, &header, sizeof(header)) && ui_stream_write_(stream, body, header.body_size);
+}
+
+static UIStreamTexture *ui_stream_texture_(UIStream *stream, uint32_t key, bool *out_added)
+{
+	*out_added = false;
+	for(size_t i = 0; i < stream->numtextures; ++i)
+	{
+		if(stream->textures[i].key == key)
+			return &stream->textures[i];
+	}
+	stream->textures = realloc(stream->textures, sizeof(UIStreamTexture) * (stream->numtextures + 1));
+	UIStreamTexture *t = &stream->textures[stream->numtextures++];
+	memset(t, 0, sizeof(UIStreamTexture));
+	t->key = key;
+	t->checked_frame = (size_t)-1;
+	*out_added = true;
+	return t;
+}
+
+// GLES 3.0 has no glGetTexImage, the texture is attached to a framebuffer and read with glReadPixels.
+// Formats that can't be attached (ETC2) are drawn into an RGBA8 texture first.
+static bool ui_stream_read_texture_(UIStream *stream, GLuint texture, int w, int h, unsigned char *out)
+{
+	if(stream->readback_fbo == 0)
+		glGenFramebuffers(1, &stream->readback_fbo);
+	GLint previous_fbo = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, stream->readback_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	GLuint copy = 0;
+	bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if(!ok)
+	{
+		glGenTextures(1, &copy);
+		glBindTexture(GL_TEXTURE_2D, copy);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, copy, 0);
+		ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if(ok)
+		{
+			// glReadPixels starts at the bottom row, which the projection puts at y = h, so v runs upwards
+			UIGLVertex quad[6] = { { { 0.f, 0.f }, { 0.f, 1.f }, { 255, 255, 255, 255 } },
+								   { { (float)w, 0.f }, { 1.f, 1.f }, { 255, 255, 255, 255 } },
+								   { { (float)w, (float)h }, { 1.f, 0.f }, { 255, 255, 255, 255 } },
+								   { { 0.f, 0.f }, { 0.f, 1.f }, { 255, 255, 255, 255 } },
+								   { { (float)w, (float)h }, { 1.f, 0.f }, { 255, 255, 255, 255 } },
+								   { { 0.f, (float)h }, { 0.f, 0.f }, { 255, 255, 255, 255 } } };
+			UIDrawCommand cmd = { texture, 0, 6, { 0.f, 0.f, 0.f, 0.f }, false };
+			UIDrawList dl = { 0 };
+			dl.vertices = quad;
+			dl.numvertices = 6;
+			dl.commands = &cmd;
+			dl.numcommands = 1;
+			dl.width = w;
+			dl.height = h;
+			GLint viewport[4];
+			glGetIntegerv(GL_VIEWPORT, viewport);
+			glViewport(0, 0, w, h);
+			GLuint program = ui_bind_renderer_();
+			// Alpha is copied, not blended
+			glDisable(GL_BLEND);
+			ui_draw_list_submit_(&dl, program);
+			glEnable(GL_BLEND);
+			glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		}
+	}
+	if(ok)
+	{
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, out);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previous_fbo);
+	if(copy)
+		glDeleteTextures(1, &copy);
+	return ok;
+}
+
+// Reads the texture back and sends it if it differs from what the viewer has
+static bool ui_stream_sync_texture_(UIStream *stream, UIStreamTexture *t)
+{
+	// Only textures the library created have known dimensions, others stay white on the viewer
+	int w = 0, h = 0;
+	ui_shared_lock_();
+	UIResource *res = ui_resource_find_(k_EUIResourceTexture, t->key);
+	if(res)
+	{
+		w = res->width;
+		h = res->height;
+	}
+	ui_shared_unlock_();
+	if(w <= 0 || h <= 0)
+		return stream->connected;
+	UIStreamBuffer *payload = &stream->readback;
+	UIStreamTextureHeader th = { (uint32_t)w, (uint32_t)h };
+	payload->size = sizeof(th) + (size_t)w * h * 4;
+	ui_stream_buffer_reserve_(payload, payload->size);
+	memcpy(payload->data, &th, sizeof(th));
+	if(!ui_stream_read_texture_(stream, t->key, w, h, payload->data + sizeof(th)))
+		return stream->connected;
+	if(t->previous.size == payload->size && !memcmp(t->previous.data, payload->data, payload->size))
+		return stream->connected;
+	stream->stats.textures++;
+	return ui_stream_send_(stream, k_EUIStreamMessageTexture, t->key, payload->data, payload->size, &t->previous);
+}
+
+bool ui_stream_send_frame(UIStream *stream)
+{
+	SDL_LockMutex(ui_ctx.draw_mutex);
+	int index = ui_ctx.published_list;
+	SDL_UnlockMutex(ui_ctx.draw_mutex);
+	if(index < 0 || !stream->connected)
+		return stream->connected;
+	UIDrawList *dl = &ui_ctx.draw_lists[index];
+	if(dl->frame == stream->sent_frame)
+		return true;
+	stream->sent_frame = dl->frame;
+	// Headless senders never call ui_submit_draw_list, tiles have to reach the GPU to be read back. Otherwise
+	// the submission uploads them and the new texture generation sends them with a later frame.
+	ui_shared_lock_();
+	bool headless = !ui_ctx.submits_lists;
+	ui_shared_unlock_();
+	if(headless && ui_on_gl_thread_())
+	{
+		for(size_t i = 0; i < dl->numtiled_images; ++i)
+		{
+			ui_tiled_image_upload_(dl->tiled_images[i], dl->frame);
+		}
+	}
+
+	// Textures first, the viewer needs them when the frame arrives. Known ones are only
+	// read back again after some texture was uploaded to.
+	int generation = SDL_AtomicGet(&ui_texture_generation_);
+	bool uploaded = generation != stream->texture_generation;
+	stream->texture_generation = generation;
+	for(size_t i = 0; i < dl->numcommands; ++i)
+	{
+		bool added;
+		UIStreamTexture *t = ui_stream_texture_(stream, dl->commands[i].texture, &added);
+		if((added || uploaded) && t->checked_frame != dl->frame)
+		{
+			t->checked_frame = dl->frame;
+			if(!ui_stream_sync_texture_(stream, t))
+				return false;
+		}
+	}
+
+	UIStreamBuffer *raw = &stream->frame;
+	raw->size = 0;
+	UIStreamFrameHeader fh = { (uint32_t)dl->frame, dl->width, dl->height, (uint32_t)dl->numvertices, (uint32_t)dl->numcommands };
+	ui_stream_buffer_append_(raw, &fh, sizeof(fh));
+	ui_stream_buffer_append_(raw, dl->vertices, sizeof(UIGLVertex) * dl->numvertices);
+	for(size_t i = 0; i < dl->numcommands; ++i)
+	{
+		UIDrawCommand *cmd = &dl->commands[i];
+		UIStreamCommand sc = { cmd->texture,
+							   (uint32_t)cmd->first,
+							   (uint32_t)cmd->count,
+							   { cmd->clip.x, cmd->clip.y, cmd->clip.w, cmd->clip.h },
+							   cmd->clipped };
+		ui_stream_buffer_append_(raw, &sc, sizeof(sc));
+	}
+	stream->stats.frames++;
+	return ui_stream_send_(stream, k_EUIStreamMessageFrame, 0, raw->data, raw->size, &stream->previous_frame);
+}
+
+bool ui_stream_send_event(UIStream *stream, const SDL_Event *ev)
+{
+	if(!stream->connected)
+		return false;
+	SDL_Event copy = *ev;
+	switch(copy.type)
+	{
+		case SDL_MOUSEMOTION:
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+			// Into the sender's coordinates when the viewer window has a different size
+			if(stream->has_frame && ui_ctx.width > 0 && ui_ctx.height > 0)
+			{
+				float sx = (float)stream->list.width / ui_ctx.width, sy = (float)stream->list.height / ui_ctx.height;
+				if(copy.type == SDL_MOUSEMOTION)
+				{
+					copy.motion.x = (int)(copy.motion.x * sx);
+					copy.motion.y = (int)(copy.motion.y * sy);
+				}
+				else
+				{
+					copy.button.x = (int)(copy.button.x * sx);
+					copy.button.y = (int)(copy.button.y * sy);
+				}
+			}
+			break;
+		case SDL_MOUSEWHEEL:
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+		case SDL_TEXTINPUT:
+			break;
+		default:
+			// Others may carry pointers or mean nothing to the sender
+			return true;
+	}
+	return ui_stream_send_(stream, k_EUIStreamMessageEvent, 0, (const unsigned char *)&copy, sizeof(copy), NULL);
+}
+
+static bool ui_stream_decode_(UIStream *stream, const UIStreamMessageHeader *header, const unsigned char *body, UIStreamBuffer *previous)
+{
+	UIStreamBuffer *raw = &stream->scratch;
+	raw->size = header->raw_size;
+	ui_stream_buffer_reserve_(raw, raw->size);
+	if(header->flags & k_EUIStreamFlagLZ)
+	{
+		bool delta = (header->flags & k_EUIStreamFlagDelta) != 0;
+		if(delta && !previous)
+			return false;
+		if(!ui_lz_decompress_(delta ? previous->data : NULL, delta ? previous->size : 0, body, header->body_size, raw->data, raw->size))
+			return false;
+	}
+	else
+	{
+		if(header->body_size != header->raw_size || (header->flags & k_EUIStreamFlagDelta))
+			return false;
+		memcpy(raw->data, body, raw->size);
+	}
+	if(previous)
+	{
+		previous->size = 0;
+		ui_stream_buffer_append_(previous, raw->data, raw->size);
+	}
+	return true;
+}
+
+static bool ui_stream_receive_texture_(UIStreamTexture *t, const UIStreamBuffer *raw)
+{
+	UIStreamTextureHeader th;
+	if(raw->size < sizeof(th))
+		return false;
+	memcpy(&th, raw->data, sizeof(th));
+	if(raw->size != sizeof(th) + (size_t)th.width * th.height * 4)
+		return false;
+	if(t->texture == 0)
+	{
+		glGenTextures(1, &t->texture);
+		ui_resource_add_(k_EUIResourceTexture, t->texture, 0);
+		glBindTexture(GL_TEXTURE_2D, t->texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, t->texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, th.width, th.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, raw->data + sizeof(th));
+	ui_resource_resize_(k_EUIResourceTexture, t->texture, (size_t)th.width * th.height * 4);
+	return true;
+}
+
+static bool ui_stream_receive_frame_(UIStream *stream, const UIStreamBuffer *raw)
+{
+	UIStreamFrameHeader fh;
+	if(raw->size < sizeof(fh))
+		return false;
+	memcpy(&fh, raw->data, sizeof(fh));
+	size_t vertices_size = sizeof(UIGLVertex) * fh.numvertices;
+	if(raw->size != sizeof(fh) + vertices_size + sizeof(UIStreamCommand) * fh.numcommands)
+		return false;
+	UIDrawList *dl = &stream->list;
+	if(fh.numvertices > dl->maxvertices)
+	{
+		dl->maxvertices = fh.numvertices;
+		dl->vertices = realloc(dl->vertices, vertices_size);
+	}
+	if(fh.numcommands > dl->maxcommands)
+	{
+		dl->maxcommands = fh.numcommands;
+		dl->commands = realloc(dl->commands, sizeof(UIDrawCommand) * fh.numcommands);
+	}
+	memcpy(dl->vertices, raw->data + sizeof(fh), vertices_size);
+	const unsigned char *p = raw->data + sizeof(fh) + vertices_size;
+	for(uint32_t i = 0; i < fh.numcommands; ++i, p += sizeof(UIStreamCommand))
+	{
+		UIStreamCommand sc;
+		memcpy(&sc, p, sizeof(sc));
+		if(sc.first + sc.count > fh.numvertices || sc.first + sc.count < sc.first)
+			return false;
+		bool added;
+		UIStreamTexture *t = ui_stream_texture_(stream, sc.texture, &added);
+		UIDrawCommand *cmd = &dl->commands[i];
+		cmd->texture = t->texture ? t->texture : ui_ctx.white_texture;
+		cmd->first = sc.first;
+		cmd->count = sc.count;
+		cmd->clip = (UIRectangle) { sc.clip[0], sc.clip[1], sc.clip[2], sc.clip[3] };
+		cmd->clipped = sc.clipped != 0;
+	}
+	dl->numvertices = fh.numvertices;
+	dl->numcommands = fh.numcommands;
+	dl->width = fh.width;
+	dl->height = fh.height;
+	dl->frame = fh.frame;
+	stream->has_frame = true;
+	stream->stats.frames++;
+	return true;
+}
+
+bool ui_stream_poll(UIStream *stream)
+{
+	bool new_frame = false;
+	while(stream->connected)
+	{
+		ui_stream_buffer_reserve_(&stream->in, stream->in.size + UI_STREAM_READ_SIZE);
+		int n = stream->transport.read(stream->transport.userdata, stream->in.data + stream->in.size, UI_STREAM_READ_SIZE);
+		if(n < 0)
+			stream->connected = false;
+		if(n <= 0)
+			break;
+		stream->in.size += n;
+	}
+	size_t offset = 0;
+	UIStreamMessageHeader header;
+	while(stream->in.size - offset >= sizeof(header))
+	{
+		memcpy(&header, stream->in.data + offset, sizeof(header));
+		if(header.magic != UI_STREAM_MAGIC || header.raw_size > UI_STREAM_MAX_MESSAGE || header.body_size > UI_STREAM_MAX_MESSAGE)
+		{
+			// Out of sync, nothing after this can be trusted
+			stream->connected = false;
+			break;
+		}
+		if(stream->in.size - offset - sizeof(header) < header.body_size)
+			break;
+		const unsigned char *body = stream->in.data + offset + sizeof(header);
+		offset += sizeof(header) + header.body_size;
+		stream->stats.raw_bytes += sizeof(header) + header.raw_size;
+		stream->stats.received_bytes += sizeof(header) + header.body_size;
+		bool ok = false;
+		switch(header.type)
+		{
+			case k_EUIStreamMessageFrame:
+				ok = ui_stream_decode_(stream, &header, body, &stream->previous_frame)
+					 && ui_stream_receive_frame_(stream, &stream->previous_frame);
+				new_frame |= ok;
+				break;
+			case k_EUIStreamMessageTexture:
+			{
+				bool added;
+				UIStreamTexture *t = ui_stream_texture_(stream, header.key, &added);
+				ok = ui_stream_decode_(stream, &header, body, &t->previous)
+					 && ui_stream_receive_texture_(t, &t->previous);
+				stream->stats.textures += ok;
+			} break;
+			case k_EUIStreamMessageEvent:
+			{
+				SDL_Event ev;
+				ok = ui_stream_decode_(stream, &header, body, NULL) && stream->scratch.size == sizeof(ev);
+				if(ok)
+				{
+					memcpy(&ev, stream->scratch.data, sizeof(ev));
+					// The viewer's clock means nothing here, latency is measured from arrival
+					ev.common.timestamp = SDL_GetTicks();
+					ui_event(&ev);
+				}
+			} break;
+		}
+		if(!ok)
+		{
+			stream->connected = false;
+			break;
+		}
+	}
+	memmove(stream->in.data, stream->in.data + offset, stream->in.size - offset);
+	stream->in.size -= offset;
+	return new_frame;
+}
+
+void ui_stream_render(UIStream *stream)
+{
+	if(!stream->has_frame)
+		return;
+	GLuint program = ui_bind_renderer_();
+	ui_draw_list_submit_(&stream->list, program);
+}
+
+UIStream *ui_create_stream(const UIStreamTransport *transport, bool compress)
+{
+	UIStream *stream = calloc(1, sizeof(UIStream));
+	stream->transport = *transport;
+	stream->compress = compress;
+	stream->connected = true;
+	stream->sent_frame = (size_t)-1;
+	stream->texture_generation = SDL_AtomicGet(&ui_texture_generation_);
+	return stream;
+}
+
+void ui_destroy_stream(UIStream *stream)
+{
+	for(size_t i = 0; i < stream->numtextures; ++i)
+	{
+		UIStreamTexture *t = &stream->textures[i];
+		if(t->texture)
+		{
+			ui_resource_remove_(k_EUIResourceTexture, t->texture);
+			glDeleteTextures(1, &t->texture);
+		}
+		ui_stream_buffer_free_(&t->previous);
+	}
+	free(stream->textures);
+	ui_stream_buffer_free_(&stream->in);
+	ui_stream_buffer_free_(&stream->scratch);
+	ui_stream_buffer_free_(&stream->encoded);
+	ui_stream_buffer_free_(&stream->readback);
+	ui_stream_buffer_free_(&stream->frame);
+	ui_stream_buffer_free_(&stream->previous_frame);
+	free(stream->lz_table);
+	if(stream->readback_fbo)
+		glDeleteFramebuffers(1, &stream->readback_fbo);
+	free(stream->list.vertices);
+	free(stream->list.commands);
+	free(stream->owned_userdata);
+	free(stream);
+}
+
+void ui_stream_stats(UIStream *stream, UIStreamStats *out_stats)
+{
+	*out_stats = stream->stats;
+}
+
+// Software backend, draws a list into an RGBA8 buffer. Textures are sampled from the atlas pages'
+// CPU copies, anything else has no pixels on this side and is drawn with the vertex color only,
+// UIFrameSlot.untextured counts those commands.
+typedef struct
+{
+	unsigned char *pixels;
+	int width, height, stride;
+} UISoftwareTarget;
+
+typedef struct
+{
+	const unsigned char *pixels;
+	int width, height;
+} UISoftwareTexture;
+
+static void ui_software_texture_(GLuint texture, UISoftwareTexture *out)
+{
+	out->pixels = NULL;
+	for(size_t i = 0; i < ui_ctx.shared->atlas.numpages; ++i)
+	{
+		if(ui_ctx.shared->atlas.pages[i].gl_texture == texture)
+		{
+			out->pixels = ui_ctx.shared->atlas.pages[i].pixels;
+			out->width = out->height = UI_ATLAS_PAGE_SIZE;
+			return;
+		}
+	}
+}
+
+// Nearest texel modulated by the vertex color, then blended like glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+static void ui_software_blend_(unsigned char *dst, const unsigned char *color, const UISoftwareTexture *tex, float s, float t)
+{
+	unsigned int c[4] = { color[0], color[1], color[2], color[3] };
+	if(tex->pixels)
+	{
+		int x = (int)(s * tex->width), y = (int)(t * tex->height);
+		x = x < 0 ? 0 : (x >= tex->width ? tex->width - 1 : x);
+		y = y < 0 ? 0 : (y >= tex->height ? tex->height - 1 : y);
+		const unsigned char *texel = tex->pixels + ((size_t)y * tex->width + x) * 4;
+		for(int i = 0; i < 4; ++i)
+			c[i] = (c[i] * texel[i] + 127) / 255;
+	}
+	unsigned int a = c[3], ia = 255 - a;
+	for(int i = 0; i < 4; ++i)
+		dst[i] = (unsigned char)((c[i] * a + dst[i] * ia + 127) / 255);
+}
+
+// Pixels whose centers lie inside, the same coverage the GPU gives the two triangles
+static void ui_software_rect_(const UISoftwareTarget *target, const UIFrameRect *clip, const UIGLVertex *v, const UISoftwareTexture *tex)
+{
+	float x0 = v[0].position[0], y0 = v[0].position[1], x1 = v[4].position[0], y1 = v[4].position[1];
+	int px0 = max(clip->x, (int)ceilf(x0 - 0.5f)), px1 = min(clip->x + clip->w, (int)ceilf(x1 - 0.5f));
+	int py0 = max(clip->y, (int)ceilf(y0 - 0.5f)), py1 = min(clip->y + clip->h, (int)ceilf(y1 - 0.5f));
+	if(px0 >= px1 || py0 >= py1 || v[0].color[3] == 0)
+		return;
+	float ds = (v[4].texCoord[0] - v[0].texCoord[0]) / (x1 - x0);
+	float dt = (v[4].texCoord[1] - v[0].texCoord[1]) / (y1 - y0);
+	for(int y = py0; y < py1; ++y)
+	{
+		unsigned char *row = target->pixels + (size_t)y * target->stride;
+		float t = v[0].texCoord[1] + (y + 0.5f - y0) * dt;
+		for(int x = px0; x < px1; ++x)
+		{
+			float s = v[0].texCoord[0] + (x + 0.5f - x0) * ds;
+			ui_software_blend_(row + x * 4, v[0].color, tex, s, t);
+		}
+	}
+}
+
+// Evaluated from the same endpoint either way round, so a shared edge gives exactly opposite values
+static float ui_software_edge_(const float *a, const float *b, float x, float y)
+{
+	if(a[0] > b[0] || (a[0] == b[0] && a[1] > b[1]))
+		return -((a[0] - b[0]) * (y - b[1]) - (a[1] - b[1]) * (x - b[0]));
+	return (b[0] - a[0]) * (y - a[1]) - (b[1] - a[1]) * (x - a[0]);
+}
+
+// Top-left rule, a pixel on an edge shared by two triangles is only drawn once
+static bool ui_software_edge_inside_(float w, const float *a, const float *b)
+{
+	if(w != 0.f)
+		return w > 0.f;
+	float dx = b[0] - a[0], dy = b[1] - a[1];
+	return dy < 0.f || (dy == 0.f && dx > 0.f);
+}
+
+static void ui_software_triangle_(const UISoftwareTarget *target, const UIFrameRect *clip, const UIGLVertex *in, const UISoftwareTexture *tex)
+{
+	// The edge functions below want one winding, flip the others
+	UIGLVertex v[3] = { in[0], in[1], in[2] };
+	float area = ui_software_edge_(v[0].position, v[1].position, v[2].position[0], v[2].position[1]);
+	if(area == 0.f)
+		return;
+	if(area < 0.f)
+	{
+		UIGLVertex tmp = v[1];
+		v[1] = v[2];
+		v[2] = tmp;
+		area = -area;
+	}
+	const float *p0 = v[0].position, *p1 = v[1].position, *p2 = v[2].position;
+	bool flat = !memcmp(v[0].color, v[1].color, 4) && !memcmp(v[0].color, v[2].color, 4);
+	int x0 = max(clip->x, (int)floorf(min(p0[0], min(p1[0], p2[0])))), x1 = min(clip->x + clip->w, (int)ceilf(max(p0[0], max(p1[0], p2[0]))));
+	int y0 = max(clip->y, (int)floorf(min(p0[1], min(p1[1], p2[1])))), y1 = min(clip->y + clip->h, (int)ceilf(max(p0[1], max(p1[1], p2[1]))));
+	for(int y = y0; y < y1; ++y)
+	{
+		unsigned char *row = target->pixels + (size_t)y * target->stride;
+		float py = y + 0.5f;
+		for(int x = x0; x < x1; ++x)
+		{
+			float px = x + 0.5f;
+			float w0 = ui_software_edge_(p1, p2, px, py);
+			float w1 = ui_software_edge_(p2, p0, px, py);
+			float w2 = ui_software_edge_(p0, p1, px, py);
+			if(!ui_software_edge_inside_(w0, p1, p2) || !ui_software_edge_inside_(w1, p2, p0) || !ui_software_edge_inside_(w2, p0, p1))
+				continue;
+			w0 /= area;
+			w1 /= area;
+			w2 /= area;
+			unsigned char color[4];
+			for(int i = 0; i < 4; ++i)
+				color[i] = flat ? v[0].color[i] : (unsigned char)(w0 * v[0].color[i] + w1 * v[1].color[i] + w2 * v[2].color[i] + 0.5f);
+			float s = w0 * v[0].texCoord[0] + w1 * v[1].texCoord[0] + w2 * v[2].texCoord[0];
+			float t = w0 * v[0].texCoord[1] + w1 * v[1].texCoord[1] + w2 * v[2].texCoord[1];
+			ui_software_blend_(row + x * 4, color, tex, s, t);
+		}
+	}
+}
+
+// Two triangles as emitted by ui_draw_rect_, untransformed and with a single color
+static bool ui_software_is_rect_(const UIGLVertex *v)
+{
+	return v[0].position[1] == v[1].position[1] && v[0].position[0] == v[2].position[0]
+		   && !memcmp(&v[1], &v[3], sizeof(UIGLVertex)) && !memcmp(&v[2], &v[5], sizeof(UIGLVertex))
+		   && v[4].position[0] == v[1].position[0] && v[4].position[1] == v[2].position[1]
+		   && !memcmp(v[0].color, v[4].color, 4) && !memcmp(v[0].color, v[1].color, 4) && !memcmp(v[0].color, v[2].color, 4);
+}
+
+// Only pixels inside region are touched
+static void ui_software_draw_list_(const UIDrawList *dl, const UISoftwareTarget *target, const UIFrameRect *region)
+{
+	for(size_t i = 0; i < dl->numcommands; ++i)
+	{
+		const UIDrawCommand *cmd = &dl->commands[i];
+		UIFrameRect clip = *region;
+		if(cmd->clipped)
+		{
+			int cx0 = (int)floorf(cmd->clip.x), cy0 = (int)floorf(cmd->clip.y);
+			int cx1 = (int)ceilf(cmd->clip.x + cmd->clip.w), cy1 = (int)ceilf(cmd->clip.y + cmd->clip.h);
+			int x0 = max(clip.x, cx0), y0 = max(clip.y, cy0);
+			clip.w = min(clip.x + clip.w, cx1) - x0;
+			clip.h = min(clip.y + clip.h, cy1) - y0;
+			clip.x = x0;
+			clip.y = y0;
+			if(clip.w <= 0 || clip.h <= 0)
+				continue;
+		}
+		UISoftwareTexture tex;
+		ui_software_texture_(cmd->texture, &tex);
+		const UIGLVertex *v = dl->vertices + cmd->first, *end = v + cmd->count;
+		while(v + 3 <= end)
+		{
+			if(v + 6 <= end && ui_software_is_rect_(v))
+			{
+				ui_software_rect_(target, &clip, v, &tex);
+				v += 6;
+			}
+			else
+			{
+				ui_software_triangle_(target, &clip, v, &tex);
+				v += 3;
+			}
+		}
+	}
+}
+
+#ifndef _WIN32
+struct UIFrameRing_s
+{
+	int fd;
+	char name[256]; // Unlinked on destroy, empty for anonymous rings
+	UIFrameRingHeader *header;
+	size_t size;
+	unsigned int sequence; // Frames written
+	size_t written_frame;
+	UIFrameRect stale[UI_FRAME_RING_MAX_SLOTS]; // Changed since the slot was last written
+	int texture_generation;
+	// Previous list, dirty rectangles come from comparing against it
+	UIGLVertex *vertices;
+	size_t numvertices, maxvertices;
+	UIDrawCommand *commands;
+	size_t numcommands, maxcommands;
+};
+
+static void ui_frame_rect_union_(UIFrameRect *r, const UIFrameRect *o)
+{
+	if(o->w <= 0 || o->h <= 0)
+		return;
+	if(r->w <= 0 || r->h <= 0)
+	{
+		*r = *o;
+		return;
+	}
+	int x1 = max(r->x + r->w, o->x + o->w), y1 = max(r->y + r->h, o->y + o->h);
+	r->x = min(r->x, o->x);
+	r->y = min(r->y, o->y);
+	r->w = x1 - r->x;
+	r->h = y1 - r->y;
+}
+
+static void ui_frame_rect_add_triangle_(UIFrameRect *r, const UIGLVertex *v)
+{
+	float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+	for(int i = 0; i < 3; ++i)
+	{
+		x0 = min(x0, v[i].position[0]);
+		y0 = min(y0, v[i].position[1]);
+		x1 = max(x1, v[i].position[0]);
+		y1 = max(y1, v[i].position[1]);
+	}
+	UIFrameRect t = { (int)floorf(x0), (int)floorf(y0), (int)ceilf(x1) - (int)floorf(x0) + 1, (int)ceilf(y1) - (int)floorf(y0) + 1 };
+	ui_frame_rect_union_(r, &t);
+}
+
+static void ui_frame_rect_add_vertices_(UIFrameRect *r, const UIGLVertex *v, size_t count)
+{
+	for(size_t i = 0; i + 3 <= count; i += 3)
+		ui_frame_rect_add_triangle_(r, v + i);
+}
+
+static bool ui_frame_ring_atlas_texture_(GLuint texture)
+{
+	for(size_t i = 0; i < ui_ctx.shared->atlas.numpages; ++i)
+	{
+		if(ui_ctx.shared->atlas.pages[i].gl_texture == texture)
+			return true;
+	}
+	return false;
+}
+
+// Bounds of the triangles that differ from the previous list. Commands are paired in order and their
+// triangles compared from the start of each command, so a change only dirties the command it is in.
+static UIFrameRect ui_frame_ring_dirty_(UIFrameRing *ring, const UIDrawList *dl)
+{
+	UIFrameRect full = { 0, 0, (int)ring->header->width, (int)ring->header->height };
+	int generation = SDL_AtomicGet(&ui_texture_generation_);
+	bool textures_changed = generation != ring->texture_generation;
+	ring->texture_generation = generation;
+	if(ring->sequence == 0)
+		return full;
+	UIFrameRect dirty = { 0 };
+	size_t common = min(dl->numcommands, ring->numcommands);
+	for(size_t i = 0; i < common; ++i)
+	{
+		const UIDrawCommand *a = &dl->commands[i], *b = &ring->commands[i];
+		const UIGLVertex *va = dl->vertices + a->first, *vb = ring->vertices + b->first;
+		// Only atlas pages are sampled here, other uploads can't change what was rasterized
+		bool resampled = textures_changed && ui_frame_ring_atlas_texture_(a->texture);
+		if(resampled || a->texture != b->texture || a->clipped != b->clipped || (a->clipped && memcmp(&a->clip, &b->clip, sizeof(UIRectangle))))
+		{
+			ui_frame_rect_add_vertices_(&dirty, va, a->count);
+			ui_frame_rect_add_vertices_(&dirty, vb, b->count);
+			continue;
+		}
+		size_t n = min(a->count, b->count) / 3 * 3;
+		for(size_t k = 0; k < n; k += 3)
+		{
+			if(memcmp(va + k, vb + k, sizeof(UIGLVertex) * 3))
+			{
+				ui_frame_rect_add_triangle_(&dirty, va + k);
+				ui_frame_rect_add_triangle_(&dirty, vb + k);
+			}
+		}
+		ui_frame_rect_add_vertices_(&dirty, va + n, a->count - n);
+		ui_frame_rect_add_vertices_(&dirty, vb + n, b->count - n);
+	}
+	for(size_t i = common; i < dl->numcommands; ++i)
+		ui_frame_rect_add_vertices_(&dirty, dl->vertices + dl->commands[i].first, dl->commands[i].count);
+	for(size_t i = common; i < ring->numcommands; ++i)
+		ui_frame_rect_add_vertices_(&dirty, ring->vertices + ring->commands[i].first, ring->commands[i].count);
+	// Clamp to the frame
+	int x0 = max(dirty.x, 0), y0 = max(dirty.y, 0);
+	int x1 = min(dirty.x + dirty.w, full.w), y1 = min(dirty.y + dirty.h, full.h);
+	if(x0 >= x1 || y0 >= y1)
+		return (UIFrameRect) { 0, 0, 0, 0 };
+	return (UIFrameRect) { x0, y0, x1 - x0, y1 - y0 };
+}
+
+UIFrameRing *ui_create_frame_ring(const char *name, int width, int height, int numslots)
+{
+	if(width <= 0 || height <= 0 || numslots <= 0 || numslots > UI_FRAME_RING_MAX_SLOTS)
+		return NULL;
+	UIFrameRing *ring = calloc(1, sizeof(UIFrameRing));
+	if(name)
+	{
+		snprintf(ring->name, sizeof(ring->name), "%s", name);
+		ring->fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+	}
+	else
+	{
+		// Anonymous, the name only lives until it is unlinked right away. Pass the fd on to share it.
+		char tmp[64];
+		snprintf(tmp, sizeof(tmp), "/ui_frames_%d_%p", (int)getpid(), (void *)ring);
+		ring->fd = shm_open(tmp, O_CREAT | O_EXCL | O_RDWR, 0600);
+		if(ring->fd >= 0)
+			shm_unlink(tmp);
+	}
+	if(ring->fd < 0)
+	{
+		free(ring);
+		return NULL;
+	}
+	// Pixels of every slot start on a page boundary
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t header_size = (sizeof(UIFrameRingHeader) + page - 1) / page * page;
+	size_t stride = (size_t)width * 4;
+	size_t slot_size = (stride * height + page - 1) / page * page;
+	ring->size = header_size + slot_size * numslots;
+	if(ftruncate(ring->fd, (off_t)ring->size) != 0)
+	{
+		ui_destroy_frame_ring(ring);
+		return NULL;
+	}
+	void *base = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+	if(base == MAP_FAILED)
+	{
+		ui_destroy_frame_ring(ring);
+		return NULL;
+	}
+	ring->header = base;
+	UIFrameRingHeader *h = ring->header;
+	memset(h, 0, sizeof(UIFrameRingHeader));
+	h->width = width;
+	h->height = height;
+	h->stride = (uint32_t)stride;
+	h->numslots = numslots;
+	h->latest = -1;
+	for(int i = 0; i < numslots; ++i)
+	{
+		h->slots[i].offset = header_size + slot_size * i;
+		ring->stale[i] = (UIFrameRect) { 0, 0, width, height };
+	}
+	// Written last, consumers check it before trusting the rest
+	SDL_MemoryBarrierRelease();
+	h->magic = UI_FRAME_RING_MAGIC;
+	return ring;
+}
+
+void ui_destroy_frame_ring(UIFrameRing *ring)
+{
+	if(ring->header)
+		munmap(ring->header, ring->size);
+	if(ring->fd >= 0)
+		close(ring->fd);
+	if(ring->name[0])
+		shm_unlink(ring->name);
+	free(ring->vertices);
+	free(ring->commands);
+	free(ring);
+}
+
+int ui_frame_ring_fd(UIFrameRing *ring)
+{
+	return ring->fd;
+}
+
+bool ui_frame_ring_write(UIFrameRing *ring)
+{
+	SDL_LockMutex(ui_ctx.draw_mutex);
+	int index = ui_ctx.published_list;
+	SDL_UnlockMutex(ui_ctx.draw_mutex);
+	if(index < 0)
+		return false;
+	UIDrawList *dl = &ui_ctx.draw_lists[index];
+	if(ring->sequence > 0 && dl->frame == ring->written_frame)
+		return false;
+	ring->written_frame = dl->frame;
+
+	UIFrameRingHeader *h = ring->header;
+	// Atlas pages are sampled below, keep other contexts from repacking meanwhile
+	ui_shared_lock_();
+	UIFrameRect dirty = ui_frame_ring_dirty_(ring, dl);
+	int s = ring->sequence % h->numslots;
+	UIFrameSlot *slot = &h->slots[s];
+	// The slot still shows an older frame, redraw what changed since then
+	UIFrameRect region = ring->stale[s];
+	ui_frame_rect_union_(&region, &dirty);
+
+	SDL_AtomicAdd((SDL_atomic_t *)&slot->sequence, 1); // Odd, readers retry
+	UISoftwareTarget target = { (unsigned char *)h + slot->offset, (int)h->width, (int)h->height, (int)h->stride };
+	if(region.w > 0 && region.h > 0)
+	{
+		for(int y = region.y; y < region.y + region.h; ++y)
+			memset(target.pixels + (size_t)y * target.stride + region.x * 4, 0, (size_t)region.w * 4);
+		ui_software_draw_list_(dl, &target, &region);
+	}
+	uint32_t untextured = 0;
+	for(size_t i = 0; i < dl->numcommands; ++i)
+	{
+		GLuint texture = dl->commands[i].texture;
+		untextured += texture != ui_ctx.white_texture && !ui_frame_ring_atlas_texture_(texture);
+	}
+	slot->frame = ring->sequence;
+	slot->timestamp = SDL_GetTicks();
+	slot->dirty = dirty;
+	slot->untextured = untextured;
+	SDL_AtomicAdd((SDL_atomic_t *)&slot->sequence, 1);
+	SDL_AtomicSet((SDL_atomic_t *)&h->latest, s);
+	ui_shared_unlock_();
+
+	for(unsigned int i = 0; i < h->numslots; ++i)
+		ui_frame_rect_union_(&ring->stale[i], &dirty);
+	ring->stale[s] = (UIFrameRect) { 0, 0, 0, 0 };
+	ring->sequence++;
+
+	if(dl->numvertices > ring->maxvertices)
+	{
+		ring->maxvertices = dl->numvertices;
+		ring->vertices = realloc(ring->vertices, sizeof(UIGLVertex) * ring->maxvertices);
+	}
+	if(dl->numcommands > ring->maxcommands)
+	{
+		ring->maxcommands = dl->numcommands;
+		ring->commands = realloc(ring->commands, sizeof(UIDrawCommand) * ring->maxcommands);
+	}
+	memcpy(ring->vertices, dl->vertices, sizeof(UIGLVertex) * dl->numvertices);
+	memcpy(ring->commands, dl->commands, sizeof(UIDrawCommand) * dl->numcommands);
+	ring->numvertices = dl->numvertices;
+	ring->numcommands = dl->numcommands;
+	return true;
+}
+
+#ifdef UI_DEBUG_PNG
+// Debugging aid only, consumers map the ring instead
+bool ui_frame_ring_write_png(UIFrameRing *ring, const char *path)
+{
+	UIFrameRingHeader *h = ring->header;
+	int latest = SDL_AtomicGet((SDL_atomic_t *)&h->latest);
+	if(latest < 0)
+		return false;
+	const unsigned char *pixels = (const unsigned char *)h + h->slots[latest].offset;
+	return stbi_write_png(path, h->width, h->height, 4, pixels, h->stride) != 0;
+}
+#endif
+#endif
+
+#ifndef _WIN32
+typedef struct
+{
+	int read_fd, write_fd;
+} UIStreamFds;
+
+static int ui_stream_fd_write_(void *userdata, const void *data, size_t size)
+{
+	UIStreamFds *fds = userdata;
+	ssize_t n = write(fds->write_fd, data, size);
+	if(n < 0)
+		return errno == EINTR || errno == EAGAIN ? 0 : -1;
+	return (int)n;
+}
+
+static int ui_stream_fd_read_(void *userdata, void *data, size_t size)
+{
+	UIStreamFds *fds = userdata;
+	struct pollfd pfd = { fds->read_fd, POLLIN, 0 };
+	if(poll(&pfd, 1, 0) <= 0)
+		return 0;
+	ssize_t n = read(fds->read_fd, data, size);
+	if(n == 0)
+		return -1; // Closed by the other end
+	if(n < 0)
+		return errno == EINTR || errno == EAGAIN ? 0 : -1;
+	return (int)n;
+}
+
+UIStream *ui_create_stream_fd(int read_fd, int write_fd, bool compress)
+{
+	UIStreamFds *fds = malloc(sizeof(UIStreamFds));
+	fds->read_fd = read_fd;
+	fds->write_fd = write_fd;
+	UIStreamTransport transport = { ui_stream_fd_write_, ui_stream_fd_read_, fds };
+	UIStream *stream = ui_create_stream(&transport, compress);
+	stream->owned_userdata = fds;
+	return stream;
+}
+#endif
+/*
+void ui_update(UIContext *ctx)
+{
+}*/
+
+void ui_cleanup()
+{
+	if(ui_default_ctx_)
+	{
+		ui_destroy_context(ui_default_ctx_);
+		ui_default_ctx_ = NULL;
+	}
+}
+
+void ui_element_content_measurements_(UIElement *e, float *w, float *h)
+{
+	*w = *h = 0.f;
+	char tmp[128];
+	switch(e->type)
+	{
+		case k_EUIElementTypeButton:
+		case k_EUIElementTypeLabel:
+		{
+			*w = ui_element_label_width_(e);
+			*h = ui_ctx.default_font->height;
+		} break;
+		case k_EUIElementTypeCheckbox:
+		{
+			*w = ui_element_label_width_(e);
+			*h = ui_ctx.default_font->height;
+			*w += *h * 2.f;
+		} break;
+		case k_EUIElementTypeInput:
+		{
+			float x;
+			*w = ui_element_label_width_(e);
+			ui_font_measure_text(ui_ctx.default_font, ": |", NULL, &x, h);
+			*w += x;
+			char *text_repr = ui_element_input_to_string(e, tmp, sizeof(tmp));
+			if(e->u.input.value_measured)
+				x = ui_ctx.width_arena[e->u.input.value_widths + e->u.input.value_length];
+			else if(text_repr == e->u.input.value_text)
+				x = e->u.input.value_width;
+			else
+				ui_font_measure_text(ui_ctx.default_font, text_repr, NULL, &x, h);
+			*w += x;
+		} break;
+	}
+}
+
+static void ui_element_resolve_size_(const UIResolvedStyle *props, float *width, float *height, float content_width, float content_height)
+{
+	if(*width == 0.f)
+	{
+		*width = content_width;
+	}
+	if(*height == 0.f)
+	{
+		*height = content_height;
+	}
+	if(props->max_width > 0.f)
+	{
+		*width = min(*width, props->max_width);
+	}
+	if(props->max_height > 0.f)
+	{
+		*height = min(*height, props->max_height);
+	}
+}
+
+void ui_element_bounds_(UIElement *e)
+{
+	const UIResolvedStyle *props = ui_element_style_props_(e);
+	ui_element_resolve_size_(props, &e->width, &e->height, e->content_width, e->content_height);
+	e->rect.x = ui_ctx.x; // TODO?: margin-left: -10px
+	e->rect.y = ui_ctx.y;
+	e->rect.w = props->border_thickness * 2.f + props->padding_x + props->margin + e->width;
+	e->rect.h = props->border_thickness * 2.f + props->padding_y + props->margin + e->height;
+}
+
+UIElement *ui_prev_element_()
+{
+	return ui_ctx.numelements <= 1 ? NULL : &ui_ctx.elements[ui_ctx.numelements - 2];
+}
+
+void ui_layout_place_cursor_();
+void ui_layout_add_item_(size_t first_element, const UIRectangle *rect);
+
+void ui_element_layout_prev_()
+{
+	ui_layout_place_cursor_();
+	if(ui_ctx.sameline)
+	{
+		UIElement *prev = ui_prev_element_();
+		assert(prev);
+		ui_ctx.y = prev->rect.y;
+		ui_ctx.x += prev->rect.w;
+
+		ui_ctx.sameline = false;
+	}
+	else if(ui_ctx.sameline_count > 0)
+	{
+		UIElement *prev = &ui_ctx.elements[ui_ctx.numelements - 2 - ui_ctx.sameline_count];
+		ui_ctx.x = prev->rect.x;
+		ui_ctx.sameline_count = 0;
+	}
+}
+void ui_element_layout_next_(UIElement *e)
+{
+	if(ui_ctx.pane_depth > 0)
+	{
+		UIPane *pane = &ui_ctx.panes[ui_ctx.pane_depth - 1];
+		e->clip = pane->clip;
+		e->clip_owner = pane->element;
+		e->clip_transform = pane->transform;
+		e->clipped = true;
+		ui_element_cull_(e);
+		// Elements sized without measuring don't count, ui_end_pane keeps last frame's width for them
+		if(e->estimated)
+			pane->estimated = true;
+		else
+			pane->max_x = max(pane->max_x, e->rect.x + e->rect.w);
+		pane->max_y = max(pane->max_y, e->rect.y + e->rect.h);
+	}
+	ui_ctx.y += e->rect.h;
+	ui_layout_add_item_(e->index, &e->rect);
+}
+
+// Text height doesn't depend on the string, only measure glyphs if the element can be visible
+static bool ui_element_outside_pane_(UIElement *e)
+{
+	if(ui_ctx.pane_depth == 0)
+		return false;
+	UIPane *pane = &ui_ctx.panes[ui_ctx.pane_depth - 1];
+	e->content_width = 0.f;
+	e->content_height = e->type == k_EUIElementTypeImage ? 0.f : ui_ctx.default_font->height;
+	ui_element_bounds_(e);
+	bool outside = e->rect.y >= pane->clip.y + pane->clip.h || e->rect.y + e->rect.h <= pane->clip.y;
+	e->estimated = outside && e->width <= 0.f;
+	return outside;
+}
+
+void ui_style(UIStyle *style)
+{
+	ui_ctx.style = style;
+}
+
+bool ui_element_input_focused(UIElement *e)
+{
+	return ui_ctx.input_element.input_type != k_EUIInputElementTypeInvalid && ui_ctx.input_element.out_value
+		   == e->u.input.out_value;
+}
+// The translation is the absolute cursor for ui_restore_transform, not an offset ui_push_transform expects
+void ui_save_transform(UITransform *transform)
+{
+	transform->translation[0] = ui_ctx.x;
+	transform->translation[1] = ui_ctx.y;
+	transform->rotation = 0.f;
+	transform->scale[0] = transform->scale[1] = 1.f;
+}
+
+void ui_restore_transform(UITransform *transform)
+{
+	ui_ctx.x = transform->translation[0];
+	ui_ctx.y = transform->translation[1];
+}
+
+static void ui_element_select_style_(UIElement *e, const UIStyleProps *props, UIVec2 size)
+{
+	e->style = ui_intern_style_(props);
+	e->width = size.x > 0.f ? size.x : props->width;
+	e->height = size.y > 0.f ? size.y : props->height;
+}
+
+// Picks the style state and lays out the element once, size overrides the style width/height when > 0
+void ui_element_style_(UIElement *e, UIStyle *style, UIVec2 size)
+{
+	ui_element_select_style_(e, &style->initial, size);
+	if(ui_element_outside_pane_(e))
+	{
+		return;
+	}
+	// Bounds wrote the estimated content size into the element
+	e->width = size.x > 0.f ? size.x : style->initial.width;
+	e->height = size.y > 0.f ? size.y : style->initial.height;
+	ui_element_content_measurements_(e, &e->content_width, &e->content_height);
+	if(e->type == k_EUIElementTypeInput && ui_element_input_focused(e))
+	{
+		ui_element_select_style_(e, &style->focused, size);
+	}
+	else
+	{
+		// Hover test against the unhovered extent without writing the element
+		const UIResolvedStyle *props = ui_element_style_props_(e);
+		float width = e->width, height = e->height;
+		ui_element_resolve_size_(props, &width, &height, e->content_width, e->content_height);
+		UIRectangle r = { ui_ctx.x,
+						  ui_ctx.y,
+						  props->border_thickness * 2.f + props->padding_x + props->margin + width,
+						  props->border_thickness * 2.f + props->padding_y + props->margin + height };
+		bool clipped_out = ui_ctx.pane_depth > 0 && !ui_mouse_test_rectangle(&ui_ctx.panes[ui_ctx.pane_depth - 1].clip);
+		if(ui_mouse_test_rectangle(&r) && !clipped_out)
 		{
-			if(!ctrl && ui_ctx.active_text_input)
-			{
-				size_t maxchars = ui_ctx.max_active_text_input_length;
-				size_t n = strlen(ui_ctx.active_text_input);
-				if(ui_input_selection_valid())
-				{
-					ui_input_remove_selection();
-					n = strlen(ui_ctx.active_text_input);
-				}
-				strncat(ui_ctx.active_text_input, ev->text.text, maxchars - n - 1);
-				ui_ctx.caret_pos = n;
-			}
+			ui_element_select_style_(e, &style->hovered, size);
 		}
-		break;
 	}
-	return true;
+	ui_element_bounds_(e);
 }
 
-void inherit_style(UIStyle *dst, UIStyle *src)
+void ui_clear_input()
 {
-	if(dst == src)
+	ui_ctx.active_text_input = NULL;
+	ui_ctx.max_active_text_input_length = 0;
+	ui_ctx.input_element.input_type = k_EUIInputElementTypeInvalid;
+	ui_ctx.input_element.out_value = NULL;
+	ui_ctx.input_element.out_value_length = 0;
+	ui_ctx.text_input_changed = false;
+}
+
+UIStyle *ui_get_element_style_(int style)
+{
+	// Override default element style
+	if(ui_ctx.style)
+		return ui_ctx.style;
+	return &ui_ctx.styles[style];
+}
+
+void ui_label(const char *fmt, ...)
+{
+	UIElement *e = ui_new_element_(k_EUIElementTypeLabel);
+	if(fmt)
 	{
-		dst->hovered = dst->initial;
-		dst->active = dst->initial;
-		dst->focused = dst->initial;
+		va_list va;
+		va_start(va, fmt);
+		ui_element_format_label_(e, fmt, va);
+		va_end(va);
 	}
-	else
+	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorDefault);
+	ui_element_style_(e, style, (UIVec2) { 0.f, 0.f });
+
+	ui_element_layout_next_(e);
+	//return ui_clicked() && ui_mouse_test_rectangle(&e->rect);
+}
+
+bool ui_button_ex(const char *label, UIVec2 size)
+{
+	//TODO: store label in hashmap
+	//TODO: check previous frame input state for this element and return true if it was pressed
+	UIElement *e = ui_new_element_(k_EUIElementTypeButton);
+	ui_element_set_label_(e, label);
+	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorInput);
+	ui_element_style_(e, style, (UIVec2) { size.x, 0.f });
+
+	ui_element_layout_next_(e);
+	return ui_element_take_click_(e);
+}
+
+// Text inputs and the input being edited keep the advances of their value for caret placement
+static void ui_input_measure_value_(UIElement *e)
+{
+	UIInputElement *input = &e->u.input;
+	char tmp[64];
+	const char *text = ui_element_input_to_string(e, tmp, sizeof(tmp));
+	if(text == input->value_text)
+		return;
+	input->value_length = strlen(text);
+	input->value_widths = ui_text_widths_(text, input->value_length);
+	input->value_measured = true;
+}
+
+bool ui_text_ex(const char *label, char *out_text, size_t out_text_length, UIVec2 size)
+{
+	UIElement *e = ui_new_element_(k_EUIElementTypeInput);
+	e->u.input.input_type = k_EUIInputElementTypeText;
+	ui_element_set_label_(e, label);
+	e->u.input.out_value = out_text;
+	e->u.input.out_value_length = out_text_length;
+	ui_input_measure_value_(e);
+	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorInput);
+	ui_element_style_(e, style, (UIVec2) { size.x, 0.f });
+
+	ui_element_layout_next_(e);
+	if(ui_ctx.text_input_changed && ui_ctx.input_element.out_value == out_text)
 	{
-		memcpy(dst, src, sizeof(UIStyle));
+		ui_clear_input();
+		return true;
 	}
+	return false;
 }
-SDL_Cursor *default_cursor;
-SDL_Cursor *hand_cursor;
-SDL_Cursor *text_cursor;
-bool ui_init(int width, int height)
+
+bool ui_image(unsigned int image_id, UIVec2 size)
 {
-	default_cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_ARROW);
-	hand_cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_HAND);
-	text_cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_IBEAM);
+	UIElement *e = ui_new_element_(k_EUIElementTypeImage);
+	e->u.image.image_id = image_id;
+	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorDefault);
+	ui_element_style_(e, style, size);
 
-	memset(&ui_ctx, 0, sizeof(UIContext));
-	ui_ctx.default_font = ui_load_font("C:/Windows/Fonts/arial.ttf");
-	GLuint create_program(const char *path, const char *vs_source, const char *fs_source);
-	ui_ctx.gl_program = create_program("#ui", vertex_shader_source, fragment_shader_source);
-	ui_ctx.width = width;
-	ui_ctx.height = height;
-	glGenTextures(1, &ui_ctx.default_image);
-	glBindTexture(GL_TEXTURE_2D, ui_ctx.default_image);
-	static const unsigned char default_image_data[] = {
-		255, 0, 0, 255,
-		255, 255, 255, 255,
-		255, 255, 255, 255,
-		255, 0, 0, 255
-	};
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, default_image_data);
+	ui_element_layout_next_(e);
+	return false;
+}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	// glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+bool ui_image_from_path(const char *path, unsigned int *image_id, UIVec2 size)
+{
+	// Always go through the cache, the texture may have been evicted or reloaded since last frame
+	ui_shared_lock_();
+	*image_id = ui_image_cache_lookup_(path, size)->image_id;
+	ui_shared_unlock_();
+	return ui_image(*image_id, size);
+}
 
-	glGenTextures(1, &ui_ctx.white_texture);
-	glBindTexture(GL_TEXTURE_2D, ui_ctx.white_texture);
-	static const unsigned char image[] = { 255, 255, 255, 255 };
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+bool ui_tiled_image(UITiledImage *image, float zoom, UIVec2 center, UIVec2 size)
+{
+	UIElement *e = ui_new_element_(k_EUIElementTypeImage);
+	e->u.image.tiled = image;
+	e->u.image.zoom = zoom;
+	e->u.image.center = center;
+	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorDefault);
+	ui_element_style_(e, style, size);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	// glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	ui_element_layout_next_(e);
+	return ui_element_take_click_(e);
+}
 
+// Writes the decimal digits of v, returns the length
+static size_t ui_format_uint_(uint64_t v, char *out)
+{
+	char tmp[24];
+	size_t n = 0;
+	do
 	{
-		UIStyleProps *style = &ui_ctx.styles[k_EUIStyleSelectorDefault].initial;
-		style->background_color[0] = 1.f;
-		style->background_color[1] = 1.f;
-		style->background_color[2] = 1.f;
-		style->background_color[3] = 0.f;
-		style->text_color[0] = 0.f;
-		style->text_color[1] = 0.f;
-		style->text_color[2] = 0.f;
-		style->text_color[3] = 1.f;
-		style->border_color[0] = 0.f;
-		style->border_color[1] = 0.f;
-		style->border_color[2] = 0.f;
-		style->border_color[3] = 0.f;
-		style->margin = 5.f;
-		style->padding_y = 2.5f;
-		style->padding_x = 10.f;
-		style->border_thickness = 1.f;
-		ui_ctx.styles[k_EUIStyleSelectorDefault].hovered = ui_ctx.styles[k_EUIStyleSelectorDefault].initial;
-		ui_ctx.styles[k_EUIStyleSelectorDefault].active = ui_ctx.styles[k_EUIStyleSelectorDefault].initial;
-		ui_ctx.styles[k_EUIStyleSelectorDefault].focused = ui_ctx.styles[k_EUIStyleSelectorDefault].initial;
-		for(size_t i = 1; i < k_EUIStyleSelectorMax; ++i)
-		{
-			ui_ctx.styles[i] = ui_ctx.styles[k_EUIStyleSelectorDefault];
-		}
+		tmp[n++] = (char)('0' + v % 10);
+		v /= 10;
+	} while(v);
+	for(size_t i = 0; i < n; ++i)
+		out[i] = tmp[n - 1 - i];
+	out[n] = 0;
+	return n;
+}
+
+static void ui_format_int_(int v, char *out)
+{
+	if(v < 0)
+	{
+		*out++ = '-';
+		ui_format_uint_((uint64_t)(-(int64_t)v), out);
+		return;
 	}
+	ui_format_uint_((uint64_t)v, out);
+}
 
+// precision >= 0 prints that many decimals like %.*f, UI_FLOAT_SHORTEST the shortest text that parses back to v
+static void ui_format_float_(float v, int precision, char *out, size_t out_size)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+	if(precision < 0)
 	{
-		UIStyleProps *style = &ui_ctx.styles[k_EUIStyleSelectorInput].initial;
-		style->background_color[3] = 1.f;
-		style->border_color[0] = 143.f / 255.f;
-		style->border_color[1] = 143.f / 255.f;
-		style->border_color[2] = 157.f / 255.f;
-		style->border_color[3] = 1.f;
-		style->background_color[0] = 233.f / 255.f;
-		style->background_color[1] = 233.f / 255.f;
-		style->background_color[2] = 237.f / 255.f;
-		style->background_color[3] = 1.f;
-		style->text_color[0] = 0.f;
-		style->text_color[1] = 0.f;
-		style->text_color[2] = 0.f;
-		style->text_color[3] = 1.f;
-		ui_ctx.styles[k_EUIStyleSelectorInput].hovered = ui_ctx.styles[k_EUIStyleSelectorInput].initial;
-		ui_ctx.styles[k_EUIStyleSelectorInput].active = ui_ctx.styles[k_EUIStyleSelectorInput].initial;
-		ui_ctx.styles[k_EUIStyleSelectorInput].focused = ui_ctx.styles[k_EUIStyleSelectorInput].initial;
+		for(int digits = 1; digits <= 9; ++digits)
+		{
+			snprintf(out, out_size, "%.*g", digits, v);
+			if(strtof(out, NULL) == v)
+				return;
+		}
+		return;
 	}
+	double scaled = fabs((double)v) * powers[min(precision, 9)];
+	// Beyond 2^53 or for inf/nan the integer split below loses digits
+	if(precision > 9 || !(scaled < 9007199254740992.0))
 	{
-		UIStyleProps *style = &ui_ctx.styles[k_EUIStyleSelectorInput].hovered;
-		style->background_color[0] = 180.f / 255.f;
-		style->background_color[1] = 180.f / 255.f;
-		style->background_color[2] = 184.f / 255.f;
+		snprintf(out, out_size, "%.*f", precision, v);
+		return;
 	}
+	// Ties to even like printf
+	uint64_t fixed = (uint64_t)nearbyint(scaled);
+	uint64_t scale = (uint64_t)powers[precision];
+	char *p = out;
+	if(signbit(v))
+		*p++ = '-';
+	p += ui_format_uint_(fixed / scale, p);
+	if(precision > 0)
 	{
-		UIStyleProps *style = &ui_ctx.styles[k_EUIStyleSelectorInput].focused;
-		style->border_color[0] = 0.f;
-		style->border_color[1] = 0.f;
-		style->border_color[2] = 1.f;
+		*p++ = '.';
+		uint64_t frac = fixed % scale;
+		for(int i = precision - 1; i >= 0; --i)
+		{
+			p[i] = (char)('0' + frac % 10);
+			frac /= 10;
+		}
+		p[precision] = 0;
 	}
-
-	return true;
 }
 
-void ui_inherit_style(int style, UIStyle *out_style)
+// Formats and measures a numeric input once, then reuses the text while the value's bits don't change
+static void ui_input_format_number_(UIElement *e, int precision)
 {
-	*out_style = ui_ctx.styles[style];
+	UIInputElement *input = &e->u.input;
+	uint32_t bits;
+	memcpy(&bits, input->out_value, sizeof(bits));
+	if(!ui_ctx.number_cache)
+		ui_ctx.number_cache = calloc(UI_NUMBER_CACHE_SIZE, sizeof(UINumberCacheEntry));
+	uintptr_t h = (uintptr_t)input->out_value;
+	h ^= h >> 12;
+	UINumberCacheEntry *entry = &ui_ctx.number_cache[(h >> 2) % UI_NUMBER_CACHE_SIZE];
+	if(entry->key != input->out_value || entry->bits != bits || entry->precision != precision
+	   || entry->type != input->input_type)
+	{
+		entry->key = input->out_value;
+		entry->bits = bits;
+		entry->precision = precision;
+		entry->type = input->input_type;
+		if(input->input_type == k_EUIInputElementTypeInteger)
+			ui_format_int_(*(int *)input->out_value, entry->text);
+		else
+			ui_format_float_(*(float *)input->out_value, precision, entry->text, sizeof(entry->text));
+		ui_font_measure_text(ui_ctx.default_font, entry->text, NULL, &entry->width, NULL);
+	}
+	memcpy(input->value_text, entry->text, sizeof(input->value_text));
+	input->value_width = entry->width;
+	input->value_cached = true;
 }
-void ui_default_style(UIStyle *out_style)
+
+//TODO: set ui_ctx.input_filter to only accept integer values
+
+bool ui_integer_ex(const char *label, int *out_integer, UIVec2 size)
 {
-	*out_style = ui_ctx.styles[k_EUIStyleSelectorDefault];
+	UIElement *e = ui_new_element_(k_EUIElementTypeInput);
+	e->u.input.input_type = k_EUIInputElementTypeInteger;
+	ui_element_set_label_(e, label);
+	e->u.input.out_value = out_integer;
+	e->u.input.out_value_length = sizeof(int);
+	ui_input_format_number_(e, 0);
+	ui_input_measure_value_(e);
+	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorInput);
+	ui_element_style_(e, style, (UIVec2) { size.x, 0.f });
+
+	ui_element_layout_next_(e);
+	if(ui_ctx.text_input_changed && ui_ctx.input_element.out_value == out_integer)
+	{
+		*out_integer = atoi(ui_ctx.active_text_input);
+		ui_clear_input();
+		return true;
+	}
+	return false;
 }
-void ui_save_style(UIStyle *style)
+bool ui_float_ex(const char *label, float *out_number, UIVec2 size)
 {
-	//*style = ui_ctx.custom_style;
-	//ui_ctx.style = &ui_ctx.custom_style;
-	ui_ctx.custom_style = *style;
-	ui_ctx.style = style;
+	return ui_float_precision_ex(label, out_number, 6, size);
 }
-void ui_restore_style(UIStyle *style)
+
+bool ui_float_precision_ex(const char *label, float *out_number, int precision, UIVec2 size)
 {
-	//ui_ctx.custom_style = *style;
-	*style = ui_ctx.custom_style;
-	ui_ctx.style = NULL;
+	UIElement *e = ui_new_element_(k_EUIElementTypeInput);
+	e->u.input.input_type = k_EUIInputElementTypeFloat;
+	ui_element_set_label_(e, label);
+	e->u.input.out_value = out_number;
+	e->u.input.out_value_length = sizeof(int);
+	ui_input_format_number_(e, precision);
+	ui_input_measure_value_(e);
+	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorInput);
+	ui_element_style_(e, style, (UIVec2) { size.x, 0.f });
+
+	ui_element_layout_next_(e);
+	if(ui_ctx.text_input_changed && ui_ctx.input_element.out_value == out_number)
+	{
+		*out_number = (float)atof(ui_ctx.active_text_input);
+		ui_clear_input();
+		return true;
+	}
+	return false;
 }
 
-typedef struct
+bool ui_checkbox_ex(const char *label, bool *out_cond, UIVec2 size)
 {
-	float position[2];
-	float texCoord[2];
-} UIGLVertex;
-static GLuint ui_vao = 0, ui_vbo = 0;
+	UIElement *e = ui_new_element_(k_EUIElementTypeCheckbox);
+	ui_element_set_label_(e, label);
+	e->u.checkbox.state = out_cond;
+	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorInput);
+	ui_element_style_(e, style, (UIVec2) { size.x, 0.f });
 
-//TODO: text overflow?
-bool ui_render_char_(UIFont *font, int ch, float *x, float *y, float x_max, bool allow_overflow)
-{
-	stbtt_aligned_quad q;
-	stbtt_GetBakedQuad(font->cdata, 512, 512, ch, x, y, &q, 1); // 1=opengl & d3d10+,0=d3d9
-	if(x_max > 0.f && *x >= x_max && !allow_overflow)
+	ui_element_layout_next_(e);
+	bool pressed = ui_element_take_click_(e);
+	if(pressed)
 	{
-		return false;
+		*out_cond ^= 1;
 	}
-	UIGLVertex vertices[] = { { q.x0, q.y0, q.s0, q.t0 }, { q.x1, q.y0, q.s1, q.t0 }, { q.x0, q.y1, q.s0, q.t1 },
-
-							  { q.x1, q.y0, q.s1, q.t0 }, { q.x1, q.y1, q.s1, q.t1 }, { q.x0, q.y1, q.s0, q.t1 } };
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	// https://stackoverflow.com/questions/50185488/why-can-i-use-gl-quads-with-gldrawarrays
-	// GL_INVALID_ENUM, newer OpenGL API doesn't support GL_QUADS anymore.
-	// glDrawArrays(GL_QUADS, 0, 4);
-	return true;
+	return pressed;
 }
-bool ui_render_text_(UIFont *font, float *x, float *y, float x_max, const char *text, float *textcolor)
-{
-	glBindTexture(GL_TEXTURE_2D, font->gl_texture);
-
-	mat4x4 proj;
-	float aspect = (float)ui_ctx.width / (float)ui_ctx.height;
 
-	mat4x4_identity(proj);
-	mat4x4_ortho(proj, 0.f, (float)ui_ctx.width, (float)ui_ctx.height, 0.f, -(1 << 16), (1 << 16));
-	//mat4x4_ortho(proj, -aspect, aspect, -1.f, 1.f, 1.f, -1.f);
-	glUniformMatrix4fv(glGetUniformLocation(ui_ctx.gl_program, "projection"), 1, GL_FALSE, &proj[0][0]);
+void ui_sameline()
+{
+	ui_ctx.sameline = true;
+	ui_ctx.sameline_count++;
+}
 
-	mat4x4 identity;
-	mat4x4_identity(identity);
-	#if 0
-	mat4x4 translation;
-	mat4x4_translate(translation, x, y, 0.0f);
+void ui_begin_pane(const char *id, UIVec2 size)
+{
+	assert(ui_ctx.pane_depth < UI_MAX_PANE_DEPTH);
+	unsigned int pane_id = ui_id_(id);
+	UIElement *e = ui_new_element_(k_EUIElementTypePane);
+	e->u.pane.state = ui_state_(ui_id_append_(pane_id, "#pane"), sizeof(UIPaneState));
+	UIStyleProps props = ui_get_element_style_(k_EUIStyleSelectorInput)->initial;
+	props.padding_x = 0.f;
+	props.padding_y = 0.f;
+	props.margin = 0.f;
+	e->style = ui_intern_style_(&props);
+	e->width = size.x;
+	e->height = size.y;
+	ui_element_bounds_(e);
+	ui_element_layout_next_(e);
 
-	mat4x4 scale;
-	mat4x4_identity(scale);
-	mat4x4_scale_aniso(scale, identity, 100.0f, 100.0f, 1.0f);
+	UIPane *pane = &ui_ctx.panes[ui_ctx.pane_depth++];
+	pane->element = e->index;
+	pane->id = pane_id;
+	pane->transform = ui_current_transform_();
+	pane->state = e->u.pane.state;
+	pane->saved_x = e->rect.x;
+	pane->saved_y = ui_ctx.y;
+	float border = props.border_thickness;
+	pane->clip.x = e->rect.x + border;
+	pane->clip.y = e->rect.y + border;
+	pane->clip.w = e->rect.w - 2.f * border;
+	pane->clip.h = e->rect.h - 2.f * border;
+	if(pane->state->content_height > pane->clip.h)
+	{
+		pane->clip.w -= UI_PANE_SCROLLBAR_WIDTH;
+	}
+	if(e->clipped)
+	{
+		ui_rectangle_intersect_(&pane->clip, &e->clip, &pane->clip);
+	}
+	pane->content_x = e->rect.x + border;
+	pane->content_y = e->rect.y + border;
+	pane->max_x = pane->content_x;
+	pane->max_y = pane->content_y;
+	pane->extent_y = 0.0;
+	pane->estimated = false;
 
-	mat4x4 model;
-	mat4x4_mul(model, translation, scale);
-	#endif
+	// A pane always ends the current row, its children start a layout of their own
+	ui_ctx.sameline = false;
+	ui_ctx.sameline_count = 0;
+	ui_ctx.x = pane->content_x - pane->state->scroll_x;
+	ui_ctx.y = pane->content_y - pane->state->scroll_y;
+}
 
+void ui_end_pane()
+{
+	assert(ui_ctx.pane_depth > 0);
+	UIPane *pane = &ui_ctx.panes[--ui_ctx.pane_depth];
+	UIPaneState *state = pane->state;
+	UIElement *e = &ui_ctx.elements[pane->element];
+	// Unmeasured rows may be wider, the width only shrinks once every element was measured
+	float content_width = pane->max_x + state->scroll_x - pane->content_x;
+	state->content_width = pane->estimated ? max(content_width, state->content_width) : content_width;
+	state->content_height = max(pane->max_y + state->scroll_y - pane->content_y, pane->extent_y);
 
-	glUniformMatrix4fv(glGetUniformLocation(ui_ctx.gl_program, "model"), 1, GL_FALSE, &identity[0][0]);
-	glUniform4fv(glGetUniformLocation(ui_ctx.gl_program, "textColor"), 1, textcolor);
-	float w = (float)ui_ctx.width;
-	float h = (float)ui_ctx.height;
-	bool overflow = false;
-	size_t n = 0;
-	while(*text)
+	// Innermost hovered pane takes the wheel
+	if(!e->culled && ui_mouse_test_rectangle(&pane->clip))
 	{
-		if(*text >= 32 && *text < 128)
-		{
-			//if(!ui_render_char_(font, *text - 32, x, y, x_max, n == 0)) //TODO: FIXME atm first character always renders
-			if(!ui_render_char_(font, *text - 32, x, y, x_max, true)) //TODO: FIXME atm first character always renders
-			{
-				overflow = true;
-				break;
-			}
-		}
-		++n;
-		++text;
+		state->scroll_y -= ui_ctx.mouse.wheel_y * UI_PANE_SCROLL_STEP;
+		state->scroll_x += ui_ctx.mouse.wheel_x * UI_PANE_SCROLL_STEP;
+		ui_ctx.mouse.wheel_x = 0.f;
+		ui_ctx.mouse.wheel_y = 0.f;
 	}
+	state->scroll_x = max(0.f, min(state->scroll_x, state->content_width - pane->clip.w));
+	state->scroll_y = max(0.0, min(state->scroll_y, state->content_height - pane->clip.h));
 
-	//glDeleteBuffers(1, &vbo);
-	//glDeleteVertexArrays(1, &vao);
-	CHECK_GL_ERROR();
-	return overflow;
+	ui_ctx.sameline = false;
+	ui_ctx.sameline_count = 0;
+	ui_ctx.x = pane->saved_x;
+	ui_ctx.y = pane->saved_y;
 }
 
-bool ui_clicked()
+static void ui_layout_cache_destroy_(void *data)
 {
-	return !ui_ctx.mouse_prev_frame.buttons[0] && ui_ctx.mouse.buttons[0];
+	UILayoutCache *cache = data;
+	free(cache->positions);
 }
 
-/*
-bool ui_hovering_element()
-{
-	return false;
-}*/
-bool ui_mouse_test_rectangle(UIRectangle *rect)
+// Only direct children of the innermost layout are items, elements inside nested panes are not
+static UILayout *ui_layout_top_()
 {
-	return (ui_ctx.mouse.x >= rect->x && ui_ctx.mouse.x <= rect->x + rect->w)
-		   && (ui_ctx.mouse.y >= rect->y && ui_ctx.mouse.y <= rect->y + rect->h);
+	if(ui_ctx.layout_depth == 0)
+		return NULL;
+	UILayout *layout = &ui_ctx.layouts[ui_ctx.layout_depth - 1];
+	return layout->pane_depth == ui_ctx.pane_depth ? layout : NULL;
 }
 
-void ui_render_quad_(float x, float y, float width, float height, const float *bgcolor, unsigned int image_id)
+void ui_layout_place_cursor_()
 {
-	if(image_id == 0)
+	UILayout *layout = ui_layout_top_();
+	if(!layout)
+		return;
+	UILayoutCache *cache = layout->cache;
+	size_t n = layout->numitems;
+	if(n < cache->count)
 	{
-		image_id = ui_ctx.white_texture;
+		ui_ctx.x = layout->origin_x + cache->positions[n * 2];
+		ui_ctx.y = layout->origin_y + cache->positions[n * 2 + 1];
 	}
-	glBindTexture(GL_TEXTURE_2D, image_id);
-
-	mat4x4 proj;
-	float aspect = (float)ui_ctx.width / (float)ui_ctx.height;
-
-	mat4x4_identity(proj);
-	mat4x4_ortho(proj, 0.f, (float)ui_ctx.width, (float)ui_ctx.height, 0.f, -(1 << 16), (1 << 16));
-	// mat4x4_ortho(proj, -aspect, aspect, -1.f, 1.f, 1.f, -1.f);
-	glUniformMatrix4fv(glGetUniformLocation(ui_ctx.gl_program, "projection"), 1, GL_FALSE, &proj[0][0]);
+	else
+	{
+		ui_ctx.x = layout->origin_x + layout->flow_x;
+		ui_ctx.y = layout->origin_y + layout->flow_y;
+	}
+	ui_ctx.sameline = false;
+	ui_ctx.sameline_count = 0;
+}
 
-	mat4x4 identity;
-	mat4x4_identity(identity);
-#if 1
-	mat4x4 translation;
-	mat4x4_translate(translation, x, y, 0.0f);
+// Places item n given the sizes of the items before it, returns the position relative to the origin
+static void ui_layout_flow_(UILayout *layout, float w, float h, float *x, float *y)
+{
+	float limit_x = layout->max_size.x, limit_y = layout->max_size.y;
+	switch(layout->type)
+	{
+		case k_EUILayoutRow:
+			if(limit_x > 0.f && layout->flow_x > 0.f && layout->flow_x + w > limit_x)
+			{
+				layout->flow_x = 0.f;
+				layout->flow_y += layout->flow_extent + layout->spacing;
+				layout->flow_extent = 0.f;
+			}
+			*x = layout->flow_x;
+			*y = layout->flow_y;
+			layout->flow_x += w + layout->spacing;
+			layout->flow_extent = max(layout->flow_extent, h);
+			break;
+		case k_EUILayoutColumn:
+			if(limit_y > 0.f && layout->flow_y > 0.f && layout->flow_y + h > limit_y)
+			{
+				layout->flow_y = 0.f;
+				layout->flow_x += layout->flow_extent + layout->spacing;
+				layout->flow_extent = 0.f;
+			}
+			*x = layout->flow_x;
+			*y = layout->flow_y;
+			layout->flow_y += h + layout->spacing;
+			layout->flow_extent = max(layout->flow_extent, w);
+			break;
+		case k_EUILayoutGrid:
+			// Estimate only, cell sizes depend on every item and are known after ui_end_layout
+			*x = layout->flow_x;
+			*y = layout->flow_y;
+			layout->flow_extent = max(layout->flow_extent, h);
+			if((layout->numitems + 1) % layout->columns == 0)
+			{
+				layout->flow_x = 0.f;
+				layout->flow_y += layout->flow_extent + layout->spacing;
+				layout->flow_extent = 0.f;
+			}
+			else
+			{
+				layout->flow_x += w + layout->spacing;
+			}
+			break;
+	}
+}
 
-	mat4x4 scale;
-	mat4x4_identity(scale);
-	mat4x4_scale_aniso(scale, identity, width, height, 1.0f);
+void ui_layout_add_item_(size_t first_element, const UIRectangle *rect)
+{
+	UILayout *layout = ui_layout_top_();
+	if(!layout)
+		return;
+	if(ui_ctx.numlayout_items >= ui_ctx.maxlayout_items)
+	{
+		ui_ctx.maxlayout_items = ui_ctx.maxlayout_items == 0 ? 64 : ui_ctx.maxlayout_items * 2;
+		ui_ctx.layout_items = realloc(ui_ctx.layout_items, sizeof(UILayoutItem) * ui_ctx.maxlayout_items);
+	}
+	UILayoutItem *item = &ui_ctx.layout_items[ui_ctx.numlayout_items++];
+	item->first_element = first_element;
+	item->rect = *rect;
+	float x, y;
+	ui_layout_flow_(layout, rect->w, rect->h, &x, &y);
+	layout->numitems++;
+}
 
-	mat4x4 model;
-	mat4x4_mul(model, translation, scale);
-#endif
+static void ui_layout_begin_(const char *id, UILayoutType type, int columns, float spacing, UIVec2 max_size)
+{
+	assert(ui_ctx.layout_depth < UI_MAX_LAYOUT_DEPTH);
+	ui_layout_place_cursor_();
+	unsigned int parent = ui_ctx.layout_depth > 0 ? ui_ctx.layouts[ui_ctx.layout_depth - 1].id : ui_id_("#layout");
+	UILayout *layout = &ui_ctx.layouts[ui_ctx.layout_depth++];
+	memset(layout, 0, sizeof(UILayout));
+	layout->id = ui_id_append_(parent, id);
+	layout->type = type;
+	layout->columns = max(columns, 1);
+	layout->spacing = spacing;
+	layout->max_size = max_size;
+	layout->origin_x = ui_ctx.x;
+	layout->origin_y = ui_ctx.y;
+	layout->pane_depth = ui_ctx.pane_depth;
+	layout->first_element = ui_ctx.numelements;
+	layout->first_item = ui_ctx.numlayout_items;
+	layout->cache = ui_state_ex_(layout->id, sizeof(UILayoutCache), ui_layout_cache_destroy_);
+}
 
-	glUniformMatrix4fv(glGetUniformLocation(ui_ctx.gl_program, "model"), 1, GL_FALSE, &model[0][0]);
-	glUniform4fv(glGetUniformLocation(ui_ctx.gl_program, "textColor"), 1, bgcolor);
-	float w = (float)ui_ctx.width;
-	float h = (float)ui_ctx.height;
+void ui_begin_row(const char *id, float spacing, UIVec2 max_size)
+{
+	ui_layout_begin_(id, k_EUILayoutRow, 0, spacing, max_size);
+}
 
-	UIGLVertex vertices[] = { { 0.0f, 1.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f },
-							  { 0.0f, 1.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 0.0f, 1.0f, 0.0f } };
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+void ui_begin_column(const char *id, float spacing, UIVec2 max_size)
+{
+	ui_layout_begin_(id, k_EUILayoutColumn, 0, spacing, max_size);
+}
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	// https://stackoverflow.com/questions/50185488/why-can-i-use-gl-quads-with-gldrawarrays
-	// GL_INVALID_ENUM, newer OpenGL API doesn't support GL_QUADS anymore.
-	// glDrawArrays(GL_QUADS, 0, 4);
-	CHECK_GL_ERROR();
+void ui_begin_grid(const char *id, int columns, float spacing, UIVec2 max_size)
+{
+	ui_layout_begin_(id, k_EUILayoutGrid, columns, spacing, max_size);
 }
-char *ui_element_input_to_string(UIElement *e, char *input_str_repr_buf, size_t input_str_repr_buf_sz)
+
+static void ui_layout_solve_(UILayout *layout, UILayoutItem *items, size_t n)
 {
-	if(ui_ctx.input_element.out_value == e->u.input.out_value)
+	UILayoutCache *cache = layout->cache;
+	if(n > cache->capacity)
 	{
-		if(ui_ctx.active_text_input)
-		{
-			return ui_ctx.active_text_input;
-		}
+		cache->capacity = max(n, cache->capacity * 2);
+		cache->positions = realloc(cache->positions, sizeof(float) * 2 * cache->capacity);
 	}
-	assert(input_str_repr_buf_sz >= 1);
-	input_str_repr_buf[0] = 0;
-	if(e->type != k_EUIElementTypeInput)
-		return NULL;
-	switch(e->u.input.input_type)
+	cache->count = n;
+	cache->width = cache->height = 0.f;
+	if(layout->type == k_EUILayoutGrid)
 	{
-		case k_EUIInputElementTypeInteger:
+		// Column widths are the widest cell in the column, row heights the tallest cell in the row
+		int columns = layout->columns;
+		size_t rows = (n + columns - 1) / columns;
+		float *widths = calloc(columns + rows, sizeof(float));
+		float *heights = widths + columns;
+		for(size_t i = 0; i < n; ++i)
 		{
-			snprintf(input_str_repr_buf, input_str_repr_buf_sz, "%d", *(int*)e->u.input.out_value);
+			widths[i % columns] = max(widths[i % columns], items[i].rect.w);
+			heights[i / columns] = max(heights[i / columns], items[i].rect.h);
 		}
-		break;
-		case k_EUIInputElementTypeFloat:
+		float y = 0.f;
+		for(size_t r = 0; r < rows; ++r)
 		{
-			snprintf(input_str_repr_buf, input_str_repr_buf_sz, "%f", *(float*)e->u.input.out_value);
+			float x = 0.f;
+			for(int c = 0; c < columns && r * columns + c < n; ++c)
+			{
+				cache->positions[(r * columns + c) * 2] = x;
+				cache->positions[(r * columns + c) * 2 + 1] = y;
+				x += widths[c] + layout->spacing;
+			}
+			cache->width = max(cache->width, x - layout->spacing);
+			y += heights[r] + layout->spacing;
 		}
-		break;
-		case k_EUIInputElementTypeText: return (char*)e->u.input.out_value;
+		cache->height = rows > 0 ? y - layout->spacing : 0.f;
+		free(widths);
 	}
-	return input_str_repr_buf;
+	else
+	{
+		layout->flow_x = layout->flow_y = layout->flow_extent = 0.f;
+		for(size_t i = 0; i < n; ++i)
+		{
+			float *pos = &cache->positions[i * 2];
+			ui_layout_flow_(layout, items[i].rect.w, items[i].rect.h, &pos[0], &pos[1]);
+			cache->width = max(cache->width, pos[0] + items[i].rect.w);
+			cache->height = max(cache->height, pos[1] + items[i].rect.h);
+		}
+	}
+	if(layout->max_size.x > 0.f)
+		cache->width = min(cache->width, layout->max_size.x);
+	if(layout->max_size.y > 0.f)
+		cache->height = min(cache->height, layout->max_size.y);
 }
-void ui_render_element_(UIElement *e)
+
+static void ui_layout_translate_(size_t first, size_t last, float dx, float dy)
 {
-	UIFont *font = ui_ctx.default_font;
-	//bool hovering = ui_mouse_test_rectangle(&e->rect);
-	static unsigned int blink_time = 0;
-	unsigned int now = ticks();
-	static bool draw_caret = false;
-	if(now - blink_time >= 600)
+	for(size_t i = first; i < last; ++i)
 	{
-		draw_caret ^= 1;
-		blink_time += 600;
+		UIElement *e = &ui_ctx.elements[i];
+		e->rect.x += dx;
+		e->rect.y += dy;
+		if(!e->clipped)
+			continue;
+		// Clips of panes inside the moved range move along, outer clips stay put
+		if(e->clip_owner >= first)
+		{
+			e->clip.x += dx;
+			e->clip.y += dy;
+		}
+		ui_element_cull_(e);
 	}
-	
-	UIStyleProps *props = &e->style;
-
-	float x = e->rect.x;
-	float y = e->rect.y;
-	float w = e->rect.w;
-	float h = e->rect.h;
-	float content_x = x + props->border_thickness + props->padding_x / 2.f + props->margin / 2.f;
-	float content_y = y + props->border_thickness + props->padding_y / 2.f + props->margin / 2.f;
-	ui_render_quad_(x, y, w, h, props->border_color, 0);
+}
 
-	ui_render_quad_(x + props->border_thickness,
-					y + props->border_thickness,
-					w - 2.0f * props->border_thickness,
-					h - 2.0f * props->border_thickness,
-					props->background_color,
-					0);
+void ui_end_layout()
+{
+	assert(ui_ctx.layout_depth > 0);
+	UILayout *layout = &ui_ctx.layouts[ui_ctx.layout_depth - 1];
+	assert(layout->pane_depth == ui_ctx.pane_depth);
+	UILayoutCache *cache = layout->cache;
+	UILayoutItem *items = &ui_ctx.layout_items[layout->first_item];
+	size_t n = layout->numitems;
 
-	switch(e->type)
+	unsigned int h = 2166136261u;
+	h = ui_hash_bytes_(h, &layout->type, sizeof(layout->type));
+	h = ui_hash_bytes_(h, &layout->columns, sizeof(layout->columns));
+	h = ui_hash_bytes_(h, &layout->spacing, sizeof(layout->spacing));
+	h = ui_hash_bytes_(h, &layout->max_size, sizeof(layout->max_size));
+	for(size_t i = 0; i < n; ++i)
 	{
-		case k_EUIElementTypeButton:
-		case k_EUIElementTypeLabel:
-			content_y += e->content_height;
-			ui_render_text_(font, &content_x, &content_y, 0.f, e->label, props->text_color);
-			break;
-		case k_EUIElementTypeImage:
-			ui_render_quad_(x, y, w, h, ui_color_white, e->u.image.image_id);
-			break;
-		case k_EUIElementTypeInput:
-		{
-			float value_y = content_y;
-			content_y += e->content_height;
-			ui_render_text_(font, &content_x, &content_y, 0.f, e->label, props->text_color);
-			ui_render_text_(font, &content_x, &content_y, 0.f, ": ", props->text_color);
-			if(e->u.input.out_value)
-			{
-				char input_str_repr_buf[128];
-				char *input_str_repr = ui_element_input_to_string(e, input_str_repr_buf, sizeof(input_str_repr_buf));
-				float value_x = content_x;
-				#if 0
-				float text_width = 0.f;
-				ui_font_measure_text(ui_ctx.default_font,
-									 e->u.text.out_string,
-									 NULL,
-									 &text_width,
-									 NULL);
-#endif
-				//TODO: cleanup/refactor
-				if(!ui_render_text_(font,
-									&content_x,
-									&content_y,
-									props->width + e->rect.x,
-									input_str_repr,
-									props->text_color))
-				{
-					if(ui_ctx.active_text_input == e->u.input.out_value
-					   && e->u.input.input_type == k_EUIInputElementTypeText)
-					{
-						if(draw_caret && ui_ctx.caret_pos >= 0 && ui_ctx.caret_pos <= strlen(input_str_repr))
-						{
-							float caret_x_offset = 0.f;
-							ui_font_measure_text(ui_ctx.default_font,
-												 input_str_repr,
-												 input_str_repr + ui_ctx.caret_pos,
-												 &caret_x_offset,
-												 NULL);
-							caret_x_offset += value_x - 1.f;
-							ui_render_text_(font, &caret_x_offset, &content_y, 0.f, "|", props->text_color);
-						}
-					}
-				}
-				if(ui_ctx.selection_beg >= 0 && ui_ctx.selection_end <= strlen(input_str_repr)
-				   && ui_ctx.selection_beg < ui_ctx.selection_end && e->u.input.input_type == k_EUIInputElementTypeText)
-				{
-					size_t n = ui_ctx.selection_end - ui_ctx.selection_beg;
-					float selx = 0.f, sely = 0.f;
-					ui_font_measure_text(ui_ctx.default_font, input_str_repr, input_str_repr + n,
-										 &selx,
-										 &sely);
-					static const float selcol[] = { 0.f, 0.f, 1.f, 0.5f };
-					ui_render_quad_(value_x, value_y, selx, e->content_height, selcol, 0);
-
-				}
-			}
-		} break;
-		case k_EUIElementTypeCheckbox:
+		h = ui_hash_bytes_(h, &items[i].rect.w, sizeof(float) * 2);
+	}
+	// Children were placed from the cached solve, nothing moves unless the inputs changed
+	if(h != cache->hash || n != cache->count)
+	{
+		ui_layout_solve_(layout, items, n);
+		cache->hash = h;
+		for(size_t i = 0; i < n; ++i)
 		{
-			static const float color[] = { 0.f, 0.f, 1.f, 1.f };
-			static const float color2[] = { 1.f, 1.f, 1.f, 1.f };
-			content_y += e->content_height;
-			ui_render_text_(font, &content_x, &content_y, 0.f, e->label, props->text_color);
-			ui_render_text_(font, &content_x, &content_y, 0.f, ": ", props->text_color);
-			float sz = e->content_height;
-			ui_render_quad_(content_x,
-							content_y - sz,
-							sz, sz, color, 0);
-			if(!*e->u.checkbox.state)
+			float dx = layout->origin_x + cache->positions[i * 2] - items[i].rect.x;
+			float dy = layout->origin_y + cache->positions[i * 2 + 1] - items[i].rect.y;
+			if(dx != 0.f || dy != 0.f)
 			{
-				ui_render_quad_(content_x + sz / 4.f,
-								content_y - e->content_height + sz / 4.f,
-								sz / 2.f,
-								sz / 2.f,
-								color2,
-								0);
+				size_t last = i + 1 < n ? items[i + 1].first_element : ui_ctx.numelements;
+				ui_layout_translate_(items[i].first_element, last, dx, dy);
 			}
-		} break;
+		}
 	}
-}
 
-void ui_begin_frame()
-{
-	ui_ctx.interact_active = SDL_GetRelativeMouseMode();
-	ui_ctx.x = 0;
-	ui_ctx.y = 0;
-	ui_ctx.numelements = 0;
+	UIRectangle bounds = { layout->origin_x, layout->origin_y, cache->width, cache->height };
+	size_t first_element = layout->first_element;
+	ui_ctx.numlayout_items = layout->first_item;
+	ui_ctx.layout_depth--;
+	if(ui_ctx.pane_depth > 0)
+	{
+		UIPane *pane = &ui_ctx.panes[ui_ctx.pane_depth - 1];
+		pane->max_x = max(pane->max_x, bounds.x + bounds.w);
+		pane->max_y = max(pane->max_y, bounds.y + bounds.h);
+	}
 	ui_ctx.sameline = false;
 	ui_ctx.sameline_count = 0;
+	ui_ctx.x = bounds.x;
+	ui_ctx.y = bounds.y + bounds.h;
+	// A nested layout is a single item of its parent
+	ui_layout_add_item_(first_element, &bounds);
 }
-void ui_end_frame()
+
+typedef struct
 {
-	ui_ctx.text_input_changed = false;
-	ui_ctx.mouse_prev_frame = ui_ctx.mouse;
-	memset(ui_ctx.mouse.buttons, 0, sizeof(ui_ctx.mouse.buttons));
-}
+	size_t count, capacity;
+	float estimate;
+	float *heights;
+	double *tree; // Fenwick tree over heights, prefix sums give row offsets in O(log n)
+} UIListState;
 
-void ui_translate(float x, float y)
+static void ui_list_state_destroy_(void *data)
 {
-	ui_ctx.x = x;
-	ui_ctx.y = y;
+	UIListState *state = data;
+	free(state->heights);
+	free(state->tree);
 }
 
-void ui_render()
+static void ui_list_state_resize_(UIListState *state, size_t count, float estimate)
 {
-	glUseProgram(ui_ctx.gl_program);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glUniform1i(glGetUniformLocation(ui_ctx.gl_program, "s_texture"), 0);
-	glActiveTexture(GL_TEXTURE0);
-	glDisable(GL_DEPTH_TEST);
-	if(ui_vao == 0)
+	if(count + 1 > state->capacity)
 	{
-		glGenVertexArrays(1, &ui_vao);
-		glBindVertexArray(ui_vao);
-		if(ui_vbo == 0)
-		{
-			glGenBuffers(1, &ui_vbo);
-		}
-		glBindBuffer(GL_ARRAY_BUFFER, ui_vbo);
-
-		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(UIGLVertex), (void *)offsetof(UIGLVertex, position));
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(UIGLVertex), (void *)offsetof(UIGLVertex, texCoord));
-		glEnableVertexAttribArray(1);
+		state->capacity = max(count + 1, state->capacity * 2);
+		state->heights = realloc(state->heights, sizeof(float) * state->capacity);
+		state->tree = realloc(state->tree, sizeof(double) * state->capacity);
 	}
-	glBindVertexArray(ui_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, ui_vbo);
-	//float color[] = { 1.f, 0.f, 0.f, 1.f };
-	//ui_render_quad_(ui_ctx.mouse.x, ui_ctx.mouse.y, 8.f, 8.f, color);
-	char *active_text_input = ui_ctx.active_text_input;
-	UIElement *active_element = NULL;
-	UIElement *hovered_element = NULL;
-	for(size_t i = 0; i < ui_ctx.numelements; ++i)
+	// A node only covers rows before it, so shrinking keeps the tree valid and growing
+	// fills the new nodes from their children in O(log n) each
+	state->tree[0] = 0.0;
+	for(size_t i = state->count + 1; i <= count; ++i)
 	{
-		UIElement *e = &ui_ctx.elements[i];
-		bool hovered = ui_mouse_test_rectangle(&e->rect);
-		if(hovered)
-		{
-			hovered_element = e;
-			if(ui_clicked())
-			{
-				active_element = e;
-				if(e->type == k_EUIElementTypeInput)
-				{
-					if(e->u.input.input_type == k_EUIInputElementTypeText)
-					{
-						ui_ctx.active_text_input = e->u.input.out_value;
-						ui_ctx.active_text_input[0] = 0;
-						ui_ctx.max_active_text_input_length = e->u.input.out_value_length;
-					}
-					else
-					{
-						ui_ctx.small_input_buffer[0] = 0;
-						ui_ctx.active_text_input = ui_ctx.small_input_buffer;
-						ui_ctx.max_active_text_input_length = sizeof(ui_ctx.small_input_buffer);
-					}
-					ui_ctx.input_element = e->u.input;
-					ui_ctx.caret_pos = 0;
-					ui_ctx.text_input_changed = false;
-					void ui_input_clear_selection();
-					ui_input_clear_selection();
-				}
-			}
-		}
-		ui_render_element_(e);
+		state->heights[i - 1] = estimate;
+		state->tree[i] = estimate;
+		for(size_t child = 1; child < (i & (0 - i)); child *= 2)
+			state->tree[i] += state->tree[i - child];
 	}
-	if(hovered_element)
+	state->count = count;
+	state->estimate = estimate;
+}
+
+static void ui_list_state_update_(UIListState *state, size_t row, float height)
+{
+	double delta = (double)height - state->heights[row];
+	state->heights[row] = height;
+	for(size_t i = row + 1; i <= state->count; i += i & (0 - i))
+		state->tree[i] += delta;
+}
+
+// Offset of the top of row
+static double ui_list_state_offset_(UIListState *state, size_t row)
+{
+	double sum = 0.0;
+	for(size_t i = row; i > 0; i -= i & (0 - i))
+		sum += state->tree[i];
+	return sum;
+}
+
+// Row containing offset y, found by descending the Fenwick tree
+static size_t ui_list_state_find_(UIListState *state, double y, double *out_offset)
+{
+	size_t pos = 0;
+	size_t step = 1;
+	while(step * 2 <= state->count)
+		step *= 2;
+	double sum = 0.0;
+	for(; step > 0; step /= 2)
 	{
-		//TODO: add cursor to style props
-		if(hovered_element->type == k_EUIElementTypeButton || hovered_element->type == k_EUIElementTypeCheckbox)
-		{
-			SDL_SetCursor(hand_cursor);
-		}
-		else if(hovered_element->type == k_EUIElementTypeInput)
-		{
-			SDL_SetCursor(text_cursor);
-		}
-		else
+		if(pos + step <= state->count && sum + state->tree[pos + step] <= y)
 		{
-			SDL_SetCursor(default_cursor);
+			pos += step;
+			sum += state->tree[pos];
 		}
 	}
-	else
+	*out_offset = sum;
+	return pos;
+}
+
+void ui_list(const char *id, const UIList *list, UIVec2 size)
+{
+	ui_begin_pane(id, size);
+	UIPane *pane = &ui_ctx.panes[ui_ctx.pane_depth - 1];
+	double scroll_y = pane->state->scroll_y;
+	bool fixed = list->row_height > 0.f;
+
+	// Offsets stay in double until they are relative to the scroll position, floats
+	// are only a few pixels apart at 100M and rows would jitter
+	UIListState *state = NULL;
+	size_t first;
+	double first_offset;
+	if(fixed)
 	{
-		SDL_SetCursor(default_cursor);
+		first = (size_t)(scroll_y / list->row_height);
+		first_offset = first * (double)list->row_height;
 	}
-	if(ui_clicked() && !active_element)
+	else
 	{
-		ui_ctx.input_element.input_type = k_EUIInputElementTypeInvalid;
-		ui_ctx.active_text_input = NULL;
+		float estimate = list->estimated_row_height > 0.f ? list->estimated_row_height : ui_ctx.default_font->height;
+		state = ui_state_ex_(ui_id_("#rows"), sizeof(UIListState), ui_list_state_destroy_);
+		if(state->count != list->row_count)
+			ui_list_state_resize_(state, list->row_count, estimate);
+		first = ui_list_state_find_(state, scroll_y, &first_offset);
 	}
-	if(!active_text_input)
+
+	float row_y = pane->content_y + (float)(first_offset - scroll_y);
+	float bottom = pane->clip.y + pane->clip.h;
+	pane->list = list;
+	for(size_t row = first; row < list->row_count && row_y < bottom; ++row)
 	{
-		if(ui_ctx.active_text_input)
+		pane->row_x = pane->content_x - pane->state->scroll_x;
+		pane->row_y = row_y;
+		ui_ctx.x = pane->row_x;
+		ui_ctx.y = row_y;
+		ui_ctx.sameline = false;
+		ui_ctx.sameline_count = 0;
+		pane->max_y = row_y;
+		list->row(list->userdata, row);
+		if(fixed)
 		{
-			SDL_StartTextInput();
+			row_y += list->row_height;
 		}
 		else
 		{
-			SDL_StopTextInput();
+			float height = max(ui_ctx.y, pane->max_y) - row_y;
+			if(height <= 0.f)
+				height = state->estimate;
+			if(height != state->heights[row])
+				ui_list_state_update_(state, row, height);
+			row_y += height;
 		}
 	}
+	pane->list = NULL;
+
+	// Content size covers every row without laying them out
+	double total = fixed ? list->row_count * (double)list->row_height : ui_list_state_offset_(state, state->count);
+	pane->extent_y = max(pane->extent_y, total);
+	ui_end_pane();
 }
-/*
-void ui_update(UIContext *ctx)
+
+void ui_list_column(size_t column)
 {
-}*/
+	assert(ui_ctx.pane_depth > 0);
+	UIPane *pane = &ui_ctx.panes[ui_ctx.pane_depth - 1];
+	assert(pane->list && column < pane->list->column_count);
+	float x = pane->row_x;
+	for(size_t i = 0; i < column; ++i)
+		x += pane->list->column_widths[i];
+	ui_ctx.x = x;
+	ui_ctx.y = pane->row_y;
+	ui_ctx.sameline = false;
+	ui_ctx.sameline_count = 0;
+}
 
-void ui_cleanup()
+void ui_plot_buffer_init(UIPlotBuffer *buffer, size_t capacity)
 {
-	free(ui_ctx.default_font);
-	ui_ctx.default_font = NULL;
+	memset(buffer, 0, sizeof(UIPlotBuffer));
+	buffer->values = malloc(sizeof(float) * capacity);
+	buffer->capacity = capacity;
 }
 
-void ui_element_content_measurements_(UIElement *e, float *w, float *h)
+void ui_plot_buffer_free(UIPlotBuffer *buffer)
 {
-	*w = *h = 0.f;
-	char tmp[128];
-	switch(e->type)
+	free(buffer->values);
+	memset(buffer, 0, sizeof(UIPlotBuffer));
+}
+
+void ui_plot_buffer_push(UIPlotBuffer *buffer, const float *values, size_t n)
+{
+	if(n > buffer->capacity)
 	{
-		case k_EUIElementTypeButton:
-		case k_EUIElementTypeLabel:
-		{
-			ui_font_measure_text(ui_ctx.default_font, e->label, NULL, w, h);
-		} break;
-		case k_EUIElementTypeCheckbox:
-		{
-			ui_font_measure_text(ui_ctx.default_font, e->label, NULL, w, h);
-			*w += *h * 2.f;
-		} break;
-		case k_EUIElementTypeInput:
-		{
-			float x;
-			ui_font_measure_text(ui_ctx.default_font, e->label, NULL, &x, h);
-			*w = x;
-			ui_font_measure_text(ui_ctx.default_font, ": |", NULL, &x, h);
-			*w += x;
-			char *text_repr = ui_element_input_to_string(e, tmp, sizeof(tmp));
-			ui_font_measure_text(ui_ctx.default_font, text_repr, NULL, &x, h);
-			*w += x;
-		} break;
+		values += n - buffer->capacity;
+		buffer->total += n - buffer->capacity;
+		n = buffer->capacity;
 	}
+	size_t first = min(n, buffer->capacity - buffer->head);
+	memcpy(buffer->values + buffer->head, values, sizeof(float) * first);
+	memcpy(buffer->values, values + first, sizeof(float) * (n - first));
+	buffer->head = (buffer->head + n) % buffer->capacity;
+	buffer->count = min(buffer->count + n, buffer->capacity);
+	buffer->total += n;
 }
 
-void ui_element_bounds_(UIElement *e)
+static void ui_plot_minmax_(const float *v, size_t n, float *io_min, float *io_max)
 {
-	UIStyleProps *props = &e->style;
-	if(props->width == 0.f)
+	float lo = *io_min, hi = *io_max;
+	size_t i = 0;
+#ifdef UI_SSE2
+	if(n >= 16)
 	{
-		props->width = e->content_width;
+		// Four independent accumulators hide the latency of minps/maxps
+		__m128 lo0 = _mm_loadu_ps(v), lo1 = _mm_loadu_ps(v + 4), lo2 = _mm_loadu_ps(v + 8), lo3 = _mm_loadu_ps(v + 12);
+		__m128 hi0 = lo0, hi1 = lo1, hi2 = lo2, hi3 = lo3;
+		for(i = 16; i + 16 <= n; i += 16)
+		{
+			__m128 a = _mm_loadu_ps(v + i), b = _mm_loadu_ps(v + i + 4);
+			__m128 c = _mm_loadu_ps(v + i + 8), d = _mm_loadu_ps(v + i + 12);
+			lo0 = _mm_min_ps(lo0, a);
+			hi0 = _mm_max_ps(hi0, a);
+			lo1 = _mm_min_ps(lo1, b);
+			hi1 = _mm_max_ps(hi1, b);
+			lo2 = _mm_min_ps(lo2, c);
+			hi2 = _mm_max_ps(hi2, c);
+			lo3 = _mm_min_ps(lo3, d);
+			hi3 = _mm_max_ps(hi3, d);
+		}
+		__m128 vlo = _mm_min_ps(_mm_min_ps(lo0, lo1), _mm_min_ps(lo2, lo3));
+		__m128 vhi = _mm_max_ps(_mm_max_ps(hi0, hi1), _mm_max_ps(hi2, hi3));
+		float a[4], b[4];
+		_mm_storeu_ps(a, vlo);
+		_mm_storeu_ps(b, vhi);
+		for(int j = 0; j < 4; ++j)
+		{
+			lo = min(lo, a[j]);
+			hi = max(hi, b[j]);
+		}
 	}
-	if(props->height == 0.f)
+#endif
+	for(; i < n; ++i)
 	{
-		props->height = e->content_height;
+		lo = min(lo, v[i]);
+		hi = max(hi, v[i]);
 	}
-	e->rect.x = ui_ctx.x; // TODO?: margin-left: -10px
-	e->rect.y = ui_ctx.y;
-	e->rect.w = props->border_thickness * 2.f + props->padding_x + props->margin + props->width;
-	e->rect.h = props->border_thickness * 2.f + props->padding_y + props->margin + props->height;
+	*io_min = lo;
+	*io_max = hi;
 }
 
-UIElement *ui_prev_element_()
+// Min/max over absolute samples [a, b) of a ring whose newest sample (end - 1) sits before head
+static void ui_plot_range_(const float *values,
+						   size_t capacity,
+						   size_t head,
+						   uint64_t end,
+						   uint64_t a,
+						   uint64_t b,
+						   float *out_min,
+						   float *out_max)
 {
-	return ui_ctx.numelements <= 1 ? NULL : &ui_ctx.elements[ui_ctx.numelements - 2];
+	*out_min = FLT_MAX;
+	*out_max = -FLT_MAX;
+	size_t p = (size_t)((head + capacity - (end - a) % capacity) % capacity);
+	size_t n = (size_t)(b - a);
+	size_t first = min(n, capacity - p);
+	ui_plot_minmax_(values + p, first, out_min, out_max);
+	ui_plot_minmax_(values, n - first, out_min, out_max);
 }
 
-void ui_element_layout_prev_()
+static void ui_plot_state_destroy_(void *data)
 {
-	if(ui_ctx.sameline)
+	UIPlotState *state = data;
+	free(state->bucket_min);
+	free(state->bucket_max);
+	free(state->bucket_index);
+	free(state->column_min);
+	free(state->column_max);
+	free(state->column_x0);
+	free(state->column_x1);
+}
+
+static bool ui_plot_(const char *id,
+					 const float *values,
+					 size_t capacity,
+					 size_t head,
+					 size_t count,
+					 uint64_t total,
+					 bool cacheable,
+					 float scale_min,
+					 float scale_max,
+					 UIVec2 size)
+{
+	UIElement *e = ui_new_element_(k_EUIElementTypePlot);
+	ui_element_set_label_(e, id);
+	UIStyleProps props = ui_get_element_style_(k_EUIStyleSelectorInput)->initial;
+	props.padding_x = 0.f;
+	props.padding_y = 0.f;
+	props.margin = 0.f;
+	e->style = ui_intern_style_(&props);
+	e->width = size.x;
+	e->height = size.y;
+	memcpy(e->u.plot.color, props.text_color, sizeof(e->u.plot.color));
+	ui_element_bounds_(e);
+	ui_element_layout_next_(e);
+
+	UIPlotState *state = ui_state_ex_(ui_id_append_(ui_id_(id), "#plot"), sizeof(UIPlotState), ui_plot_state_destroy_);
+	e->u.plot.state = state;
+	state->numcolumns = 0;
+	if(e->culled || count == 0)
+		return false;
+
+	float inner_x = e->rect.x + props.border_thickness;
+	float inner_w = e->rect.w - 2.f * props.border_thickness;
+	int width = max(1, (int)inner_w);
+	size_t spp = (count + width - 1) / width;
+	if(spp == 0)
+		spp = 1;
+	if(width != state->width)
 	{
-		UIElement *prev = ui_prev_element_();
-		assert(prev);
-		ui_ctx.y = prev->rect.y;
-		ui_ctx.x += prev->rect.w;
+		state->capacity = width + 2;
+		state->bucket_min = realloc(state->bucket_min, sizeof(float) * state->capacity);
+		state->bucket_max = realloc(state->bucket_max, sizeof(float) * state->capacity);
+		state->bucket_index = realloc(state->bucket_index, sizeof(uint64_t) * state->capacity);
+		state->column_min = realloc(state->column_min, sizeof(float) * state->capacity);
+		state->column_max = realloc(state->column_max, sizeof(float) * state->capacity);
+		state->column_x0 = realloc(state->column_x0, sizeof(float) * state->capacity);
+		state->column_x1 = realloc(state->column_x1, sizeof(float) * state->capacity);
+	}
+	if(!cacheable || width != state->width || spp != state->samples_per_column || values != state->values)
+	{
+		for(size_t i = 0; i < state->capacity; ++i)
+			state->bucket_index[i] = UINT64_MAX;
+		state->width = width;
+		state->samples_per_column = spp;
+		state->values = values;
+	}
 
-		ui_ctx.sameline = false;
+	// Only columns inside the pane's clip are decimated
+	float visible_x0 = 0.f, visible_x1 = inner_w;
+	if(e->clipped)
+	{
+		visible_x0 = max(visible_x0, e->clip.x - inner_x);
+		visible_x1 = min(visible_x1, e->clip.x + e->clip.w - inner_x);
 	}
-	else if(ui_ctx.sameline_count > 0)
+
+	// Columns are aligned to absolute sample indices, so complete columns stay valid while the window slides
+	uint64_t end = total, start = total - count;
+	float lo = FLT_MAX, hi = -FLT_MAX;
+	for(uint64_t k = start / spp; k * spp < end; ++k)
 	{
-		UIElement *prev = &ui_ctx.elements[ui_ctx.numelements - 2 - ui_ctx.sameline_count];
-		ui_ctx.x = prev->rect.x;
-		ui_ctx.sameline_count = 0;
+		uint64_t a = max(k * spp, start), b = min((k + 1) * spp, end);
+		float x0 = (float)(a - start) * inner_w / count, x1 = (float)(b - start) * inner_w / count;
+		if(x1 < visible_x0 || x0 > visible_x1)
+			continue;
+		size_t slot = (size_t)(k % state->capacity);
+		size_t column = state->numcolumns++;
+		bool complete = a == k * spp && b == (k + 1) * spp;
+		if(complete && state->bucket_index[slot] == k)
+		{
+			state->column_min[column] = state->bucket_min[slot];
+			state->column_max[column] = state->bucket_max[slot];
+		}
+		else
+		{
+			ui_plot_range_(values, capacity, head, end, a, b, &state->column_min[column], &state->column_max[column]);
+			if(complete && cacheable)
+			{
+				state->bucket_index[slot] = k;
+				state->bucket_min[slot] = state->column_min[column];
+				state->bucket_max[slot] = state->column_max[column];
+			}
+		}
+		state->column_x0[column] = x0;
+		state->column_x1[column] = x1;
+		lo = min(lo, state->column_min[column]);
+		hi = max(hi, state->column_max[column]);
 	}
-}
-void ui_element_layout_next_(UIElement *e)
-{
-	ui_ctx.y += e->rect.h;
+	// Equal scale bounds fit the visible data
+	state->lo = scale_min != scale_max ? scale_min : lo;
+	state->hi = scale_min != scale_max ? scale_max : hi;
+	return ui_element_take_click_(e);
 }
 
-void ui_style(UIStyle *style)
+bool ui_plot_lines(const char *id, const float *values, size_t count, float scale_min, float scale_max, UIVec2 size)
 {
-	ui_ctx.style = style;
+	return ui_plot_(id, values, count, 0, count, count, false, scale_min, scale_max, size);
 }
 
-bool ui_element_input_focused(UIElement *e)
+bool ui_plot_buffer(const char *id, const UIPlotBuffer *buffer, float scale_min, float scale_max, UIVec2 size)
 {
-	return ui_ctx.input_element.input_type != k_EUIInputElementTypeInvalid && ui_ctx.input_element.out_value
-		   == e->u.input.out_value;
+	return ui_plot_(id,
+					buffer->values,
+					buffer->capacity,
+					buffer->head,
+					buffer->count,
+					buffer->total,
+					true,
+					scale_min,
+					scale_max,
+					size);
 }
-void ui_save_transform(UITransform *transform)
+
+void ui_console(const char *id, UIConsole *console, UIVec2 size)
 {
-	transform->translation[0] = ui_ctx.x;
-	transform->translation[1] = ui_ctx.y;
+	ui_console_poll_(console);
+	uint32_t count = (uint32_t)min(console->end, (uint64_t)console->capacity);
+	uint32_t oldest = (uint32_t)(console->end - count);
+	float line_height = ui_ctx.default_font->height;
+
+	ui_begin_pane(id, size);
+	UIPane *pane = &ui_ctx.panes[ui_ctx.pane_depth - 1];
+	UIPaneState *state = pane->state;
+	float total = count * line_height;
+	// Follow new lines while scrolled to the bottom, scrolling up stops following
+	if(console->follow)
+		state->scroll_y = max(0.f, total - pane->clip.h);
+	float top = pane->content_y - state->scroll_y;
+	uint32_t first = (uint32_t)(state->scroll_y / line_height);
+	uint32_t visible = (uint32_t)ceilf(pane->clip.h / line_height) + 1;
+	first = min(first, count);
+	visible = min(visible, count - first);
+	// Every visible line needs its own cache slot
+	visible = min(visible, UI_CONSOLE_RUN_CACHE_SIZE);
+	for(uint32_t i = oldest + first; i != oldest + first + visible; ++i)
+		ui_console_run_(console, i, ui_ctx.default_font);
+
+	UIElement *e = ui_new_element_(k_EUIElementTypeConsole);
+	e->u.console.console = console;
+	e->u.console.first = oldest + first;
+	e->u.console.last = oldest + first + visible;
+	e->u.console.line_height = line_height;
+	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorDefault);
+	memcpy(e->u.console.color, style->initial.text_color, sizeof(e->u.console.color));
+	e->style = 0; // Empty style, the console draws no border or background
+	e->rect.x = pane->content_x - state->scroll_x;
+	e->rect.y = top + first * line_height;
+	e->rect.w = pane->clip.w;
+	e->rect.h = visible * line_height;
+	ui_ctx.y = e->rect.y;
+	ui_element_layout_next_(e);
+
+	pane->max_y = max(pane->max_y, top + total);
+	double scroll_before = state->scroll_y;
+	ui_end_pane();
+	if(state->scroll_y != scroll_before)
+		console->follow = state->scroll_y >= total - pane->clip.h - 1.f;
 }
 
-void ui_restore_transform(UITransform *transform)
+typedef struct
 {
-	ui_ctx.x = transform->translation[0];
-	ui_ctx.y = transform->translation[1];
-}
+	uint64_t node;
+	int depth;
+	bool has_children;
+} UITreeRow;
 
-void ui_element_style_(UIElement *e, UIStyle *style)
+typedef struct
 {
-	ui_element_content_measurements_(e, &e->content_width, &e->content_height);
-	e->style = style->initial;
-	ui_element_bounds_(e);
-	if(ui_mouse_test_rectangle(&e->rect))
-	{
-		e->style = style->hovered;
-		ui_element_bounds_(e);
-	}
-	if(e->type == k_EUIElementTypeInput)
-	{
-		if(ui_element_input_focused(e))
-		{
-			e->style = style->focused;
-			ui_element_bounds_(e);
-		}
-	}
-}
+	// Open addressing set of expanded node ids
+	uint64_t *keys;
+	unsigned char *used; // 0 empty, 1 occupied, 2 deleted
+	size_t capacity, count, deleted;
+	// Expanded nodes flattened in display order, rebuilt only when expansion or the tree changes
+	UITreeRow *rows;
+	size_t numrows, maxrows;
+	uint64_t root, version;
+	bool dirty;
+	bool valid;
+} UITreeState;
 
-void ui_clear_input()
+static void ui_tree_state_destroy_(void *data)
 {
-	ui_ctx.active_text_input = NULL;
-	ui_ctx.max_active_text_input_length = 0;
-	ui_ctx.input_element.input_type = k_EUIInputElementTypeInvalid;
-	ui_ctx.input_element.out_value = NULL;
-	ui_ctx.input_element.out_value_length = 0;
-	ui_ctx.text_input_changed = false;
+	UITreeState *state = data;
+	free(state->keys);
+	free(state->used);
+	free(state->rows);
 }
 
-UIStyle *ui_get_element_style_(int style)
+static size_t ui_tree_hash_(uint64_t key)
 {
-	// Override default element style
-	if(ui_ctx.style)
-		return ui_ctx.style;
-	return &ui_ctx.styles[style];
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	return (size_t)key;
 }
 
-void ui_label(const char *fmt, ...)
+static size_t ui_tree_find_(UITreeState *state, uint64_t node)
 {
-	char text[256] = { 0 };
-	if(fmt)
+	size_t mask = state->capacity - 1;
+	size_t i = ui_tree_hash_(node) & mask;
+	while(state->used[i] != 0)
 	{
-		va_list va;
-		va_start(va, fmt);
-		vsnprintf(text, sizeof(text), fmt, va);
-		va_end(va);
+		if(state->used[i] == 1 && state->keys[i] == node)
+			return i;
+		i = (i + 1) & mask;
 	}
-	UIElement *e = ui_new_element_(k_EUIElementTypeLabel);
-	snprintf(e->label, sizeof(e->label), "%s", text);
-	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorDefault);
-	ui_element_style_(e, style);
+	return (size_t)-1;
+}
 
-	ui_element_layout_next_(e);
-	//return ui_clicked() && ui_mouse_test_rectangle(&e->rect);
+static bool ui_tree_expanded_(UITreeState *state, uint64_t node)
+{
+	return state->capacity > 0 && ui_tree_find_(state, node) != (size_t)-1;
 }
 
-bool ui_button_ex(const char *label, UIVec2 size)
+static void ui_tree_insert_(UITreeState *state, uint64_t node)
 {
-	//TODO: store label in hashmap
-	//TODO: check previous frame input state for this element and return true if it was pressed
-	UIElement *e = ui_new_element_(k_EUIElementTypeButton);
-	snprintf(e->label, sizeof(e->label), "%s", label);
-	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorInput);
-	ui_element_style_(e, style);
-	if(size.x > 0.f)
+	if((state->count + state->deleted + 1) * 2 > state->capacity)
 	{
-		e->style.width = size.x;
+		// Rehash, which also drops the deleted markers
+		uint64_t *keys = state->keys;
+		unsigned char *used = state->used;
+		size_t capacity = state->capacity;
+		state->capacity = max(capacity * 2, 64);
+		if(state->count * 4 < capacity)
+			state->capacity = max(capacity, 64);
+		state->keys = malloc(sizeof(uint64_t) * state->capacity);
+		state->used = calloc(state->capacity, 1);
+		state->count = 0;
+		state->deleted = 0;
+		for(size_t i = 0; i < capacity; ++i)
+		{
+			if(used[i] == 1)
+				ui_tree_insert_(state, keys[i]);
+		}
+		free(keys);
+		free(used);
 	}
-	ui_element_bounds_(e);
-
-	ui_element_layout_next_(e);
-	return ui_clicked() && ui_mouse_test_rectangle(&e->rect);
+	size_t mask = state->capacity - 1;
+	size_t i = ui_tree_hash_(node) & mask;
+	while(state->used[i] == 1)
+		i = (i + 1) & mask;
+	if(state->used[i] == 2)
+		state->deleted--;
+	state->keys[i] = node;
+	state->used[i] = 1;
+	state->count++;
 }
 
-bool ui_text_ex(const char *label, char *out_text, size_t out_text_length, UIVec2 size)
+static void ui_tree_toggle_node_(UITreeState *state, uint64_t node)
 {
-	UIElement *e = ui_new_element_(k_EUIElementTypeInput);
-	e->u.input.input_type = k_EUIInputElementTypeText;
-	snprintf(e->label, sizeof(e->label), "%s", label);
-	e->u.input.out_value = out_text;
-	e->u.input.out_value_length = out_text_length;
-	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorInput);
-	ui_element_style_(e, style);
-	if(size.x > 0.f)
+	size_t i = state->capacity > 0 ? ui_tree_find_(state, node) : (size_t)-1;
+	if(i != (size_t)-1)
 	{
-		e->style.width = size.x;
+		state->used[i] = 2;
+		state->count--;
+		state->deleted++;
 	}
-	ui_element_bounds_(e);
-
-	ui_element_layout_next_(e);
-	if(ui_ctx.text_input_changed && ui_ctx.input_element.out_value == out_text)
+	else
 	{
-		ui_clear_input();
-		return true;
+		ui_tree_insert_(state, node);
 	}
-	return false;
+	state->dirty = true;
 }
 
-bool ui_image(unsigned int image_id, UIVec2 size)
-{
-	UIElement *e = ui_new_element_(k_EUIElementTypeImage);
-	e->u.image.image_id = image_id;
-	e->label[0] = 0;
-	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorDefault);
-	ui_element_style_(e, style);
-	e->style.width = size.x;
-	e->style.height = size.y;
-	ui_element_bounds_(e);
-
-	ui_element_layout_next_(e);
-	return false;
-}
-
-bool ui_image_from_path(const char *path, unsigned int *image_id, UIVec2 size)
+static void ui_tree_push_row_(UITreeState *state, uint64_t node, int depth, bool has_children)
 {
-	if(*image_id == 0)
+	if(state->numrows >= state->maxrows)
 	{
-		*image_id = ui_load_image(path);
+		state->maxrows = state->maxrows == 0 ? 256 : state->maxrows * 2;
+		state->rows = realloc(state->rows, sizeof(UITreeRow) * state->maxrows);
 	}
-	return ui_image(*image_id, size);
+	UITreeRow *row = &state->rows[state->numrows++];
+	row->node = node;
+	row->depth = depth;
+	row->has_children = has_children;
 }
 
-//TODO: set ui_ctx.input_filter to only accept integer values
+typedef struct
+{
+	uint64_t node;
+	size_t next, count;
+} UITreeFrame;
 
-bool ui_integer_ex(const char *label, int *out_integer, UIVec2 size)
+// Only expanded nodes have their children requested
+static void ui_tree_flatten_(UITreeState *state, const UITree *tree)
 {
-	UIElement *e = ui_new_element_(k_EUIElementTypeInput);
-	e->u.input.input_type = k_EUIInputElementTypeInteger;
-	snprintf(e->label, sizeof(e->label), "%s", label);
-	e->u.input.out_value = out_integer;
-	e->u.input.out_value_length = sizeof(int);
-	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorInput);
-	ui_element_style_(e, style);
-	if(size.x > 0.f)
+	size_t maxframes = 64, numframes = 0;
+	UITreeFrame *stack = malloc(sizeof(UITreeFrame) * maxframes);
+	stack[numframes++] = (UITreeFrame) { tree->root, 0, tree->child_count(tree->userdata, tree->root) };
+	state->numrows = 0;
+	while(numframes > 0)
 	{
-		e->style.width = size.x;
+		UITreeFrame *top = &stack[numframes - 1];
+		if(top->next == top->count)
+		{
+			--numframes;
+			continue;
+		}
+		uint64_t child = tree->child(tree->userdata, top->node, top->next++);
+		int depth = (int)numframes - 1;
+		if(!ui_tree_expanded_(state, child))
+		{
+			bool has_children = tree->has_children ? tree->has_children(tree->userdata, child) : true;
+			ui_tree_push_row_(state, child, depth, has_children);
+			continue;
+		}
+		size_t count = tree->child_count(tree->userdata, child);
+		ui_tree_push_row_(state, child, depth, count > 0);
+		if(count > 0)
+		{
+			if(numframes >= maxframes)
+			{
+				maxframes *= 2;
+				stack = realloc(stack, sizeof(UITreeFrame) * maxframes);
+			}
+			stack[numframes++] = (UITreeFrame) { child, 0, count };
+		}
 	}
-	ui_element_bounds_(e);
+	free(stack);
+	state->root = tree->root;
+	state->version = tree->version;
+	state->dirty = false;
+	state->valid = true;
+}
 
+typedef struct
+{
+	const UITree *tree;
+	UITreeState *state;
+	float indent;
+} UITreeListContext;
+
+static void ui_tree_row_(void *userdata, size_t index)
+{
+	UITreeListContext *ctx = userdata;
+	UITreeRow *row = &ctx->state->rows[index];
+	ui_ctx.x += row->depth * ctx->indent;
+	UIElement *e = ui_new_element_(k_EUIElementTypeLabel);
+	if(row->has_children)
+		ui_element_set_label_(e, ui_tree_expanded_(ctx->state, row->node) ? "-" : "+");
+	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorDefault);
+	const UIStyleProps *props = &style->initial;
+	ui_element_style_(e, style, (UIVec2) { ctx->indent - props->padding_x - props->margin - props->border_thickness * 2.f, 0.f });
 	ui_element_layout_next_(e);
-	if(ui_ctx.text_input_changed && ui_ctx.input_element.out_value == out_integer)
+	if(row->has_children && ui_element_take_click_(e))
 	{
-		*out_integer = atoi(ui_ctx.active_text_input);
-		ui_clear_input();
-		return true;
+		// Takes effect next frame, the rows of this frame are already laid out
+		ui_tree_toggle_node_(ctx->state, row->node);
 	}
-	return false;
+	ui_sameline();
+	ctx->tree->row(ctx->tree->userdata, row->node, row->depth);
 }
-bool ui_float_ex(const char *label, float *out_number, UIVec2 size)
+
+void ui_tree(const char *id, const UITree *tree, UIVec2 size)
 {
-	UIElement *e = ui_new_element_(k_EUIElementTypeInput);
-	e->u.input.input_type = k_EUIInputElementTypeFloat;
-	snprintf(e->label, sizeof(e->label), "%s", label);
-	e->u.input.out_value = out_number;
-	e->u.input.out_value_length = sizeof(int);
-	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorInput);
-	ui_element_style_(e, style);
-	if(size.x > 0.f)
+	// The list pane below owns ui_id_(id)
+	UITreeState *state = ui_state_ex_(ui_id_append_(ui_id_(id), "#tree"), sizeof(UITreeState), ui_tree_state_destroy_);
+	if(!state->valid || state->dirty || state->root != tree->root || state->version != tree->version)
 	{
-		e->style.width = size.x;
+		ui_tree_flatten_(state, tree);
 	}
-	ui_element_bounds_(e);
+	UIStyleProps *props = &ui_get_element_style_(k_EUIStyleSelectorDefault)->initial;
+	float row_height = ui_ctx.default_font->height + props->border_thickness * 2.f + props->padding_y + props->margin;
 
-	ui_element_layout_next_(e);
-	if(ui_ctx.text_input_changed && ui_ctx.input_element.out_value == out_number)
-	{
-		*out_number = (float)atof(ui_ctx.active_text_input);
-		ui_clear_input();
-		return true;
-	}
-	return false;
+	UITreeListContext ctx = { tree, state, 0.f };
+	ui_font_measure_text(ui_ctx.default_font, "+", NULL, &ctx.indent, NULL);
+	ctx.indent += props->padding_x + props->margin + props->border_thickness * 2.f;
+
+	UIList list = { 0 };
+	list.row_count = state->numrows;
+	list.row_height = row_height;
+	list.row = ui_tree_row_;
+	list.userdata = &ctx;
+	ui_list(id, &list, size);
 }
 
-bool ui_checkbox_ex(const char *label, bool *out_cond, UIVec2 size)
+bool ui_text_editor(const char *id, UITextBuffer *buffer, UIVec2 size)
 {
-	UIElement *e = ui_new_element_(k_EUIElementTypeCheckbox);
-	snprintf(e->label, sizeof(e->label), "%s", label);
-	e->u.checkbox.state = out_cond;
-	UIStyle *style = ui_get_element_style_(k_EUIStyleSelectorInput);
-	ui_element_style_(e, style);
-	if(size.x > 0.f)
-	{
-		e->style.width = size.x;
-	}
-	ui_element_bounds_(e);
+	float line_height = ui_ctx.default_font->height;
+	ui_begin_pane(id, size);
+	UIPane *pane = &ui_ctx.panes[ui_ctx.pane_depth - 1];
+	UIPaneState *state = pane->state;
+	float top = pane->content_y - state->scroll_y;
+	size_t first = min((size_t)(state->scroll_y / line_height), buffer->numlines);
+	size_t visible = min((size_t)ceilf(pane->clip.h / line_height) + 1, buffer->numlines - first);
+	buffer->page_lines = (size_t)(pane->clip.h / line_height);
 
+	UIElement *e = ui_new_element_(k_EUIElementTypeEditor);
+	e->style = ui_intern_style_(&ui_get_element_style_(k_EUIStyleSelectorInput)->initial);
+	e->u.editor.buffer = buffer;
+	e->u.editor.first = first;
+	e->u.editor.last = first + visible;
+	e->u.editor.line_height = line_height;
+	e->rect.x = pane->content_x - state->scroll_x;
+	e->rect.y = top + first * line_height;
+	e->rect.w = pane->clip.w + state->scroll_x;
+	e->rect.h = visible * line_height;
+	ui_ctx.y = e->rect.y;
 	ui_element_layout_next_(e);
-	bool pressed = ui_clicked() && ui_mouse_test_rectangle(&e->rect);
-	if(pressed)
+	// Only visible lines are measured, the width grows as wider lines scroll into view
+	for(size_t line = first; line < first + visible; ++line)
+		ui_text_buffer_line_width_(buffer, line);
+	pane->max_x = max(pane->max_x, e->rect.x + buffer->max_width + line_height);
+	pane->max_y = max(pane->max_y, top + buffer->numlines * line_height);
+
+	const UIMousePress *press = ui_first_press_(0);
+	if(press)
 	{
-		*out_cond ^= 1;
+		if(ui_point_test_rectangle_(&pane->clip, pane->transform, (float)press->x, (float)press->y))
+		{
+			ui_clear_input();
+			ui_ctx.active_editor = buffer;
+			float x = (float)press->x, y = (float)press->y;
+			if(e->transform != 0)
+				ui_affine_apply_(ui_ctx.transforms[e->transform].inverse, x, y, &x, &y);
+			size_t line = (size_t)max(0.f, (y - top) / line_height);
+			line = min(line, buffer->numlines - 1);
+			bool shift = ui_ctx.scan_code_state[SDL_SCANCODE_LSHIFT] || ui_ctx.scan_code_state[SDL_SCANCODE_RSHIFT];
+			ui_text_buffer_set_caret_(buffer, ui_text_buffer_hit_(buffer, line, x - e->rect.x), shift);
+		}
+		else if(ui_ctx.active_editor == buffer)
+		{
+			ui_ctx.active_editor = NULL;
+		}
 	}
-	return pressed;
-}
+	e->u.editor.focused = ui_ctx.active_editor == buffer;
+	ui_end_pane();
 
-void ui_sameline()
-{
-	ui_ctx.sameline = true;
-	ui_ctx.sameline_count++;
+	bool changed = buffer->changed;
+	buffer->changed = false;
+	return changed;
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <stdint.h>
 
 typedef struct
 {
@@ -39,20 +40,214 @@ typedef struct
 } UITransform;
 
 // Leave push/pop stack implementations up to caller
+// Saves the cursor position as the translation with identity rotation and scale. ui_push_transform
+// translates relative to the cursor, so subtract the cursor from the translation before pushing a saved one.
 void ui_save_transform(UITransform*);
 void ui_restore_transform(UITransform*);
 
+// Affine transform for the elements that follow, composed with the enclosing ones.
+// Rotation (radians) and scale pivot around the cursor, a zero scale component is treated as 1.
+// Vertices are transformed in batches, hit testing maps the mouse through the inverse.
+void ui_push_transform(const UITransform *transform);
+void ui_pop_transform();
+
 void ui_translate(float x, float y);
 void ui_begin_frame();
 void ui_end_frame();
+// Creates a default context and makes it current for the calling thread
 bool ui_init(int width, int height);
+// Same as ui_build_draw_list followed by ui_submit_draw_list
 void ui_render();
+// Resolves interaction and records the frame into the back draw list, no GL calls are made unless the
+// context has never submitted a list and runs on the GL thread, then unloaded textures are deleted and
+// atlas pages repacked here
+void ui_build_draw_list();
+// Draws the most recently built list, can run on the render thread while the next frame is built.
+// Unloaded or evicted textures and atlas repacks are applied here once no published list still uses them,
+// so are the cursor and text input state the list was built with.
+void ui_submit_draw_list();
 void ui_update();
 void ui_cleanup();
 
+typedef struct UIContext_s UIContext;
+
+// A context shares the font, shader, atlas and image cache of share, or creates its own when share is NULL.
+// Contexts can be built on different threads, each thread calls ui_set_context before building.
+// Font and image loading upload textures right away on the thread that created the shared state. Elsewhere
+// ui_load_font returns NULL and ui_load_image the default image, ui_image_from_path draws the default image
+// until the next ui_submit_draw_list has loaded it.
+// Cursor and text input changes are applied by ui_submit_draw_list, which also makes GL calls.
+UIContext *ui_create_context(int width, int height, UIContext *share);
+void ui_destroy_context(UIContext *ctx);
+void ui_set_context(UIContext *ctx);
+UIContext *ui_get_context();
+
+// Linked shader programs are cached there keyed by driver and source, NULL or "" disables the cache.
+// Off by default, takes effect for programs that haven't been used yet.
+void ui_program_cache_directory(const char *dir);
+
+typedef enum
+{
+	k_EUIResourceTexture,
+	k_EUIResourceBuffer,
+	k_EUIResourceVertexArray,
+	k_EUIResourceProgram,
+	k_EUIResourceFont,
+	k_EUIResourceCursor,
+	k_EUIResourceMax
+} k_EUIResource;
+
+typedef struct
+{
+	size_t count[k_EUIResourceMax];
+	size_t bytes[k_EUIResourceMax]; // GPU memory, estimated from texture dimensions and buffer uploads
+	size_t atlas_bytes; // CPU copies of the atlas pages
+	size_t context_bytes; // Elements, draw lists and widget state of the current context
+} UIResourceStats;
+
+// Live resources shared by the current context. Everything the library created is freed when the
+// last context sharing them is destroyed, including images that were never unloaded.
+void ui_resource_stats(UIResourceStats *out_stats);
+
+typedef struct
+{
+	size_t events; // Mouse events received by ui_event
+	size_t coalesced; // Motion and wheel events merged into the previous queued event
+	size_t frames; // Submitted frames that contained input
+	float last_ms, average_ms, max_ms; // Oldest input event of a frame to its submission
+} UIInputStats;
+
+void ui_input_stats(UIInputStats *out_stats);
+
+// Streams built draw lists to a viewer process that draws them with the same renderer.
+// With compress set, frames and textures are LZ compressed using their previous version as a dictionary,
+// so content that moved still matches. Textures used by a frame are read back and sent when they change.
+typedef struct UIStream_s UIStream;
+
+typedef struct
+{
+	// Returns the number of bytes written or -1 if the connection is gone, short writes are retried
+	int (*write)(void *userdata, const void *data, size_t size);
+	// Must not block, returns the number of bytes read, 0 if nothing arrived yet or -1 if the connection is gone
+	int (*read)(void *userdata, void *data, size_t size);
+	void *userdata;
+} UIStreamTransport;
+
+typedef struct
+{
+	size_t frames; // Sent or received
+	size_t textures; // Texture uploads sent or received
+	size_t raw_bytes; // Before compression
+	size_t sent_bytes, received_bytes;
+} UIStreamStats;
+
+UIStream *ui_create_stream(const UIStreamTransport *transport, bool compress);
+#ifndef _WIN32
+// Pipe or socket file descriptors, read_fd and write_fd may be the same
+UIStream *ui_create_stream_fd(int read_fd, int write_fd, bool compress);
+#endif
+void ui_destroy_stream(UIStream *stream);
+// Sender: call after ui_build_draw_list, sends the last built list unless it was already sent.
+// Returns false once the connection is gone.
+bool ui_stream_send_frame(UIStream *stream);
+// Both sides: handles what has arrived. Input from the viewer goes through ui_event on the sender.
+// Returns true on the viewer when a new frame was received.
+bool ui_stream_poll(UIStream *stream);
+union SDL_Event;
+// Viewer: forwards input, mouse coordinates are scaled from the viewer window to the sender's size
+bool ui_stream_send_event(UIStream *stream, const union SDL_Event *ev);
+// Viewer: draws the last received frame, clip rectangles assume the window has the sender's size
+void ui_stream_render(UIStream *stream);
+void ui_stream_stats(UIStream *stream, UIStreamStats *out_stats);
+
+typedef struct
+{
+	int x, y, w, h;
+} UIFrameRect;
+
+#define UI_FRAME_RING_MAGIC (0x52465549u) // "UIFR"
+#define UI_FRAME_RING_MAX_SLOTS (8)
+
+// Layout of the shared memory segment, RGBA8 pixels of a slot start at offset from the segment start.
+// A slot is being written while its sequence is odd: read sequence, read the pixels, and check that
+// sequence is unchanged. latest and sequence are accessed atomically by the writer.
+typedef struct
+{
+	volatile int sequence;
+	uint32_t frame; // Ring write counter, a gap means dirty no longer covers everything since the last one read
+	uint32_t timestamp; // SDL_GetTicks when written
+	UIFrameRect dirty; // Changed since the previous frame, empty if nothing did
+	uint32_t untextured; // Draw commands whose texture has no CPU copy, drawn with their vertex color only
+	uint64_t offset;
+} UIFrameSlot;
+
+typedef struct
+{
+	uint32_t magic; // Set once the header is complete
+	uint32_t width, height, stride; // stride in bytes
+	uint32_t numslots;
+	volatile int latest; // Slot holding the newest frame, -1 before the first
+	UIFrameSlot slots[UI_FRAME_RING_MAX_SLOTS];
+} UIFrameRingHeader;
+
+#ifndef _WIN32
+typedef struct UIFrameRing_s UIFrameRing;
+
+// Frames rendered on the CPU into a ring of shared memory slots for another local process.
+// With a name the segment is shm_open'ed under it, NULL creates an anonymous one to pass on by fd.
+UIFrameRing *ui_create_frame_ring(const char *name, int width, int height, int numslots);
+void ui_destroy_frame_ring(UIFrameRing *ring);
+int ui_frame_ring_fd(UIFrameRing *ring);
+// Rasterizes the last built draw list into the next slot, only the area that changed since the slot's
+// previous frame is redrawn. Returns false if there was no new list.
+bool ui_frame_ring_write(UIFrameRing *ring);
+#ifdef UI_DEBUG_PNG
+bool ui_frame_ring_write_png(UIFrameRing *ring, const char *path);
+#endif
+#endif
+
 void ui_sameline();
 void ui_label(const char *fmt, ...);
 
+// Scrollable region clipped to size, elements outside of it are laid out but not drawn.
+// Scroll offsets persist per id, a pane always ends the current row.
+void ui_begin_pane(const char *id, UIVec2 size);
+void ui_end_pane();
+
+typedef enum
+{
+	k_EUILayoutRow,
+	k_EUILayoutColumn,
+	k_EUILayoutGrid
+} UILayoutType;
+
+// Containers place their direct children, a nested layout or pane counts as one child.
+// The solved positions are cached per id and only recomputed when a child size or a parameter changes.
+// Rows wrap at max_size.x and columns at max_size.y, a zero component leaves that axis unconstrained.
+void ui_begin_row(const char *id, float spacing, UIVec2 max_size);
+void ui_begin_column(const char *id, float spacing, UIVec2 max_size);
+void ui_begin_grid(const char *id, int columns, float spacing, UIVec2 max_size);
+void ui_end_layout();
+
+// Called for every visible row with the layout cursor at the start of the row
+typedef void (*UIListRowFn)(void *userdata, size_t row);
+
+typedef struct
+{
+	size_t row_count;
+	float row_height; // <= 0 for variable height rows, measured and cached once visible
+	float estimated_row_height; // Height assumed for variable rows that were never visible
+	const float *column_widths;
+	size_t column_count;
+	UIListRowFn row;
+	void *userdata;
+} UIList;
+
+// Virtualized pane, only the visible row range is laid out
+void ui_list(const char *id, const UIList *list, UIVec2 size);
+// Moves the cursor to a column of the current row, use ui_sameline to continue within a column
+void ui_list_column(size_t column);
+
 bool ui_button_ex(const char *label, UIVec2 size);
 static bool ui_button(const char *label)
 {
@@ -78,12 +273,145 @@ static bool ui_float(const char *label, float *out_value)
 {
 	return ui_float_ex(label, out_value, (UIVec2) { 0.f, 0.f });
 }
+#define UI_FLOAT_SHORTEST (-1)
+// Shows precision decimals, or the shortest text that reads back as the same value with UI_FLOAT_SHORTEST
+bool ui_float_precision_ex(const char *label, float *, int precision, UIVec2 size);
 void ui_style(UIStyle *style);
 void ui_inherit_style(int style, UIStyle *out_style);
 void ui_default_style(UIStyle *out_style);
 // Leave push/pop stack implementations up to caller
 void ui_save_style(UIStyle *);
 void ui_restore_style(UIStyle *);
+// Images no larger than the atlas threshold are packed into shared atlas pages,
+// their ids have UI_IMAGE_ATLAS_BIT set and don't name a GL texture.
+#define UI_IMAGE_ATLAS_BIT (0x80000000u)
+
 bool ui_image(unsigned int image_id, UIVec2 size);
 unsigned int ui_load_image(const char *path);
-bool ui_image_from_path(const char *path, unsigned int *image_id, UIVec2 size);
\ No newline at end of file
+void ui_unload_image(unsigned int image_id);
+
+typedef struct
+{
+	int max_width, max_height; // Box filtered down at decode time to fit, keeping the aspect ratio, 0 leaves an axis free
+	bool mipmaps;
+} UIImageLoadOptions;
+// Also accepts KTX2 files holding ETC2 data, which are uploaded compressed without decoding. max_width and
+// max_height pick the first stored mip level that fits, mipmaps uploads the rest of the stored chain.
+unsigned int ui_load_image_ex(const char *path, const UIImageLoadOptions *options);
+#ifdef UI_KTX2_WRITER
+// Encodes an image to a KTX2 file with ETC2 data, for converting assets ahead of time
+bool ui_convert_image_ktx2(const char *src_path, const char *dst_path, bool mipmaps);
+#endif
+bool ui_image_from_path(const char *path, unsigned int *image_id, UIVec2 size);
+
+typedef struct
+{
+	size_t hits, misses, reloads, evictions;
+	size_t entries;
+	size_t bytes, budget;
+} UIImageCacheStats;
+
+// Shared texture cache keyed by path, reloaded when the file's mtime changes.
+// Images drawn this frame or acquired (refcount > 0) are never evicted.
+// Acquired ids are not reloaded either, changes are picked up after the last release.
+unsigned int ui_acquire_image(const char *path);
+void ui_release_image(const char *path);
+void ui_image_cache_budget(size_t bytes);
+// downscale: decode to the largest size passed to ui_image_from_path, reloading if it grows
+void ui_image_cache_options(bool downscale, bool mipmaps);
+void ui_image_cache_stats(UIImageCacheStats *out_stats);
+void ui_image_cache_clear();
+
+typedef struct
+{
+	size_t pages;
+	size_t images;
+	size_t repacks;
+	size_t used_area, freed_area; // In texels
+} UIImageAtlasStats;
+
+// Pages are repacked once freed area exceeds repack_threshold of the allocated area
+void ui_image_atlas_config(int max_image_size, float repack_threshold);
+void ui_image_atlas_stats(UIImageAtlasStats *out_stats);
+
+// Loads one tile_size x tile_size RGBA tile of a mip level (0 is full resolution) on a loader thread.
+// Edge tiles only fill the part inside the level, out_rgba is zeroed beforehand.
+typedef bool (*UITileLoadFn)(void *userdata, int level, int tile_x, int tile_y, int tile_size, unsigned char *out_rgba);
+
+typedef struct
+{
+	int width, height; // Full resolution
+	int tile_size;
+	int levels; // 0 halves until the image fits in a single tile
+	UITileLoadFn load_tile;
+	void *userdata;
+} UITileSource;
+
+typedef struct UITiledImage_s UITiledImage;
+
+// Keeps at most max_tiles tiles resident, only tiles in view are requested
+UITiledImage *ui_create_tiled_image(const UITileSource *source, size_t max_tiles);
+// Pre-tiled pyramid on disk, path_format gets level, tile x and tile y, e.g. "scan/%d/%d_%d.png"
+UITiledImage *ui_open_tiled_image(const char *path_format, int width, int height, int tile_size, size_t max_tiles);
+void ui_destroy_tiled_image(UITiledImage *image);
+// zoom is screen pixels per image pixel, center is in full resolution image pixels
+bool ui_tiled_image(UITiledImage *image, float zoom, UIVec2 center, UIVec2 size);
+
+// Append-only ring of samples, the plot reuses decimated columns that are already complete
+typedef struct
+{
+	float *values;
+	size_t capacity;
+	size_t count;
+	size_t head; // Next write position
+	uint64_t total; // Samples pushed since init
+} UIPlotBuffer;
+
+void ui_plot_buffer_init(UIPlotBuffer *buffer, size_t capacity);
+void ui_plot_buffer_free(UIPlotBuffer *buffer);
+void ui_plot_buffer_push(UIPlotBuffer *buffer, const float *values, size_t n);
+// Decimated to min/max per pixel column, scale_min == scale_max fits the data
+bool ui_plot_lines(const char *id, const float *values, size_t count, float scale_min, float scale_max, UIVec2 size);
+bool ui_plot_buffer(const char *id, const UIPlotBuffer *buffer, float scale_min, float scale_max, UIVec2 size);
+
+typedef struct UIConsole_s UIConsole;
+
+// Fixed ring of max_lines lines, the oldest lines are overwritten
+UIConsole *ui_create_console(size_t max_lines);
+void ui_destroy_console(UIConsole *console);
+// May be called from any thread, a writer only waits when the ring laps a line still being written.
+// Lines longer than a slot continue in the next ones.
+void ui_console_append(UIConsole *console, const char *text, size_t length);
+// Write (e.g. snprintf) straight into the ring slot, at most 255 bytes, then publish with end_line
+char *ui_console_begin_line(UIConsole *console, uint32_t *out_ticket);
+void ui_console_end_line(UIConsole *console, uint32_t ticket, size_t length);
+void ui_console(const char *id, UIConsole *console, UIVec2 size);
+
+typedef struct
+{
+	// Only called for the root and for expanded nodes
+	size_t (*child_count)(void *userdata, uint64_t node);
+	uint64_t (*child)(void *userdata, uint64_t node, size_t index);
+	// Optional, decides whether a collapsed node gets an expand toggle.
+	// Without it every collapsed node has one, until expanding shows it has no children.
+	bool (*has_children)(void *userdata, uint64_t node);
+	// Draws the contents of a visible row, after the expand toggle
+	void (*row)(void *userdata, uint64_t node, int depth);
+	void *userdata;
+	uint64_t root; // Not drawn, its children are the top level rows
+	uint64_t version; // Change to refetch children after the hierarchy was modified
+} UITree;
+
+// Expanded nodes persist per id, only the visible rows are laid out
+void ui_tree(const char *id, const UITree *tree, UIVec2 size);
+
+typedef struct UITextBuffer_s UITextBuffer;
+
+// Gap buffer with a line index, edits only touch the line table past the caret
+UITextBuffer *ui_create_text_buffer(const char *text, size_t length);
+void ui_destroy_text_buffer(UITextBuffer *buffer);
+size_t ui_text_buffer_length(UITextBuffer *buffer);
+// Copies at most out_size - 1 bytes and terminates, returns the full length
+size_t ui_text_buffer_copy(UITextBuffer *buffer, char *out, size_t out_size);
+// Multi-line editor, only visible lines are drawn. Returns true if the text changed.
+bool ui_text_editor(const char *id, UITextBuffer *buffer, UIVec2 size);
\ No newline at end of file